@@ -0,0 +1,151 @@
+/*   
+ *  audiotrace.c
+ *
+ *  Copy out and decode the event trace of an audio driver that was 
+ *  built with AUDIO_TRACE. The events can be saved in a file with -w 
+ *  and be decoded later, e.g. on another machine, with -r.
+ */
+#include <sys/types.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <minix/sound.h>
+#include <ioc_audio.h>
+
+int main(int argc, char **argv);
+void usage(void);
+
+static const char *event_name[] = {
+  "?",
+  "irq",
+  "int_write",
+  "int_read",
+  "copy_start",
+  "copy_end",
+  "reply",
+  "int_sum",
+  "open",
+  "close",
+  "poll"
+};
+#define NR_EVENT_NAMES	(sizeof(event_name) / sizeof(event_name[0]))
+
+static struct dsp_trace dump;
+
+
+void usage()
+{
+  fprintf(stderr, "Usage: audiotrace [-f device] [-w file]\n"
+		  "       audiotrace -r file\n");
+  exit(-1);
+}
+
+
+/* print one event; times are relative to the first event */
+static void print_event(struct audio_trace_rec *rec, u32_t usec_per_gtsc)
+{
+  static u64_t first, prev;
+  static int started = 0;
+  double t, dt;
+
+  if (!started) {
+	first = prev = rec->tsc;
+	started = 1;
+  }
+  t = (double) (rec->tsc - first) * usec_per_gtsc / 1e9;
+  dt = (double) (rec->tsc - prev) * usec_per_gtsc / 1e9;
+  prev = rec->tsc;
+
+  printf("%12.1f us %+10.1f  %-10s ", t, dt,
+	rec->event < NR_EVENT_NAMES ? event_name[rec->event] : "?");
+  if (rec->sub_dev == TRACE_NO_SUB_DEV)
+	printf("    -");
+  else
+	printf("%5u", rec->sub_dev);
+  printf("  %u (0x%x)\n", rec->arg, rec->arg);
+}
+
+
+/* decode a file written with -w: the time scale, followed by the events */
+static int read_file(char *file)
+{
+  FILE *fp;
+  u32_t usec_per_gtsc;
+  struct audio_trace_rec rec;
+
+  if ((fp = fopen(file, "r")) == NULL) {
+	fprintf(stderr, "Cannot open %s: %s\n", file, strerror(errno));
+	return -1;
+  }
+  if (fread(&usec_per_gtsc, sizeof(usec_per_gtsc), 1, fp) != 1) {
+	fprintf(stderr, "%s is not a trace\n", file);
+	fclose(fp);
+	return -1;
+  }
+  while (fread(&rec, sizeof(rec), 1, fp) == 1)
+	print_event(&rec, usec_per_gtsc);
+
+  fclose(fp);
+  return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  int c, audio, first;
+  unsigned int i;
+  char *device = "/dev/audio", *in = NULL, *out = NULL;
+  FILE *fp = NULL;
+
+  while ((c = getopt(argc, argv, "f:r:w:")) != -1) {
+	switch (c) {
+	case 'f': device = optarg; break;
+	case 'r': in = optarg; break;
+	case 'w': out = optarg; break;
+	default: usage();
+	}
+  }
+  if (optind != argc || (in != NULL && out != NULL)) usage();
+
+  if (in != NULL) exit(read_file(in) == 0 ? 0 : -1);
+
+  if ((audio = open(device, O_RDONLY | O_NONBLOCK)) < 0) {
+	fprintf(stderr, "Cannot open %s: %s\n", device, strerror(errno));
+	exit(-1);
+  }
+  if (out != NULL && (fp = fopen(out, "w")) == NULL) {
+	fprintf(stderr, "Cannot open %s: %s\n", out, strerror(errno));
+	exit(-1);
+  }
+
+  /* copy out everything the driver still has, chunk by chunk */
+  dump.next = 0;
+  first = 1;
+  do {
+	if (ioctl(audio, DSPIOTRACE, &dump) < 0) {
+		fprintf(stderr, "Cannot read trace (driver built without "
+			"AUDIO_TRACE?): %s\n", strerror(errno));
+		exit(-1);
+	}
+	if (first && fp != NULL)
+		fwrite(&dump.usec_per_gtsc, sizeof(dump.usec_per_gtsc), 1, fp);
+	if (dump.lost > 0)
+		fprintf(stderr, "%u events lost\n", dump.lost);
+	first = 0;
+
+	for (i = 0; i < dump.count; i++) {
+		if (fp != NULL)
+			fwrite(&dump.rec[i], sizeof(dump.rec[i]), 1, fp);
+		else
+			print_event(&dump.rec[i], dump.usec_per_gtsc);
+	}
+  } while (dump.count == AUDIO_TRACE_CHUNK);
+
+  if (fp != NULL) fclose(fp);
+  close(audio);
+  exit(0);
+}
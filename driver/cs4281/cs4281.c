@@ -5,8 +5,9 @@
 DEV_STRUCT dev;
 aud_sub_dev_conf_t aud_conf[3];
 sub_dev_t sub_dev[3];
-special_file_t special_file[3];
+special_file_t special_file[4];
 drv_t drv;
+static u32_t intr_polled;	/* sub devices with their interrupt off */
 
 /* internal function */
 static int dev_probe(void);
@@ -285,9 +286,12 @@ static u32_t dev_read_clear_intr_status(u32_t *base) {
 static void dev_intr_enable(u32_t *base, int flag) {
 	u32_t data, base0 = base[0];
 	if (flag == INTR_ENABLE) {
+		/* DMA0 is the DAC, DMA1 the ADC; leave polled ones masked */
+		data = CMD_INTR_DMA;
+		if (!(intr_polled & (1 << DAC))) data |= CMD_INTR_DMA0;
+		if (!(intr_polled & (1 << ADC))) data |= CMD_INTR_DMA1;
 		sdr_out32(base0, REG_INTR_CTRL, CMD_INTR_ENABLE);
-		sdr_out32(base0, REG_INTR_MASK, ~(CMD_INTR_DMA | CMD_INTR_DMA0 |
-										CMD_INTR_DMA1));
+		sdr_out32(base0, REG_INTR_MASK, ~data);
 	}
 	else if (flag == INTR_DISABLE) {
 		sdr_out32(base0, REG_INTR_CTRL, ~CMD_INTR_ENABLE);
@@ -406,20 +410,11 @@ static int free_buf(u32_t *val, int *len, int num) {
 	return OK;
 }
 
-/* Get the current sample counter */
-static int get_samples_in_buf(u32_t *result, int *len, int chan) {
-	u32_t res;
-	/* READ_DMA_CURRENT_ADDR */
-	res = dev_read_dma_current(dev.base, chan);
-	*result = (u32_t)(sub_dev[chan].BufLength * 8192) + res;
-	return OK;
-}
-
 /* ======= [Audio interface] Initialize data structure ======= */
 int drv_init(void) {
 	drv.DriverName = DRIVER_NAME;
 	drv.NrOfSubDevices = 3;
-	drv.NrOfSpecialFiles = 3;
+	drv.NrOfSpecialFiles = 4;
 
 	sub_dev[DAC].readable = 0;
 	sub_dev[DAC].writable = 1;
@@ -453,6 +448,13 @@ int drv_init(void) {
 	special_file[2].read_chan = NO_CHANNEL;
 	special_file[2].io_ctl = MIX;
 
+	/* the DAC again, for up to MIX_CLIENTS writers that the framework 
+	   mixes */
+	special_file[3].minor_dev_nr = 3;
+	special_file[3].write_chan = DAC;
+	special_file[3].read_chan = NO_CHANNEL;
+	special_file[3].io_ctl = DAC;
+
 	return OK;
 }
 
@@ -546,13 +548,28 @@ int drv_stop(int sub_dev) {
 	return OK;
 }
 
+/* ======= [Audio interface] Start two channels together ======= */
+int drv_start_linked(int UNUSED(write_sub_dev), int UNUSED(read_sub_dev)) {
+	/* each channel is started by its own register */
+	return ENOSYS;
+}
+
 /* ======= [Audio interface] Enable interrupt ======= */
 int drv_reenable_int(int chan) {
+	intr_polled &= ~(1 << chan);
 	/* INTR_ENABLE_DISABLE */
 	dev_intr_enable(dev.base, INTR_ENABLE);
 	return OK;
 }
 
+/* ======= [Audio interface] Disable interrupt ======= */
+int drv_disable_int(int chan) {
+	/* the other sub device may still interrupt */
+	intr_polled |= 1 << chan;
+	dev_intr_enable(dev.base, INTR_ENABLE);
+	return OK;
+}
+
 /* ======= [Audio interface] I/O control ======= */
 int drv_io_ctl(unsigned long request, void *val, int *len, int sub_dev) {
 	int status;
@@ -581,9 +598,6 @@ int drv_io_ctl(unsigned long request, void *val, int *len, int sub_dev) {
 		case DSPIOFREEBUF:
 			status = free_buf(val, len, sub_dev);
 			break;
-		case DSPIOSAMPLESINBUF:
-			status = get_samples_in_buf(val, len, sub_dev);
-			break;
 		case DSPIOPAUSE:
 			status = drv_pause(sub_dev);
 			break;
@@ -611,12 +625,109 @@ int drv_get_irq(char *irq) {
 	return OK;
 }
 
+/* ======= [Audio interface] Get nr. of cards ======= */
+int drv_get_nr_cards(void) {
+	/* only the first card found is used */
+	return 1;
+}
+
+/* ======= [Audio interface] Get the card of a sub device ======= */
+int drv_get_card(int UNUSED(sub_dev)) {
+	return 0;
+}
+
+/* ======= [Audio interface] Get request number of a card ======= */
+int drv_get_card_irq(int UNUSED(card), char *irq) {
+	return drv_get_irq(irq);
+}
+
 /* ======= [Audio interface] Get fragment size ======= */
 int drv_get_frag_size(u32_t *frag_size, int sub_dev) {
 	*frag_size = aud_conf[sub_dev].fragment_size;
 	return OK;
 }
 
+/* ======= [Audio interface] Get max. number of fragments ======= */
+int drv_get_max_fragments(int UNUSED(sub_dev)) {
+	/* the device only interrupts at half and at the end of the dma buffer */
+	return 2;
+}
+
+/* ======= [Audio interface] Set all stream parameters ======= */
+int drv_set_params(struct dsp_params *params, int num) {
+	u32_t i, diff, best, best_diff;
+
+	if ((params->bits != 8 && params->bits != 16) ||
+		params->frag_size > (sub_dev[num].DmaSize / 
+			sub_dev[num].NrOfDmaFragments) ||
+		params->frag_size < sub_dev[num].MinFragmentSize) {
+		return EINVAL;
+	}
+	/* the device only knows the rates in g_sample_rate, take the nearest */
+	best = best_diff = 0xffffffff;
+	for (i = 0; i < sizeof(g_sample_rate) / sizeof(g_sample_rate[0]); i++) {
+		diff = (g_sample_rate[i] > params->rate) ? 
+			g_sample_rate[i] - params->rate : params->rate - g_sample_rate[i];
+		if (diff < best_diff) {
+			best = g_sample_rate[i];
+			best_diff = diff;
+		}
+	}
+	params->rate = best;
+	params->stereo = (params->stereo != 0);
+	params->sign = (params->sign != 0);
+
+	/* written to the device by drv_start */
+	aud_conf[num].sample_rate = params->rate;
+	aud_conf[num].stereo = params->stereo;
+	aud_conf[num].nr_of_bits = params->bits;
+	aud_conf[num].sign = params->sign;
+	aud_conf[num].fragment_size = params->frag_size;
+	return OK;
+}
+
+/* ======= [Audio interface] Get the stream parameters ======= */
+int drv_get_params(struct dsp_params *params, int num) {
+	params->rate = aud_conf[num].sample_rate;
+	params->stereo = aud_conf[num].stereo;
+	params->bits = aud_conf[num].nr_of_bits;
+	params->sign = aud_conf[num].sign;
+	params->frag_size = aud_conf[num].fragment_size;
+	return OK;
+}
+
+/* ======= [Audio interface] Get max. number of mixed writers ======= */
+int drv_get_mix_clients(int minor_dev_nr) {
+	return (minor_dev_nr == 3) ? MIX_CLIENTS : 0;
+}
+
+/* ======= [Audio interface] Get position in the current fragment ======= */
+int drv_get_position(int num, u32_t *frag_offset, u32_t *frame_size) {
+	u32_t done;
+
+	*frame_size = aud_conf[num].nr_of_bits * (aud_conf[num].stereo + 1) / 8;
+	drv_get_dma_offset(num, &done);
+	*frag_offset = done % aud_conf[num].fragment_size;
+	return OK;
+}
+
+/* ======= [Audio interface] Get position in the dma ring ======= */
+int drv_get_dma_offset(int num, u32_t *offset) {
+	u32_t unit, ring;
+
+#ifdef DMA_LENGTH_BY_FRAME
+	unit = aud_conf[num].nr_of_bits * (aud_conf[num].stereo + 1) / 8;
+#else
+	unit = 1;
+#endif
+	/* READ_DMA_CURRENT_ADDR: the current count runs down from the dma 
+	   length set by drv_set_dma() - 1 to 0, over the whole ring */
+	ring = sub_dev[num].NrOfDmaFragments * aud_conf[num].fragment_size;
+	*offset = (ring - (dev_read_dma_current(dev.base, num) + 1) * unit) % 
+		ring;
+	return OK;
+}
+
 /* ======= [Audio interface] Set DMA channel ======= */
 int drv_set_dma(u32_t dma, u32_t length, int chan) {
 #ifdef DMA_LENGTH_BY_FRAME
@@ -633,12 +744,15 @@ int drv_int_sum(void) {
 	/* ### READ_CLEAR_INTR_STS ### */
 	status = dev_read_clear_intr_status(dev.base);
 	dev.intr_status = status;
-#ifdef MY_DEBUG
-	printf("SDR: Interrupt status is 0x%08x\n", status);
-#endif
+	TRACE(TRACE_INT_SUM, TRACE_NO_SUB_DEV, status);
 	return (status & (INTR_STS_DAC | INTR_STS_ADC));
 }
 
+/* ======= [Audio interface] Get interrupt summary status of a card ======= */
+int drv_card_int_sum(int UNUSED(card)) {
+	return drv_int_sum();
+}
+
 /* ======= [Audio interface] Handle interrupt status ======= */
 int drv_int(int sub_dev) {
 	u32_t mask;
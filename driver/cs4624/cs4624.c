@@ -12,8 +12,9 @@
 DEV_STRUCT dev;
 aud_sub_dev_conf_t aud_conf[3];
 sub_dev_t sub_dev[3];
-special_file_t special_file[3];
+special_file_t special_file[4];
 drv_t drv;
+static u32_t intr_polled;	/* sub devices with their interrupt off */
 
 void snd_mychip_pokeBA1(DEV_STRUCT *dev, u32_t reg, u32_t val){
 	u16_t bank = reg >> 16;
@@ -797,11 +798,13 @@ static void dev_intr_enable(DEV_STRUCT *dev, int flag) {
 		snd_mychip_pokeBA0(dev, BA0_HICR, HICR_IEV | HICR_CHGM);
 		tmp = snd_mychip_peekBA0(dev, BA1_PFIE);
 		tmp &= ~0x0000f03f;
+		if (intr_polled & (1 << DAC))
+			tmp |=  0x00000010;	/* polled, keep it disabled */
 		snd_mychip_pokeBA1(dev, BA1_PFIE, tmp);	/* playback interrupt enable */
 
 		tmp = snd_mychip_peekBA1(dev, BA1_CIE);
 		tmp &= ~0x0000003f;
-		tmp |=  0x00000001;
+		tmp |=  (intr_polled & (1 << ADC)) ? 0x00000011 : 0x00000001;
 		snd_mychip_pokeBA1(dev, BA1_CIE, tmp);	/* capture interrupt enable */
 	}
 	else if (flag == INTR_DISABLE) {
@@ -945,20 +948,11 @@ static int free_buf(u32_t *val, int *len, int num) {
 	return OK;
 }
 
-/* Get the current sample counter */
-static int get_samples_in_buf(u32_t *result, int *len, int chan) {
-	u32_t res;
-	/* READ_DMA_CURRENT_ADDR */
-	res = dev_read_dma_current(dev.base, chan);
-	*result = (u32_t)(sub_dev[chan].BufLength * 8192) + res;
-	return OK;
-}
-
 /* ======= [Audio interface] Initialize data structure ======= */
 int drv_init(void) {
 	drv.DriverName = DRIVER_NAME;
 	drv.NrOfSubDevices = 3;
-	drv.NrOfSpecialFiles = 3;
+	drv.NrOfSpecialFiles = 4;
 	//snd_pcm_lib_preallocate_pages_for_all(pcm, SNDRV_DMA_TYPE_DEV, snd_dma_pci_data(&dev->pci), 64*1024, 256*1024);
 	sub_dev[DAC].readable = 0;
 	sub_dev[DAC].writable = 1;
@@ -992,6 +986,13 @@ int drv_init(void) {
 	special_file[2].read_chan = NO_CHANNEL;
 	special_file[2].io_ctl = MIX;
 
+	/* the DAC again, for up to MIX_CLIENTS writers that the framework 
+	   mixes */
+	special_file[3].minor_dev_nr = 3;
+	special_file[3].write_chan = DAC;
+	special_file[3].read_chan = NO_CHANNEL;
+	special_file[3].io_ctl = DAC;
+
 	FUNC_LOG();
 	return OK;
 }
@@ -1150,13 +1151,28 @@ int drv_stop(int sub_dev) {
 	return OK;
 }
 
+/* ======= [Audio interface] Start two channels together ======= */
+int drv_start_linked(int UNUSED(write_sub_dev), int UNUSED(read_sub_dev)) {
+	/* each channel is started by its own register */
+	return ENOSYS;
+}
+
 /* ======= [Audio interface] Enable interrupt ======= */
 int drv_reenable_int(int chan) {
+	intr_polled &= ~(1 << chan);
 	/* INTR_ENABLE_DISABLE */
 	dev_intr_enable(&dev, INTR_ENABLE);
 	return OK;
 }
 
+/* ======= [Audio interface] Disable interrupt ======= */
+int drv_disable_int(int chan) {
+	/* the other sub device may still interrupt */
+	intr_polled |= 1 << chan;
+	dev_intr_enable(&dev, INTR_ENABLE);
+	return OK;
+}
+
 /* ======= [Audio interface] I/O control ======= */
 int drv_io_ctl(unsigned long request, void *val, int *len, int sub_dev) {
 	int status;
@@ -1185,9 +1201,6 @@ int drv_io_ctl(unsigned long request, void *val, int *len, int sub_dev) {
 		case DSPIOFREEBUF:
 			status = free_buf(val, len, sub_dev);
 			break;
-		case DSPIOSAMPLESINBUF:
-			status = get_samples_in_buf(val, len, sub_dev);
-			break;
 		case DSPIOPAUSE:
 			status = drv_pause(sub_dev);
 			break;
@@ -1215,12 +1228,101 @@ int drv_get_irq(char *irq) {
 	return OK;
 }
 
+/* ======= [Audio interface] Get nr. of cards ======= */
+int drv_get_nr_cards(void) {
+	/* only the first card found is used */
+	return 1;
+}
+
+/* ======= [Audio interface] Get the card of a sub device ======= */
+int drv_get_card(int UNUSED(sub_dev)) {
+	return 0;
+}
+
+/* ======= [Audio interface] Get request number of a card ======= */
+int drv_get_card_irq(int UNUSED(card), char *irq) {
+	return drv_get_irq(irq);
+}
+
 /* ======= [Audio interface] Get fragment size ======= */
 int drv_get_frag_size(u32_t *frag_size, int sub_dev) {
 	*frag_size = aud_conf[sub_dev].fragment_size;
 	return OK;
 }
 
+/* ======= [Audio interface] Get max. number of fragments ======= */
+int drv_get_max_fragments(int UNUSED(sub_dev)) {
+	/* the device only interrupts at half and at the end of the dma buffer */
+	return 2;
+}
+
+/* ======= [Audio interface] Set all stream parameters ======= */
+int drv_set_params(struct dsp_params *params, int num) {
+	if ((params->bits != 8 && params->bits != 16 && params->bits != 32) ||
+		params->frag_size > (sub_dev[num].DmaSize / 
+			sub_dev[num].NrOfDmaFragments) ||
+		params->frag_size < sub_dev[num].MinFragmentSize) {
+		return EINVAL;
+	}
+	/* the sample rate converters work from 48000 down to a ninth of it */
+	if (params->rate * 9 < 48000)
+		params->rate = 48000 / 9;
+	if (params->rate > 48000)
+		params->rate = 48000;
+	params->stereo = (params->stereo != 0);
+	params->sign = (params->sign != 0);
+
+	/* written to the device by drv_start */
+	aud_conf[num].sample_rate = params->rate;
+	aud_conf[num].stereo = params->stereo;
+	aud_conf[num].nr_of_bits = params->bits;
+	aud_conf[num].sign = params->sign;
+	aud_conf[num].fragment_size = params->frag_size;
+	return OK;
+}
+
+/* ======= [Audio interface] Get the stream parameters ======= */
+int drv_get_params(struct dsp_params *params, int num) {
+	params->rate = aud_conf[num].sample_rate;
+	params->stereo = aud_conf[num].stereo;
+	params->bits = aud_conf[num].nr_of_bits;
+	params->sign = aud_conf[num].sign;
+	params->frag_size = aud_conf[num].fragment_size;
+	return OK;
+}
+
+/* ======= [Audio interface] Get max. number of mixed writers ======= */
+int drv_get_mix_clients(int minor_dev_nr) {
+	return (minor_dev_nr == 3) ? MIX_CLIENTS : 0;
+}
+
+/* ======= [Audio interface] Get position in the current fragment ======= */
+int drv_get_position(int num, u32_t *frag_offset, u32_t *frame_size) {
+	u32_t done;
+
+	*frame_size = aud_conf[num].nr_of_bits * (aud_conf[num].stereo + 1) / 8;
+	drv_get_dma_offset(num, &done);
+	*frag_offset = done % aud_conf[num].fragment_size;
+	return OK;
+}
+
+/* ======= [Audio interface] Get position in the dma ring ======= */
+int drv_get_dma_offset(int num, u32_t *offset) {
+	u32_t unit, ring;
+
+#ifdef DMA_LENGTH_BY_FRAME
+	unit = aud_conf[num].nr_of_bits * (aud_conf[num].stereo + 1) / 8;
+#else
+	unit = 1;
+#endif
+	/* READ_DMA_CURRENT_ADDR: the current count runs down from the dma 
+	   length set by drv_set_dma() - 1 to 0, over the whole ring */
+	ring = sub_dev[num].NrOfDmaFragments * aud_conf[num].fragment_size;
+	*offset = (ring - (dev_read_dma_current(dev.base, num) + 1) * unit) % 
+		ring;
+	return OK;
+}
+
 /* ======= [Audio interface] Set DMA channel ======= */
 int drv_set_dma(u32_t dma, u32_t length, int chan) {
 #ifdef DMA_LENGTH_BY_FRAME
@@ -1237,13 +1339,16 @@ int drv_int_sum(void) {
 	/* ### READ_CLEAR_INTR_STS ### */
 	status = dev_read_clear_intr_status(&dev);
 	dev.intr_status = status;
-#ifdef MY_DEBUG
-	printf("SDR: Interrupt status is 0x%08x\n", status);
-#endif
+	TRACE(TRACE_INT_SUM, TRACE_NO_SUB_DEV, status);
 	//return (status & (INTR_STS_DAC | INTR_STS_ADC));
 	return (status & (HISR_VC0 | HISR_VC1));
 }
 
+/* ======= [Audio interface] Get interrupt summary status of a card ======= */
+int drv_card_int_sum(int UNUSED(card)) {
+	return drv_int_sum();
+}
+
 /* ======= [Audio interface] Handle interrupt status ======= */
 int drv_int(int sub_dev) {
 	u32_t mask;
@@ -7,6 +7,8 @@
 #define MIXER_AC97
 
 #include <minix/audio_fw.h>
+#include <audio_fw_ext.h>
+#include <audio_trace.h>
 #include <sys/types.h>
 #include <sys/ioc_sound.h>
 #include <minix/sound.h>
@@ -19,6 +21,9 @@
 #define ADC		1
 #define MIX		2
 
+/* writers the framework mixes onto DAC, see minor device 3 */
+#define MIX_CLIENTS		4
+
 /* PCI number and driver name */
 #define VENDOR_ID		0x1013
 #define DEVICE_ID		0x6003
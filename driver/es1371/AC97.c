@@ -12,9 +12,11 @@ static int AC97_write_unsynced(const DEV_STRUCT * pCC, u16_t wAddr,
 	u16_t wData);
 static int AC97_read_unsynced(const DEV_STRUCT * pCC, u16_t wAddr,
 	u16_t *data);
-static void set_nice_volume(void);
-static int AC97_get_volume(struct volume_level *level);
-static int AC97_set_volume(const struct volume_level *level);
+static void set_nice_volume(const DEV_STRUCT * pCC);
+static int AC97_get_volume(const DEV_STRUCT * pCC, 
+	struct volume_level *level);
+static int AC97_set_volume(const DEV_STRUCT * pCC, 
+	const struct volume_level *level);
 
 
 
@@ -52,7 +54,6 @@ static int AC97_set_volume(const struct volume_level *level);
    
 #define SRC_UNSYNCED 0xffffffffUL
 static u32_t SrcSyncState = 0x00010000UL;
-static DEV_STRUCT *dev;
 
 
 #if 0
@@ -249,8 +250,6 @@ int AC97_init( DEV_STRUCT * pCC ) {
 	int retVal;
     /* All powerdown modes: off */
     
-	dev = pCC;
-
     retVal = AC97_write (pCC, AC97_POWERDOWN_CONTROL_STAT,  0x0000U);   
     if (OK != retVal)
         return (retVal);
@@ -303,47 +302,48 @@ int AC97_init( DEV_STRUCT * pCC ) {
     if (OK != retVal)
         return (retVal);
 
-	set_nice_volume();
+	set_nice_volume(pCC);
 
     return OK;
 }
 
 
-static void set_nice_volume(void) {
+static void set_nice_volume(const DEV_STRUCT * pCC) {
   /* goofy code to set the DAC1 channel to an audibe volume 
      to be able to test it without using the mixer */
   
-  AC97_write_unsynced(dev, AC97_PCM_OUT_VOLUME, 0x0808);/* the higher, 
+  AC97_write_unsynced(pCC, AC97_PCM_OUT_VOLUME, 0x0808);/* the higher, 
 														   the softer */
-  AC97_write_unsynced(dev, AC97_MASTER_VOLUME, 0x0101);
-  AC97_write_unsynced(dev, 0x38, 0);                    /* not crucial */
+  AC97_write_unsynced(pCC, AC97_MASTER_VOLUME, 0x0101);
+  AC97_write_unsynced(pCC, 0x38, 0);                    /* not crucial */
  
-  AC97_write_unsynced(dev, AC97_LINE_IN_VOLUME, 0x0303);
-  AC97_write_unsynced(dev, AC97_MIC_VOLUME, 0x005f);
+  AC97_write_unsynced(pCC, AC97_LINE_IN_VOLUME, 0x0303);
+  AC97_write_unsynced(pCC, AC97_MIC_VOLUME, 0x005f);
   
   /* mute record gain */
-  AC97_write_unsynced(dev, AC97_RECORD_GAIN_VOLUME, 0xFFFF);
+  AC97_write_unsynced(pCC, AC97_RECORD_GAIN_VOLUME, 0xFFFF);
   /* mic record volume high */
-  AC97_write_unsynced(dev, AC97_RECORD_GAIN_MIC_VOL, 0x0000);
+  AC97_write_unsynced(pCC, AC97_RECORD_GAIN_MIC_VOL, 0x0000);
   
    /* Also, to be able test recording without mixer:
      select ONE channel as input below. */
      
   /* select LINE IN */
-  /*AC97_write_unsynced(dev, AC97_RECORD_SELECT, 0x0404);*/
+  /*AC97_write_unsynced(pCC, AC97_RECORD_SELECT, 0x0404);*/
   
   /* select MIC */
-  AC97_write_unsynced(dev, AC97_RECORD_SELECT, 0x0000);
+  AC97_write_unsynced(pCC, AC97_RECORD_SELECT, 0x0000);
   
   /* unmute record gain */
-  AC97_write_unsynced(dev, AC97_RECORD_GAIN_VOLUME, 0x0000);
+  AC97_write_unsynced(pCC, AC97_RECORD_GAIN_VOLUME, 0x0000);
 }
 
 
-static int get_volume(u8_t *left, u8_t *right, int cmd) {
+static int get_volume(const DEV_STRUCT * pCC, u8_t *left, u8_t *right, 
+		int cmd) {
 	u16_t value = 0;
 
-	AC97_read_unsynced(dev, (u16_t)cmd, &value);
+	AC97_read_unsynced(pCC, (u16_t)cmd, &value);
 
 	*left = value>>8;
 	*right = value&0xff;
@@ -352,12 +352,13 @@ static int get_volume(u8_t *left, u8_t *right, int cmd) {
 }
 
 
-static int set_volume(int left, int right, int cmd) {
+static int set_volume(const DEV_STRUCT * pCC, int left, int right, 
+		int cmd) {
 	u16_t waarde;
 
 	waarde = (u16_t)((left<<8)|right);
 
-	AC97_write_unsynced(dev, (u16_t)cmd, waarde);
+	AC97_write_unsynced(pCC, (u16_t)cmd, waarde);
 
 	return OK;
 }
@@ -383,17 +384,19 @@ void convert(int left_in, int right_in, int max_in, int *left_out,
 }
 
 
-int AC97_get_set_volume(struct volume_level *level, int flag) {
+int AC97_get_set_volume(const DEV_STRUCT * pCC, struct volume_level *level,
+		int flag) {
 	if (flag) {
-		return AC97_set_volume(level);
+		return AC97_set_volume(pCC, level);
 	}
 	else {
-		return AC97_get_volume(level);
+		return AC97_get_volume(pCC, level);
 	}
 }
 
 
-static int AC97_get_volume(struct volume_level *level) {
+static int AC97_get_volume(const DEV_STRUCT * pCC, 
+		struct volume_level *level) {
 	int cmd;
 	u8_t left;
 	u8_t right;
@@ -401,7 +404,7 @@ static int AC97_get_volume(struct volume_level *level) {
 	switch(level->device) {
 		case Master:
 			cmd = AC97_MASTER_VOLUME;
-			get_volume(&left, &right, cmd);
+			get_volume(pCC, &left, &right, cmd);
 			convert(left, right, 0x1f, 
 					&(level->left), &(level->right), 0x1f, 0);
 			break;
@@ -410,25 +413,25 @@ static int AC97_get_volume(struct volume_level *level) {
 			break;
 		case Fm:
 			cmd = AC97_PCM_OUT_VOLUME;
-			get_volume(&left, &right, cmd);
+			get_volume(pCC, &left, &right, cmd);
 			convert(left, right, 0x1f, 
 					&(level->left), &(level->right), 0x1f, 0);
 			break;
 		case Cd:
 			cmd = AC97_CD_VOLUME;
-			get_volume(&left, &right, cmd);
+			get_volume(pCC, &left, &right, cmd);
 			convert(left, right, 0x1f, 
 					&(level->left), &(level->right), 0x1f, 0);
 			break;
 		case Line:
 			cmd = AC97_LINE_IN_VOLUME;
-			get_volume(&left, &right, cmd);
+			get_volume(pCC, &left, &right, cmd);
 			convert(left, right, 0x1f, 
 					&(level->left), &(level->right), 0x1f, 0);
 			break;
 		case Mic:
 			cmd = AC97_MIC_VOLUME;
-			get_volume(&left, &right, cmd);
+			get_volume(pCC, &left, &right, cmd);
 			convert(left, right, 0x1f, 
 					&(level->left), &(level->right), 0x1f, 1);
 			break;
@@ -436,13 +439,13 @@ static int AC97_get_volume(struct volume_level *level) {
 			return EINVAL;
 		case Treble:
 			cmd = AC97_MASTER_TONE;
-			get_volume(&left, &right, cmd);
+			get_volume(pCC, &left, &right, cmd);
 			convert(left, right, 0xf, 
 					&(level->left), &(level->right), 0xf, 1);
 			break;
 		case Bass:  
 			cmd = AC97_MASTER_TONE;
-			get_volume(&left, &right, cmd);
+			get_volume(pCC, &left, &right, cmd);
 			convert(left, right, 0xf, 
 					&(level->left), &(level->right), 0xf, 1);
 			break;
@@ -453,7 +456,8 @@ static int AC97_get_volume(struct volume_level *level) {
 }
 
 
-static int AC97_set_volume(const struct volume_level *level) {
+static int AC97_set_volume(const DEV_STRUCT * pCC, 
+		const struct volume_level *level) {
 	int cmd;
 	int left;
 	int right;
@@ -490,7 +494,7 @@ static int AC97_set_volume(const struct volume_level *level) {
 		default:     
 			return EINVAL;
 	}
-	set_volume(left, right, cmd);
+	set_volume(pCC, left, right, cmd);
 
 	return OK;
 }
@@ -13,7 +13,8 @@
 */
 int AC97_init( DEV_STRUCT * pCC );
 
-int AC97_get_set_volume(struct volume_level *level, int flag);
+int AC97_get_set_volume(const DEV_STRUCT * pCC, struct volume_level *level,
+	int flag);
 
 
 
@@ -15,6 +15,10 @@
  * function prototypes you see below define a set of private helper functions.
  * Control over the AC97 codec is delegated AC97.c.  
  *
+ * One driver serves all the cards it finds, up to NR_CARDS. The sub devices
+ * and minor devices of each card are numbered after those of the one 
+ * before it, see es1371.h. 
+ *
  * October 2007    ES1371 driver (Pieter Hijma), 
  * based on ES1370 driver which is based on the ES1371 driver 
  * by Laurens Bronwasser
@@ -29,13 +33,19 @@
 #include "pci_helper.h"
 
 
-/* reg(n) will be the device specific addresses */
-#define reg(n) dev.base + n
+/* reg(cp, n) will be the device specific addresses of card cp */
+#define reg(cp, n) (cp)->dev.base + n
+
+/* the card a sub device is on, and which of its channels it is */
+#define CARD(sub_dev)	(&card[(sub_dev) / NR_SUB_DEVS])
+#define CHAN(sub_dev)	((sub_dev) % NR_SUB_DEVS)
+#define CONF(sub_dev)	(CARD(sub_dev)->aud_conf[CHAN(sub_dev)])
 
 
 /* prototypes of private functions */
 static int detect_hw(void);
-static int disable_int(int sub_dev);
+static void init_sub_devs(int c);
+static int init_card(card_t *cp, int c);
 static int set_stereo(u32_t stereo, int sub_dev);
 static int set_bits(u32_t nr_of_bits, int sub_dev);
 static int set_sample_rate(u32_t rate, int sub_dev);
@@ -43,126 +53,169 @@ static int set_sign(u32_t val, int sub_dev);
 static int get_max_frag_size(u32_t * val, int *len, int sub_dev);
 static int set_frag_size(u32_t fragment_size, int sub_dev);
 static int set_int_cnt(int sub_dev);
+static int prepare_start(int sub_dev, u32_t *enable_bit);
 static int free_buf(u32_t *val, int *len, int sub_dev);
-static int get_samples_in_buf(u32_t *val, int *len, int sub_dev);
 static int get_set_volume(struct volume_level *level, int *len, int
 	sub_dev, int flag);
 static int reset(int sub_dev);
 
 
-DEV_STRUCT dev;
-aud_sub_dev_conf_t aud_conf[4];
+card_t card[NR_CARDS];
+int nr_cards;
 
 
-sub_dev_t sub_dev[4];
-special_file_t special_file[4];
+sub_dev_t sub_dev[NR_CARDS * NR_SUB_DEVS];
+special_file_t special_file[NR_CARDS * NR_SPECIAL_FILES];
 drv_t drv;
 
 
 int drv_init(void) {
+	int c;
+
+	/* the cards we find decide how many sub devices there are */
+	if (detect_hw() != OK) {
+		return EIO;
+	}
+
 	drv.DriverName = DRIVER_NAME;
-	drv.NrOfSubDevices = 4;
-	drv.NrOfSpecialFiles = 4;
-
-	sub_dev[DAC1_CHAN].readable = 0;
-	sub_dev[DAC1_CHAN].writable = 1;
-	sub_dev[DAC1_CHAN].DmaSize = 64 * 1024;
-	sub_dev[DAC1_CHAN].NrOfDmaFragments = 2;
-	sub_dev[DAC1_CHAN].MinFragmentSize = 1024;
-	sub_dev[DAC1_CHAN].NrOfExtraBuffers = 4;
-
-	sub_dev[ADC1_CHAN].readable = 1;
-	sub_dev[ADC1_CHAN].writable = 0;
-	sub_dev[ADC1_CHAN].DmaSize = 64 * 1024;
-	sub_dev[ADC1_CHAN].NrOfDmaFragments = 2;
-	sub_dev[ADC1_CHAN].MinFragmentSize = 1024;
-	sub_dev[ADC1_CHAN].NrOfExtraBuffers = 4;
-
-	sub_dev[MIXER].writable = 0;
-	sub_dev[MIXER].readable = 0;
-
-	sub_dev[DAC2_CHAN].readable = 0;
-	sub_dev[DAC2_CHAN].writable = 1;
-	sub_dev[DAC2_CHAN].DmaSize = 64 * 1024;
-	sub_dev[DAC2_CHAN].NrOfDmaFragments = 2;
-	sub_dev[DAC2_CHAN].MinFragmentSize = 1024;
-	sub_dev[DAC2_CHAN].NrOfExtraBuffers = 4;
-
-	special_file[0].minor_dev_nr = 0;
-	special_file[0].write_chan = DAC1_CHAN;
-	special_file[0].read_chan = NO_CHANNEL;
-	special_file[0].io_ctl = DAC1_CHAN;
-
-	special_file[1].minor_dev_nr = 1;
-	special_file[1].write_chan = NO_CHANNEL;
-	special_file[1].read_chan = ADC1_CHAN;
-	special_file[1].io_ctl = ADC1_CHAN;
-
-	special_file[2].minor_dev_nr = 2;
-	special_file[2].write_chan = NO_CHANNEL;
-	special_file[2].read_chan = NO_CHANNEL;
-	special_file[2].io_ctl = MIXER;
-
-	special_file[3].minor_dev_nr = 3;
-	special_file[3].write_chan = DAC2_CHAN;
-	special_file[3].read_chan = NO_CHANNEL;
-	special_file[3].io_ctl = DAC2_CHAN;
+	drv.NrOfSubDevices = nr_cards * NR_SUB_DEVS;
+	drv.NrOfSpecialFiles = nr_cards * NR_SPECIAL_FILES;
 
+	for (c = 0; c < nr_cards; c++) {
+		init_sub_devs(c);
+	}
 	return OK;
 }
 
 
+/* the sub devices and special files of card c, see MINORS_PER_CARD */
+static void init_sub_devs(int c) {
+	sub_dev_t *sd;
+	special_file_t *sf;
+	int first, minor, i;
+
+	sd = &sub_dev[c * NR_SUB_DEVS];
+	sf = &special_file[c * NR_SPECIAL_FILES];
+	first = c * NR_SUB_DEVS;
+	minor = c * MINORS_PER_CARD;
+
+	sd[DAC1_CHAN].readable = 0;
+	sd[DAC1_CHAN].writable = 1;
+	sd[DAC1_CHAN].DmaSize = 64 * 1024;
+	sd[DAC1_CHAN].NrOfDmaFragments = 2;
+	sd[DAC1_CHAN].MinFragmentSize = 1024;
+	sd[DAC1_CHAN].NrOfExtraBuffers = 4;
+
+	sd[ADC1_CHAN].readable = 1;
+	sd[ADC1_CHAN].writable = 0;
+	sd[ADC1_CHAN].DmaSize = 64 * 1024;
+	sd[ADC1_CHAN].NrOfDmaFragments = 2;
+	sd[ADC1_CHAN].MinFragmentSize = 1024;
+	sd[ADC1_CHAN].NrOfExtraBuffers = 4;
+
+	sd[MIXER].writable = 0;
+	sd[MIXER].readable = 0;
+
+	sd[DAC2_CHAN].readable = 0;
+	sd[DAC2_CHAN].writable = 1;
+	sd[DAC2_CHAN].DmaSize = 64 * 1024;
+	sd[DAC2_CHAN].NrOfDmaFragments = 2;
+	sd[DAC2_CHAN].MinFragmentSize = 1024;
+	sd[DAC2_CHAN].NrOfExtraBuffers = 4;
+
+	sf[0].write_chan = first + DAC1_CHAN;
+	sf[0].read_chan = NO_CHANNEL;
+	sf[0].io_ctl = first + DAC1_CHAN;
+
+	sf[1].write_chan = NO_CHANNEL;
+	sf[1].read_chan = first + ADC1_CHAN;
+	sf[1].io_ctl = first + ADC1_CHAN;
+
+	sf[2].write_chan = NO_CHANNEL;
+	sf[2].read_chan = NO_CHANNEL;
+	sf[2].io_ctl = first + MIXER;
+
+	sf[3].write_chan = first + DAC2_CHAN;
+	sf[3].read_chan = NO_CHANNEL;
+	sf[3].io_ctl = first + DAC2_CHAN;
+
+	/* full duplex; DSPIOLINK can start both channels at once */
+	sf[4].write_chan = first + DAC1_CHAN;
+	sf[4].read_chan = first + ADC1_CHAN;
+	sf[4].io_ctl = first + DAC1_CHAN;
+
+	/* DAC1 again, for up to MIX_CLIENTS writers that the framework 
+	   mixes */
+	sf[5].write_chan = first + DAC1_CHAN;
+	sf[5].read_chan = NO_CHANNEL;
+	sf[5].io_ctl = first + DAC1_CHAN;
+
+	for (i = 0; i < NR_SPECIAL_FILES; i++) {
+		sf[i].minor_dev_nr = minor + i;
+	}
+}
+
+
 int drv_init_hw (void) {
-	u16_t i, j;
+	int c;
 
-	/* First, detect the hardware */
-	if (detect_hw() != OK) {
-		return EIO;
+	for (c = 0; c < nr_cards; c++) {
+		if (init_card(&card[c], c) != OK) {
+			printf("%s: could not initialize card %d\n", DRIVER_NAME, c);
+			return EIO;
+		}
 	}
+	return OK;
+}
+
+
+static int init_card(card_t *cp, int c) {
+	u16_t i, j;
 
 	/* PCI command register 
 	 * enable the SERR# driver, PCI bus mastering and I/O access
 	 */
-	pci_attr_w16 (dev.devind, PCI_CR, SERR_EN|PCI_MASTER|IO_ACCESS);
+	pci_attr_w16 (cp->dev.devind, PCI_CR, SERR_EN|PCI_MASTER|IO_ACCESS);
 
 	/* turn everything off */
-	pci_outl(reg(CHIP_SEL_CTRL),  0x0UL);
+	pci_outl(reg(cp, CHIP_SEL_CTRL),  0x0UL);
 
 	/* turn off legacy (legacy control is undocumented) */
-	pci_outl(reg(LEGACY), 0x0UL);
-	pci_outl(reg(LEGACY+4), 0x0UL);
+	pci_outl(reg(cp, LEGACY), 0x0UL);
+	pci_outl(reg(cp, LEGACY+4), 0x0UL);
 
 	/* turn off serial interface */
-	pci_outl(reg(SERIAL_INTERFACE_CTRL), 0x0UL);
-	/*pci_outl(reg(SERIAL_INTERFACE_CTRL), 0x3UL);*/
+	pci_outl(reg(cp, SERIAL_INTERFACE_CTRL), 0x0UL);
+	/*pci_outl(reg(cp, SERIAL_INTERFACE_CTRL), 0x3UL);*/
 
 
 	/* clear all the memory */
 	for (i = 0; i < 0x10; ++i) {
-		pci_outb(reg(MEM_PAGE), i);
+		pci_outb(reg(cp, MEM_PAGE), i);
 		for (j = 0; j < 0x10; j += 4) {
-			pci_outl  (reg(MEMORY) + j, 0x0UL);
+			pci_outl  (reg(cp, MEMORY) + j, 0x0UL);
 		}
 	}
 
 	/* Sample Rate Converter initialization */
-	if (src_init(&dev) != OK) {
+	if (src_init(&cp->dev) != OK) {
 		return EIO;
 	}
-	if (AC97_init(&dev) != OK) {
+	if (AC97_init(&cp->dev) != OK) {
 		return EIO;
 	}
 
 	/* initialize variables for each sub_device */
-	for (i = 0; i < drv.NrOfSubDevices; i++) {
+	for (i = 0; i < NR_SUB_DEVS; i++) {
 		if(i != MIXER) {
-			aud_conf[i].busy = 0;
-			aud_conf[i].stereo = DEFAULT_STEREO;
-			aud_conf[i].sample_rate = DEFAULT_RATE;
-			aud_conf[i].nr_of_bits = DEFAULT_NR_OF_BITS;
-			aud_conf[i].sign = DEFAULT_SIGNED;
-			aud_conf[i].fragment_size = 
-				sub_dev[i].DmaSize / sub_dev[i].NrOfDmaFragments;
+			cp->aud_conf[i].busy = 0;
+			cp->aud_conf[i].stereo = DEFAULT_STEREO;
+			cp->aud_conf[i].sample_rate = DEFAULT_RATE;
+			cp->aud_conf[i].nr_of_bits = DEFAULT_NR_OF_BITS;
+			cp->aud_conf[i].sign = DEFAULT_SIGNED;
+			cp->aud_conf[i].fragment_size = 
+				sub_dev[c * NR_SUB_DEVS + i].DmaSize / 
+				sub_dev[c * NR_SUB_DEVS + i].NrOfDmaFragments;
 		}
 	}
 	return OK;
@@ -173,6 +226,7 @@ static int detect_hw(void) {
 	u32_t device;
 	int devind;
 	u16_t v_id, d_id;
+	DEV_STRUCT *dev;
 
 	/* detect_hw tries to find device and get IRQ and base address
 	   with a little (much) help from the PCI library. 
@@ -180,34 +234,41 @@ static int detect_hw(void) {
 	   (just make sure to get the bugs out first)*/
 
 	pci_init();
-	/* get first device and then search through the list */
+	nr_cards = 0;
+	/* get first device and then search through the list; every match
+	   is a card of its own */
 	device = pci_first_dev(&devind, &v_id, &d_id);
 	while( device > 0 ) {
-		/* if we have a match...break */
-		if (v_id == VENDOR_ID && d_id == DEVICE_ID) break;
+		if (v_id == VENDOR_ID && d_id == DEVICE_ID) {
+			if (nr_cards == NR_CARDS) {
+				printf("%s: only the first %d cards are used\n", 
+					DRIVER_NAME, NR_CARDS);
+				break;
+			}
+			pci_reserve(devind);
+			dev = &card[nr_cards++].dev;
+
+			dev->name = pci_dev_name(v_id, d_id);
+
+			/* get base address of our device, ignore least signif. bit 
+			   this last bit thing could be device dependent, i don't 
+			   know */
+			dev->base = pci_attr_r32(devind, PCI_BAR) & 0xfffffffe;
+
+			/* get IRQ */
+			dev->irq = pci_attr_r8(devind, PCI_ILR);  
+			dev->revision = pci_attr_r8(devind, PCI_REV);
+			dev->d_id = d_id;
+			dev->v_id = v_id;
+			dev->devind = devind; /* pci device identifier */
+		}
 		device = pci_next_dev(&devind, &v_id, &d_id);
 	}
 
 	/* did we find anything? */
-	if (v_id != VENDOR_ID || d_id != DEVICE_ID) {
+	if (nr_cards == 0) {
 		return EIO;
 	}
-
-	pci_reserve(devind);
-
-	dev.name = pci_dev_name(v_id, d_id);
-
-	/* get base address of our device, ignore least signif. bit 
-	   this last bit thing could be device dependent, i don't know */
-	dev.base = pci_attr_r32(devind, PCI_BAR) & 0xfffffffe;
-
-	/* get IRQ */
-	dev.irq = pci_attr_r8(devind, PCI_ILR);  
-	dev.revision = pci_attr_r8(devind, PCI_REV);
-	dev.d_id = d_id;
-	dev.v_id = v_id;
-	dev.devind = devind; /* pci device identifier */
-
 	return OK;
 }
 
@@ -225,16 +286,17 @@ int drv_reset() {
 }
 
 
-int drv_start(int sub_dev, int UNUSED(DmaMode)) {
-	u32_t enable_bit, result = 0;
+/* everything drv_start() does before the channel is enabled */
+static int prepare_start(int sub_dev, u32_t *enable_bit) {
+	u32_t result = 0;
 
 	/* Write default values to device in case user failed to configure.
 	   If user did configure properly, everything is written twice.
 	   please raise your hand if you object against to this strategy...*/
-	result |= set_sample_rate(aud_conf[sub_dev].sample_rate, sub_dev);
-	result |= set_stereo(aud_conf[sub_dev].stereo, sub_dev);
-	result |= set_bits(aud_conf[sub_dev].nr_of_bits, sub_dev);
-	result |= set_sign(aud_conf[sub_dev].sign, sub_dev);
+	result |= set_sample_rate(CONF(sub_dev).sample_rate, sub_dev);
+	result |= set_stereo(CONF(sub_dev).stereo, sub_dev);
+	result |= set_bits(CONF(sub_dev).nr_of_bits, sub_dev);
+	result |= set_sign(CONF(sub_dev).sign, sub_dev);
 
 	/* set the interrupt count */
 	result |= set_int_cnt(sub_dev);
@@ -246,20 +308,55 @@ int drv_start(int sub_dev, int UNUSED(DmaMode)) {
 	/* if device currently paused, resume */
 	drv_resume(sub_dev);
 
-	switch(sub_dev) {
-		case ADC1_CHAN: enable_bit = ADC1_EN;break;
-		case DAC1_CHAN: enable_bit = DAC1_EN;break;
-		case DAC2_CHAN: enable_bit = DAC2_EN;break;    
+	switch(CHAN(sub_dev)) {
+		case ADC1_CHAN: *enable_bit = ADC1_EN;break;
+		case DAC1_CHAN: *enable_bit = DAC1_EN;break;
+		case DAC2_CHAN: *enable_bit = DAC2_EN;break;    
 		default: return EINVAL;
 	}
 
 	/* enable interrupts from 'sub device' */
 	drv_reenable_int(sub_dev);
+	return OK;
+}
+
+
+int drv_start(int sub_dev, int UNUSED(DmaMode)) {
+	card_t *cp = CARD(sub_dev);
+	u32_t enable_bit;
+	int r;
+
+	if ((r = prepare_start(sub_dev, &enable_bit)) != OK) {
+		return r;
+	}
 
 	/* this means play!!! */
-	pci_outw(reg(CHIP_SEL_CTRL), pci_inw(reg(CHIP_SEL_CTRL)) | enable_bit);
+	pci_outw(reg(cp, CHIP_SEL_CTRL), 
+			pci_inw(reg(cp, CHIP_SEL_CTRL)) | enable_bit);
 
-	aud_conf[sub_dev].busy = 1;
+	CONF(sub_dev).busy = 1;
+
+	return OK;
+}
+
+
+/* both channels are enabled by the same write, so they start on the 
+   same sample clock */
+int drv_start_linked(int write_sub_dev, int read_sub_dev) {
+	card_t *cp = CARD(write_sub_dev);
+	u32_t write_bit, read_bit;
+	int r;
+
+	if ((r = prepare_start(write_sub_dev, &write_bit)) != OK ||
+			(r = prepare_start(read_sub_dev, &read_bit)) != OK) {
+		return r;
+	}
+
+	pci_outw(reg(cp, CHIP_SEL_CTRL), 
+			pci_inw(reg(cp, CHIP_SEL_CTRL)) | write_bit | read_bit);
+
+	CONF(write_sub_dev).busy = 1;
+	CONF(read_sub_dev).busy = 1;
 
 	return OK;
 }
@@ -267,9 +364,10 @@ int drv_start(int sub_dev, int UNUSED(DmaMode)) {
 
 int drv_stop(int sub_dev)
 {
+	card_t *cp = CARD(sub_dev);
 	u32_t enable_bit;
 
-	switch(sub_dev) {
+	switch(CHAN(sub_dev)) {
 		case ADC1_CHAN: enable_bit = ADC1_EN;break;
 		case DAC1_CHAN: enable_bit = DAC1_EN;break;
 		case DAC2_CHAN: enable_bit = DAC2_EN;break;    
@@ -277,10 +375,10 @@ int drv_stop(int sub_dev)
 	}
 
 	/* stop the specified channel */
-	pci_outw(reg(CHIP_SEL_CTRL),
-			pci_inw(reg(CHIP_SEL_CTRL)) & ~enable_bit);
-	aud_conf[sub_dev].busy = 0;
-	disable_int(sub_dev);
+	pci_outw(reg(cp, CHIP_SEL_CTRL),
+			pci_inw(reg(cp, CHIP_SEL_CTRL)) & ~enable_bit);
+	CONF(sub_dev).busy = 0;
+	drv_disable_int(sub_dev);
 
 	return OK;
 }
@@ -308,8 +406,6 @@ int drv_io_ctl(unsigned long request, void * val, int * len, int sub_dev) {
 			status = reset(sub_dev); break;
 		case DSPIOFREEBUF:
 			status = free_buf(val, len, sub_dev); break;
-		case DSPIOSAMPLESINBUF: 
-			status = get_samples_in_buf(val, len, sub_dev); break;
 		case DSPIOPAUSE:
 			status = drv_pause(sub_dev); break;
 		case DSPIORESUME:
@@ -327,23 +423,149 @@ int drv_io_ctl(unsigned long request, void * val, int * len, int sub_dev) {
 
 
 int drv_get_irq(char *irq) {
-	*irq = dev.irq;
+	return drv_get_card_irq(0, irq);
+}
+
+
+int drv_get_card_irq(int c, char *irq) {
+	*irq = card[c].dev.irq;
 	return OK;
 }
 
 
+int drv_get_nr_cards(void) {
+	return nr_cards;
+}
+
+
+int drv_get_card(int sub_dev) {
+	return sub_dev / NR_SUB_DEVS;
+}
+
+
 int drv_get_frag_size(u32_t *frag_size, int sub_dev) {
-	*frag_size = aud_conf[sub_dev].fragment_size;
+	*frag_size = CONF(sub_dev).fragment_size;
 	return OK;  
 }
 
 
+int drv_get_max_fragments(int UNUSED(sub_dev)) {
+	/* the interrupt sample count can be set to any fragment size, so
+	   only the size of the dma buffer limits the nr. of fragments */
+	return INT_MAX;
+}
+
+
+int drv_set_params(struct dsp_params *params, int chan) {
+	/* everything is only stored here; drv_start writes it all to the 
+	   device, so the sample rate converter is programmed just once */
+	if (CHAN(chan) != ADC1_CHAN && CHAN(chan) != DAC1_CHAN && 
+			CHAN(chan) != DAC2_CHAN) {
+		return EINVAL;
+	}
+	if ((params->bits != 8 && params->bits != 16) ||
+			params->frag_size > (sub_dev[chan].DmaSize / 
+				sub_dev[chan].NrOfDmaFragments) ||
+			params->frag_size < sub_dev[chan].MinFragmentSize) {
+		return EINVAL;
+	}
+
+	if (params->rate < MIN_RATE) params->rate = MIN_RATE;
+	if (params->rate > MAX_RATE) params->rate = MAX_RATE;
+	params->stereo = (params->stereo != 0);
+	/* the chip plays 8 bit samples unsigned and 16 bit ones signed */
+	params->sign = (params->bits == 16);
+
+	CONF(chan).sample_rate = params->rate;
+	CONF(chan).stereo = params->stereo;
+	CONF(chan).nr_of_bits = params->bits;
+	CONF(chan).sign = params->sign;
+	CONF(chan).fragment_size = params->frag_size;
+	return OK;
+}
+
+
+int drv_get_params(struct dsp_params *params, int chan) {
+	if (CHAN(chan) != ADC1_CHAN && CHAN(chan) != DAC1_CHAN && 
+			CHAN(chan) != DAC2_CHAN) {
+		return EINVAL;
+	}
+	params->rate = CONF(chan).sample_rate;
+	params->stereo = CONF(chan).stereo;
+	params->bits = CONF(chan).nr_of_bits;
+	params->sign = CONF(chan).sign;
+	params->frag_size = CONF(chan).fragment_size;
+	return OK;
+}
+
+
+int drv_get_mix_clients(int minor_dev_nr) {
+	return (minor_dev_nr % MINORS_PER_CARD == 5) ? MIX_CLIENTS : 0;
+}
+
+
+int drv_get_position(int chan, u32_t *frag_offset, u32_t *frame_size) {
+	card_t *cp = CARD(chan);
+	u16_t samp_ct_reg, curr_samp_ct_reg;
+	u32_t left;
+
+	switch(CHAN(chan)) {
+		case ADC1_CHAN: 
+			curr_samp_ct_reg = ADC_CURR_SAMP_CT;
+			samp_ct_reg = ADC_SAMP_CT; break;
+		case DAC1_CHAN: 
+			curr_samp_ct_reg = DAC1_CURR_SAMP_CT;
+			samp_ct_reg = DAC1_SAMP_CT; break;
+		case DAC2_CHAN: 
+			curr_samp_ct_reg = DAC2_CURR_SAMP_CT;
+			samp_ct_reg = DAC2_SAMP_CT; break;    
+		default: return EINVAL;
+	}
+	*frame_size = (CONF(chan).stereo ? 2 : 1) * 
+		(CONF(chan).nr_of_bits / 8);
+
+	/* the current sample count runs from the sample count set by 
+	   set_int_cnt() down to 0, in frames. Both share a 32 bit 
+	   register, read the low half first. */
+	(void) pci_inw(reg(cp, samp_ct_reg));
+	left = (pci_inw(reg(cp, curr_samp_ct_reg)) + 1) * *frame_size;
+	*frag_offset = (left < CONF(chan).fragment_size) ? 
+		CONF(chan).fragment_size - left : 0;
+	return OK;
+}
+
+
+int drv_get_dma_offset(int chan, u32_t *offset) {
+	card_t *cp = CARD(chan);
+	u32_t page, frame_count_reg;
+
+	switch(CHAN(chan)) {
+		case ADC1_CHAN: page = ADC_MEM_PAGE;
+						frame_count_reg = ADC_BUFFER_SIZE;
+						break;
+		case DAC1_CHAN: page = DAC_MEM_PAGE;
+						frame_count_reg = DAC1_BUFFER_SIZE;
+						break;
+		case DAC2_CHAN: page = DAC_MEM_PAGE;
+						frame_count_reg = DAC2_BUFFER_SIZE;
+						break;
+		default: return EINVAL;
+	}
+	/* the high half of the frame count register is the current count, 
+	   the long words done of the ring set by drv_set_dma() */
+	pci_outb(reg(cp, MEM_PAGE), page);
+	*offset = (pci_inl(reg(cp, frame_count_reg)) >> 16) * 4;
+	return OK;
+}
+
+
 int drv_set_dma(u32_t dma, u32_t length, int chan) {
+	card_t *cp = CARD(chan);
 	/* dma length in bytes, 
 	   max is 64k long words for es1371 = 256k bytes */
 	u32_t page, frame_count_reg, dma_add_reg;
 
-	switch(chan) {
+	switch(CHAN(chan)) {
 		case ADC1_CHAN: page = ADC_MEM_PAGE;
 						frame_count_reg = ADC_BUFFER_SIZE;
 						dma_add_reg = ADC_PCI_ADDRESS;
@@ -358,8 +580,8 @@ int drv_set_dma(u32_t dma, u32_t length, int chan) {
 						break;;    
 		default: return EIO;
 	}
-	pci_outb(reg(MEM_PAGE), page);
-	pci_outl(reg(dma_add_reg), dma);
+	pci_outb(reg(cp, MEM_PAGE), page);
+	pci_outl(reg(cp, dma_add_reg), dma);
 
 	/* device expects long word count in stead of bytes */
 	length /= 4;
@@ -369,7 +591,7 @@ int drv_set_dma(u32_t dma, u32_t length, int chan) {
 	 * addressable.
 	 * It expects length -1
 	 */
-	pci_outl(reg(frame_count_reg), (u32_t) (length - 1));
+	pci_outl(reg(cp, frame_count_reg), (u32_t) (length - 1));
 
 	return OK;
 }
@@ -377,32 +599,39 @@ int drv_set_dma(u32_t dma, u32_t length, int chan) {
 
 /* return status of the interrupt summary bit */
 int drv_int_sum(void) {
-	return pci_inl(reg(INTERRUPT_STATUS)) & INTR;
+	return drv_card_int_sum(0);
+}
+
+
+int drv_card_int_sum(int c) {
+	return pci_inl(reg(&card[c], INTERRUPT_STATUS)) & INTR;
 }
 
 
 int drv_int(int sub_dev) {
+	card_t *cp = CARD(sub_dev);
 	u32_t int_status;
 	u32_t bit;
 
 	/* return status of interrupt bit of specified channel*/
-	switch (sub_dev) {
+	switch(CHAN(sub_dev)) {
 		case DAC1_CHAN:  bit = DAC1;break;
 		case DAC2_CHAN:  bit = DAC2;break;
 		case ADC1_CHAN:  bit = ADC;break;
 		default: return EINVAL;
 	}
 
-	int_status = pci_inl(reg(INTERRUPT_STATUS)) & bit;
+	int_status = pci_inl(reg(cp, INTERRUPT_STATUS)) & bit;
 
 	return int_status;
 }
 
 
 int drv_reenable_int(int chan) {
+	card_t *cp = CARD(chan);
 	u16_t ser_interface, int_en_bit;
 
-	switch(chan) {
+	switch(CHAN(chan)) {
 		case ADC1_CHAN: int_en_bit = R1_INT_EN; break;
 		case DAC1_CHAN: int_en_bit = P1_INTR_EN; break;
 		case DAC2_CHAN: int_en_bit = P2_INTR_EN; break;    
@@ -410,93 +639,97 @@ int drv_reenable_int(int chan) {
 	}
 
 	/* clear and reenable an interrupt */
-	ser_interface = pci_inw(reg(SERIAL_INTERFACE_CTRL));
-	pci_outw(reg(SERIAL_INTERFACE_CTRL), ser_interface & ~int_en_bit);
-	pci_outw(reg(SERIAL_INTERFACE_CTRL), ser_interface | int_en_bit);
+	ser_interface = pci_inw(reg(cp, SERIAL_INTERFACE_CTRL));
+	pci_outw(reg(cp, SERIAL_INTERFACE_CTRL), ser_interface & ~int_en_bit);
+	pci_outw(reg(cp, SERIAL_INTERFACE_CTRL), ser_interface | int_en_bit);
 
 	return OK;
 }
 
 
 int drv_pause(int sub_dev) { 
+	card_t *cp = CARD(sub_dev);
 	u32_t pause_bit;
 
-	disable_int(sub_dev); /* don't send interrupts */
+	drv_disable_int(sub_dev); /* don't send interrupts */
 
-	switch(sub_dev) {
+	switch(CHAN(sub_dev)) {
 		case DAC1_CHAN: pause_bit = P1_PAUSE;break;
 		case DAC2_CHAN: pause_bit = P2_PAUSE;break;    
 		default: return EINVAL;
 	}
 
 	/* pause */
-	pci_outl(reg(SERIAL_INTERFACE_CTRL),
-			pci_inl(reg(SERIAL_INTERFACE_CTRL)) | pause_bit);
+	pci_outl(reg(cp, SERIAL_INTERFACE_CTRL),
+			pci_inl(reg(cp, SERIAL_INTERFACE_CTRL)) | pause_bit);
 
 	return OK;
 }
 
 
 int drv_resume(int sub_dev) {
+	card_t *cp = CARD(sub_dev);
 	u32_t pause_bit = 0;
 
 	drv_reenable_int(sub_dev); /* enable interrupts */
 
-	switch(sub_dev) {
+	switch(CHAN(sub_dev)) {
 		case DAC1_CHAN: pause_bit = P1_PAUSE;break;
 		case DAC2_CHAN: pause_bit = P2_PAUSE;break;    
 		default: return EINVAL;
 	}
 
 	/* clear pause bit */
-	pci_outl(reg(SERIAL_INTERFACE_CTRL),
-			pci_inl(reg(SERIAL_INTERFACE_CTRL)) & ~pause_bit);
+	pci_outl(reg(cp, SERIAL_INTERFACE_CTRL),
+			pci_inl(reg(cp, SERIAL_INTERFACE_CTRL)) & ~pause_bit);
 
 	return OK;
 }
 
 
 static int set_bits(u32_t nr_of_bits, int sub_dev) {
+	card_t *cp = CARD(sub_dev);
 	/* set format bits for specified channel. */
 	u16_t size_16_bit, ser_interface;
 
-	switch(sub_dev) {
+	switch(CHAN(sub_dev)) {
 		case ADC1_CHAN: size_16_bit = R1_S_EB; break;
 		case DAC1_CHAN: size_16_bit = P1_S_EB; break;
 		case DAC2_CHAN: size_16_bit = P2_S_EB; break;    
 		default: return EINVAL;
 	}
 
-	ser_interface = pci_inw(reg(SERIAL_INTERFACE_CTRL));
+	ser_interface = pci_inw(reg(cp, SERIAL_INTERFACE_CTRL));
 	ser_interface &= ~size_16_bit;
 	switch(nr_of_bits) {
 		case 16: ser_interface |= size_16_bit;break;
 		case  8: break;
 		default: return EINVAL;
 	}
-	pci_outw(reg(SERIAL_INTERFACE_CTRL), ser_interface);
-	aud_conf[sub_dev].nr_of_bits = nr_of_bits;
+	pci_outw(reg(cp, SERIAL_INTERFACE_CTRL), ser_interface);
+	CONF(sub_dev).nr_of_bits = nr_of_bits;
 	return OK;
 }
 
 
 static int set_stereo(u32_t stereo, int sub_dev) {
+	card_t *cp = CARD(sub_dev);
 	/* set format bits for specified channel. */
 	u16_t stereo_bit, ser_interface;
 
-	switch(sub_dev) {
+	switch(CHAN(sub_dev)) {
 		case ADC1_CHAN: stereo_bit = R1_S_MB; break;
 		case DAC1_CHAN: stereo_bit = P1_S_MB; break;
 		case DAC2_CHAN: stereo_bit = P2_S_MB; break;    
 		default: return EINVAL;
 	}
-	ser_interface = pci_inw(reg(SERIAL_INTERFACE_CTRL));
+	ser_interface = pci_inw(reg(cp, SERIAL_INTERFACE_CTRL));
 	ser_interface &= ~stereo_bit;
 	if (stereo) {
 		ser_interface |= stereo_bit;
 	} 
-	pci_outw(reg(SERIAL_INTERFACE_CTRL), ser_interface);
-	aud_conf[sub_dev].stereo = stereo;
+	pci_outw(reg(cp, SERIAL_INTERFACE_CTRL), ser_interface);
+	CONF(sub_dev).stereo = stereo;
 
 	return OK;
 }
@@ -513,7 +746,7 @@ static int set_frag_size(u32_t fragment_size, int sub_dev_nr) {
 			fragment_size < sub_dev[sub_dev_nr].MinFragmentSize) {
 		return EINVAL;
 	}
-	aud_conf[sub_dev_nr].fragment_size = fragment_size;
+	CONF(sub_dev_nr).fragment_size = fragment_size;
 
 	return OK;
 }
@@ -526,50 +759,51 @@ static int set_sample_rate(u32_t rate, int sub_dev) {
 		return EINVAL;
 	}
 	/* set the sample rate for the specified channel*/
-	switch(sub_dev) {
+	switch(CHAN(sub_dev)) {
 		case ADC1_CHAN: src_base_reg = SRC_ADC_BASE;break;
 		case DAC1_CHAN: src_base_reg = SRC_SYNTH_BASE;break;
 		case DAC2_CHAN: src_base_reg = SRC_DAC_BASE;break;    
 		default: return EINVAL;
 	}
-	src_set_rate(&dev, src_base_reg, rate);
-	aud_conf[sub_dev].sample_rate = rate;
+	src_set_rate(&CARD(sub_dev)->dev, src_base_reg, rate);
+	CONF(sub_dev).sample_rate = rate;
 	return OK;
 }
 
 
 static int set_int_cnt(int chan) {
+	card_t *cp = CARD(chan);
 	/* Write interrupt count for specified channel. 
 	   After <DspFragmentSize> bytes, an interrupt will be generated  */
 
 	int sample_count; 
 	u16_t int_cnt_reg;
 
-	if (aud_conf[chan].fragment_size > 
+	if (CONF(chan).fragment_size > 
 			(sub_dev[chan].DmaSize / sub_dev[chan].NrOfDmaFragments) 
-			|| aud_conf[chan].fragment_size < sub_dev[chan].MinFragmentSize) {
+			|| CONF(chan).fragment_size < sub_dev[chan].MinFragmentSize) {
 		return EINVAL;
 	}
 
-	switch(chan) {
+	switch(CHAN(chan)) {
 		case ADC1_CHAN: int_cnt_reg = ADC_SAMP_CT; break;
 		case DAC1_CHAN: int_cnt_reg = DAC1_SAMP_CT; break;
 		case DAC2_CHAN: int_cnt_reg = DAC2_SAMP_CT; break;    
 		default: return EINVAL;
 	}
 
-	sample_count = aud_conf[chan].fragment_size;
+	sample_count = CONF(chan).fragment_size;
 
 	/* adjust sample count according to sample format */
-	if( aud_conf[chan].stereo == TRUE ) sample_count >>= 1;
-	switch(aud_conf[chan].nr_of_bits) {
+	if( CONF(chan).stereo == TRUE ) sample_count >>= 1;
+	switch(CONF(chan).nr_of_bits) {
 		case 16:   sample_count >>= 1;break;
 		case  8:   break;
 		default: return EINVAL;
 	}    
 
 	/* set the sample count - 1 for the specified channel. */
-	pci_outw(reg(int_cnt_reg), sample_count - 1);
+	pci_outw(reg(cp, int_cnt_reg), sample_count - 1);
 
 	return OK;
 }
@@ -583,49 +817,19 @@ static int get_max_frag_size(u32_t * val, int * len, int sub_dev_nr) {
 }
 
 
-static int disable_int(int chan) {
+int drv_disable_int(int chan) {
+	card_t *cp = CARD(chan);
 	u16_t ser_interface, int_en_bit;
 
-	switch(chan) {
+	switch(CHAN(chan)) {
 		case ADC1_CHAN: int_en_bit = R1_INT_EN; break;
 		case DAC1_CHAN: int_en_bit = P1_INTR_EN; break;
 		case DAC2_CHAN: int_en_bit = P2_INTR_EN; break;    
 		default: return EINVAL;
 	}
 	/* clear the interrupt */
-	ser_interface = pci_inw(reg(SERIAL_INTERFACE_CTRL));
-	pci_outw(reg(SERIAL_INTERFACE_CTRL), ser_interface & ~int_en_bit);
-	return OK;
-}
-
-
-static int get_samples_in_buf (u32_t *samples_in_buf, int *len, int chan) {
-	u16_t samp_ct_reg; 
-	u16_t curr_samp_ct_reg;
-	u16_t curr_samp_ct; /* counts back from SAMP_CT till 0 */
-
-	*len = sizeof(*samples_in_buf);
-
-	switch(chan) {
-		case ADC1_CHAN: 
-			curr_samp_ct_reg = ADC_CURR_SAMP_CT;
-			samp_ct_reg = ADC_SAMP_CT; break;
-		case DAC1_CHAN: 
-			curr_samp_ct_reg = DAC1_CURR_SAMP_CT;
-			samp_ct_reg = DAC1_SAMP_CT; break;
-		case DAC2_CHAN: 
-			curr_samp_ct_reg = DAC2_CURR_SAMP_CT;
-			samp_ct_reg = DAC2_SAMP_CT; break;    
-		default: return EINVAL;
-	}
-
-	/* TODO: is this statement useful? */
-	(void) pci_inw(reg(samp_ct_reg));
-	curr_samp_ct = pci_inw(reg(curr_samp_ct_reg));
-
-	*samples_in_buf = (u32_t) (sub_dev[chan].BufLength * 8192) + 
-		curr_samp_ct;
-
+	ser_interface = pci_inw(reg(cp, SERIAL_INTERFACE_CTRL));
+	pci_outw(reg(cp, SERIAL_INTERFACE_CTRL), ser_interface & ~int_en_bit);
 	return OK;
 }
 
@@ -647,8 +851,8 @@ static int free_buf (u32_t *val, int *len, int sub_dev_nr) {
 static int get_set_volume(struct volume_level *level, int *len, int sub_dev, 
 		int flag) {
 	*len = sizeof(struct volume_level);
-	if (sub_dev == MIXER) {
-		return AC97_get_set_volume(level, flag);
+	if (CHAN(sub_dev) == MIXER) {
+		return AC97_get_set_volume(&CARD(sub_dev)->dev, level, flag);
 	}
 	else {
 		return EINVAL;
@@ -3,6 +3,7 @@
 /* best viewed with tabsize=4 */
 
 #include <minix/audio_fw.h>
+#include <audio_fw_ext.h>
 #include <sys/types.h>
 #include <sys/ioc_sound.h>
 #include <minix/sound.h>
@@ -14,11 +15,22 @@
 #define DRIVER_NAME				"ES1371"
 
 
-/* channels or subdevices */
+/* channels or subdevices, of every card */
 #define DAC1_CHAN				0
 #define ADC1_CHAN				1
 #define MIXER					2
 #define DAC2_CHAN				3
+#define NR_SUB_DEVS				4
+
+/* writers the framework mixes onto DAC1, see minor device 5 */
+#define MIX_CLIENTS				4
+
+/* Cards the driver serves, in the order the PCI bus lists them. Card c
+   has minor devices c * MINORS_PER_CARD up to NR_SPECIAL_FILES of them
+   later, and sub devices c * NR_SUB_DEVS on. */
+#define NR_CARDS				4
+#define NR_SPECIAL_FILES		6
+#define MINORS_PER_CARD			8
 
 
 /* PCI command register defines */
@@ -122,6 +134,12 @@ typedef struct DEVSTRUCT {
 	char      revision;						/* version of the device */
 } DEV_STRUCT;
 
+/* one card */
+typedef struct {
+	DEV_STRUCT dev;
+	aud_sub_dev_conf_t aud_conf[NR_SUB_DEVS];
+} card_t;
+
 #define SRC_ERR_NOT_BUSY_TIMEOUT            -1       /* SRC not busy */
 #define SRC_SUCCESS							0
 
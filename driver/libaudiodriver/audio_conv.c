@@ -0,0 +1,619 @@
+/* This file contains the sample format conversion of the audio framework,
+ * see audio_conv.h. A conversion is three steps over a block of frames:
+ * the samples written are turned into signed 16 bit ones, the channels
+ * are mapped, and the samples the device plays are made from those.
+ * Every step has a plain C kernel and most have SIMD ones, see conv_simd
+ * in audio_conv.h. conv_init() picks the best one there is for each
+ * step.
+ *
+ * The kernels read and write unaligned memory; a SIMD kernel leaves the
+ * samples after its last full vector to the C one.
+ */
+
+#include <stddef.h>
+#include "audio_conv.h"
+#include "ioc_audio.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+typedef void (*conv_in_t)(i16_t *dst, const void *src, size_t n, u32_t flip);
+typedef void (*conv_chan_t)(i16_t *dst, const i16_t *src, size_t frames);
+typedef void (*conv_out_t)(void *dst, const i16_t *src, size_t n,
+	u32_t flip);
+typedef void (*conv_fn_t)(void);			/* any of them, to look one up */
+
+/* the kernels that turn samples into signed 16 bit ones */
+#define IN_8		0
+#define IN_16		1
+#define IN_16SWAP	2
+#define IN_24		3
+#define IN_32		4
+#define IN_FLOAT	5
+#define NR_IN		6
+
+/* the kernels of one instruction set, NULL where it has none */
+struct conv_kernels {
+	conv_in_t in[NR_IN];
+	conv_chan_t up;					/* mono to stereo */
+	conv_chan_t down;				/* stereo to mono */
+	conv_out_t out8;
+	conv_out_t out16;
+};
+
+#define HALF		0x1.fffffep-2f		/* the float just below 0.5 */
+
+int conv_simd = CONV_AVX2;
+#if defined(__AVX2__)
+const int conv_built = CONV_AVX2;
+#elif defined(__SSE2__)
+const int conv_built = CONV_SSE2;
+#else
+const int conv_built = CONV_SCALAR;
+#endif
+
+
+/* ======= C ======= */
+
+static void in8_c(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u8_t *s = src;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (i16_t) (u16_t) ((u8_t) (s[i] ^ flip) << 8);
+}
+
+
+static void in16_c(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u16_t *s = src;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (i16_t) (u16_t) (s[i] ^ flip);
+}
+
+
+static void in16swap_c(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u16_t *s = src;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (i16_t) (u16_t) (((s[i] << 8) | (s[i] >> 8)) ^ flip);
+}
+
+
+/* the top two of the three bytes */
+static void in24_c(i16_t *dst, const void *src, size_t n,
+	u32_t UNUSED(flip))
+{
+	const u8_t *s = src;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (i16_t) (u16_t) (s[3 * i + 1] | (s[3 * i + 2] << 8));
+}
+
+
+static void in32_c(i16_t *dst, const void *src, size_t n,
+	u32_t UNUSED(flip))
+{
+	const i32_t *s = src;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (i16_t) (s[i] >> 16);
+}
+
+
+/* NaN is silence. Adding HALF and truncating rounds half away from
+ * zero; with 0.5 itself, the sum would round up values just below 0.5. */
+static void infloat_c(i16_t *dst, const void *src, size_t n,
+	u32_t UNUSED(flip))
+{
+	const float *s = src;
+	size_t i;
+	float v;
+
+	for (i = 0; i < n; i++) {
+		v = s[i] * 32768.0f;
+		if (v != v) v = 0.0f;
+		if (v < -32768.0f) v = -32768.0f;
+		if (v > 32767.0f) v = 32767.0f;
+		dst[i] = (i16_t) (v + (v < 0.0f ? -HALF : HALF));
+	}
+}
+
+
+static void up_c(i16_t *dst, const i16_t *src, size_t frames)
+{
+	size_t i;
+
+	for (i = 0; i < frames; i++)
+		dst[2 * i] = dst[2 * i + 1] = src[i];
+}
+
+
+static void down_c(i16_t *dst, const i16_t *src, size_t frames)
+{
+	size_t i;
+
+	for (i = 0; i < frames; i++)
+		dst[i] = (i16_t) ((src[2 * i] + src[2 * i + 1]) >> 1);
+}
+
+
+static void out8_c(void *dst, const i16_t *src, size_t n, u32_t flip)
+{
+	u8_t *d = dst;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		d[i] = (u8_t) ((src[i] >> 8) ^ flip);
+}
+
+
+static void out16_c(void *dst, const i16_t *src, size_t n, u32_t flip)
+{
+	u16_t *d = dst;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		d[i] = (u16_t) src[i] ^ flip;
+}
+
+
+static const struct conv_kernels kernels_c = {
+	{ in8_c, in16_c, in16swap_c, in24_c, in32_c, infloat_c },
+	up_c, down_c, out8_c, out16_c
+};
+
+
+/* ======= SSE2 ======= */
+#if defined(__SSE2__)
+
+/* the byte becomes the high one of the sample */
+static void in8_sse2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u8_t *s = src;
+	size_t i;
+	__m128i v, f, zero;
+
+	f = _mm_set1_epi8((char) flip);
+	zero = _mm_setzero_si128();
+	for (i = 0; i + 16 <= n; i += 16) {
+		v = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (s + i)), f);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi8(zero, v));
+		_mm_storeu_si128((__m128i *) (dst + i + 8),
+			_mm_unpackhi_epi8(zero, v));
+	}
+	in8_c(dst + i, s + i, n - i, flip);
+}
+
+
+static void in16_sse2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u16_t *s = src;
+	size_t i;
+	__m128i v, f;
+
+	f = _mm_set1_epi16((short) flip);
+	for (i = 0; i + 8 <= n; i += 8) {
+		v = _mm_loadu_si128((const __m128i *) (s + i));
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(v, f));
+	}
+	in16_c(dst + i, s + i, n - i, flip);
+}
+
+
+static void in16swap_sse2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u16_t *s = src;
+	size_t i;
+	__m128i v, f;
+
+	f = _mm_set1_epi16((short) flip);
+	for (i = 0; i + 8 <= n; i += 8) {
+		v = _mm_loadu_si128((const __m128i *) (s + i));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(v, f));
+	}
+	in16swap_c(dst + i, s + i, n - i, flip);
+}
+
+
+static void in32_sse2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const i32_t *s = src;
+	size_t i;
+	__m128i a, b;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		a = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (s + i)), 16);
+		b = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (s + i + 4)),
+			16);
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(a, b));
+	}
+	in32_c(dst + i, s + i, n - i, flip);
+}
+
+
+/* four floats as infloat_c() converts them */
+static __m128i float4_sse2(const float *s)
+{
+	__m128 v, half;
+
+	v = _mm_mul_ps(_mm_loadu_ps(s), _mm_set1_ps(32768.0f));
+	v = _mm_and_ps(v, _mm_cmpeq_ps(v, v));
+	v = _mm_max_ps(v, _mm_set1_ps(-32768.0f));
+	v = _mm_min_ps(v, _mm_set1_ps(32767.0f));
+	/* HALF with the sign of v; for -0.0 that makes no difference */
+	half = _mm_or_ps(_mm_and_ps(v, _mm_set1_ps(-0.0f)), _mm_set1_ps(HALF));
+	return _mm_cvttps_epi32(_mm_add_ps(v, half));
+}
+
+
+static void infloat_sse2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const float *s = src;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		_mm_storeu_si128((__m128i *) (dst + i),
+			_mm_packs_epi32(float4_sse2(s + i), float4_sse2(s + i + 4)));
+	}
+	infloat_c(dst + i, s + i, n - i, flip);
+}
+
+
+static void up_sse2(i16_t *dst, const i16_t *src, size_t frames)
+{
+	size_t i;
+	__m128i v;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		v = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_unpacklo_epi16(v, v));
+		_mm_storeu_si128((__m128i *) (dst + 2 * i + 8),
+			_mm_unpackhi_epi16(v, v));
+	}
+	up_c(dst + 2 * i, src + i, frames - i);
+}
+
+
+/* the average of the two halves of each 32 bit frame */
+static __m128i down4_sse2(__m128i v)
+{
+	__m128i l, r;
+
+	l = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+	r = _mm_srai_epi32(v, 16);
+	return _mm_srai_epi32(_mm_add_epi32(l, r), 1);
+}
+
+
+static void down_sse2(i16_t *dst, const i16_t *src, size_t frames)
+{
+	size_t i;
+	__m128i a, b;
+
+	for (i = 0; i + 8 <= frames; i += 8) {
+		a = down4_sse2(_mm_loadu_si128((const __m128i *) (src + 2 * i)));
+		b = down4_sse2(_mm_loadu_si128((const __m128i *) (src + 2 * i + 8)));
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_packs_epi32(a, b));
+	}
+	down_c(dst + i, src + 2 * i, frames - i);
+}
+
+
+static void out8_sse2(void *dst, const i16_t *src, size_t n, u32_t flip)
+{
+	u8_t *d = dst;
+	size_t i;
+	__m128i a, b, f;
+
+	f = _mm_set1_epi8((char) flip);
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) (src + i)), 8);
+		b = _mm_srai_epi16(_mm_loadu_si128((const __m128i *) (src + i + 8)),
+			8);
+		_mm_storeu_si128((__m128i *) (d + i),
+			_mm_xor_si128(_mm_packs_epi16(a, b), f));
+	}
+	out8_c(d + i, src + i, n - i, flip);
+}
+
+
+static void out16_sse2(void *dst, const i16_t *src, size_t n, u32_t flip)
+{
+	u16_t *d = dst;
+	size_t i;
+	__m128i v, f;
+
+	f = _mm_set1_epi16((short) flip);
+	for (i = 0; i + 8 <= n; i += 8) {
+		v = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm_storeu_si128((__m128i *) (d + i), _mm_xor_si128(v, f));
+	}
+	out16_c(d + i, src + i, n - i, flip);
+}
+
+
+static const struct conv_kernels kernels_sse2 = {
+	{ in8_sse2, in16_sse2, in16swap_sse2, NULL, in32_sse2, infloat_sse2 },
+	up_sse2, down_sse2, out8_sse2, out16_sse2
+};
+#endif /* __SSE2__ */
+
+
+/* ======= AVX2 ======= */
+#if defined(__AVX2__)
+
+/* packs works on each 128 bit lane, this puts the quarters back in
+ * order */
+#define AVX2_PACKS_ORDER	0xd8
+
+static void in16_avx2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u16_t *s = src;
+	size_t i;
+	__m256i v, f;
+
+	f = _mm256_set1_epi16((short) flip);
+	for (i = 0; i + 16 <= n; i += 16) {
+		v = _mm256_loadu_si256((const __m256i *) (s + i));
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(v, f));
+	}
+	in16_c(dst + i, s + i, n - i, flip);
+}
+
+
+static void in16swap_avx2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const u16_t *s = src;
+	size_t i;
+	__m256i v, f;
+
+	f = _mm256_set1_epi16((short) flip);
+	for (i = 0; i + 16 <= n; i += 16) {
+		v = _mm256_loadu_si256((const __m256i *) (s + i));
+		v = _mm256_or_si256(_mm256_slli_epi16(v, 8),
+			_mm256_srli_epi16(v, 8));
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(v, f));
+	}
+	in16swap_c(dst + i, s + i, n - i, flip);
+}
+
+
+static void in32_avx2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const i32_t *s = src;
+	size_t i;
+	__m256i a, b;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = _mm256_srai_epi32(
+			_mm256_loadu_si256((const __m256i *) (s + i)), 16);
+		b = _mm256_srai_epi32(
+			_mm256_loadu_si256((const __m256i *) (s + i + 8)), 16);
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_permute4x64_epi64(
+			_mm256_packs_epi32(a, b), AVX2_PACKS_ORDER));
+	}
+	in32_c(dst + i, s + i, n - i, flip);
+}
+
+
+/* eight floats as infloat_c() converts them, see float4_sse2() */
+static __m256i float8_avx2(const float *s)
+{
+	__m256 v, half;
+
+	v = _mm256_mul_ps(_mm256_loadu_ps(s), _mm256_set1_ps(32768.0f));
+	v = _mm256_and_ps(v, _mm256_cmp_ps(v, v, _CMP_EQ_OQ));
+	v = _mm256_max_ps(v, _mm256_set1_ps(-32768.0f));
+	v = _mm256_min_ps(v, _mm256_set1_ps(32767.0f));
+	half = _mm256_or_ps(_mm256_and_ps(v, _mm256_set1_ps(-0.0f)),
+		_mm256_set1_ps(HALF));
+	return _mm256_cvttps_epi32(_mm256_add_ps(v, half));
+}
+
+
+static void infloat_avx2(i16_t *dst, const void *src, size_t n, u32_t flip)
+{
+	const float *s = src;
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_permute4x64_epi64(
+			_mm256_packs_epi32(float8_avx2(s + i), float8_avx2(s + i + 8)),
+			AVX2_PACKS_ORDER));
+	}
+	infloat_c(dst + i, s + i, n - i, flip);
+}
+
+
+static void out16_avx2(void *dst, const i16_t *src, size_t n, u32_t flip)
+{
+	u16_t *d = dst;
+	size_t i;
+	__m256i v, f;
+
+	f = _mm256_set1_epi16((short) flip);
+	for (i = 0; i + 16 <= n; i += 16) {
+		v = _mm256_loadu_si256((const __m256i *) (src + i));
+		_mm256_storeu_si256((__m256i *) (d + i), _mm256_xor_si256(v, f));
+	}
+	out16_c(d + i, src + i, n - i, flip);
+}
+
+
+static const struct conv_kernels kernels_avx2 = {
+	{ NULL, in16_avx2, in16swap_avx2, NULL, in32_avx2, infloat_avx2 },
+	NULL, NULL, NULL, out16_avx2
+};
+#endif /* __AVX2__ */
+
+
+/* by instruction set, CONV_SCALAR up */
+static const struct conv_kernels *kernels[] = {
+	&kernels_c,
+#if defined(__SSE2__)
+	&kernels_sse2,
+#else
+	NULL,
+#endif
+#if defined(__AVX2__)
+	&kernels_avx2,
+#else
+	NULL,
+#endif
+};
+
+/* the highest level up to level that has a kernel for a step, e.g.
+ * PICK(out16, level); the C kernels do every step */
+#define PICK(field, level)	pick_level(offsetof(struct conv_kernels, field),\
+	level)
+
+static int pick_level(size_t offset, int level)
+{
+	const conv_fn_t *fn;
+
+	for (; level > CONV_SCALAR; level--) {
+		if (kernels[level] == NULL) continue;
+		fn = (const conv_fn_t *) ((const char *) kernels[level] + offset);
+		if (*fn != NULL) break;
+	}
+	return level;
+}
+
+
+u32_t conv_frame_size(u32_t format, u32_t channels)
+{
+	if (channels != 1 && channels != 2) return 0;
+
+	switch(format) {
+		case DSP_FMT_U8:
+		case DSP_FMT_S8:
+			return channels;
+		case DSP_FMT_S16_LE:
+		case DSP_FMT_S16_BE:
+		case DSP_FMT_U16_LE:
+		case DSP_FMT_U16_BE:
+			return 2 * channels;
+		case DSP_FMT_S24_LE:
+			return 3 * channels;
+		case DSP_FMT_S32_LE:
+		case DSP_FMT_FLOAT:
+			return 4 * channels;
+		default:
+			return 0;
+	}
+}
+
+
+int conv_init(audio_conv_t *cv, u32_t format, u32_t in_channels,
+	u32_t bits, u32_t sign, u32_t out_channels)
+{
+	int in, level;
+
+	cv->in_frame = conv_frame_size(format, in_channels);
+	if (cv->in_frame == 0) return EINVAL;
+	if ((bits != 8 && bits != 16) ||
+			(out_channels != 1 && out_channels != 2)) {
+		return EINVAL;
+	}
+
+	cv->in_flip = 0;
+	switch(format) {
+		case DSP_FMT_U8:		cv->in_flip = 0x80;		/* fall through */
+		case DSP_FMT_S8:		in = IN_8; break;
+		case DSP_FMT_U16_LE:	cv->in_flip = 0x8000;	/* fall through */
+		case DSP_FMT_S16_LE:	in = IN_16; break;
+		case DSP_FMT_U16_BE:	cv->in_flip = 0x8000;	/* fall through */
+		case DSP_FMT_S16_BE:	in = IN_16SWAP; break;
+		case DSP_FMT_S24_LE:	in = IN_24; break;
+		case DSP_FMT_S32_LE:	in = IN_32; break;
+		default:				in = IN_FLOAT; break;
+	}
+	level = (conv_simd > CONV_AVX2) ? CONV_AVX2 : conv_simd;
+	cv->in = kernels[PICK(in[in], level)]->in[in];
+
+	cv->in_channels = in_channels;
+	cv->out_channels = out_channels;
+	cv->chan = NULL;
+	if (in_channels == 1 && out_channels == 2)
+		cv->chan = kernels[PICK(up, level)]->up;
+	if (in_channels == 2 && out_channels == 1)
+		cv->chan = kernels[PICK(down, level)]->down;
+
+	cv->out_frame = out_channels * bits / 8;
+	if (bits == 8) {
+		cv->out_flip = sign ? 0 : 0x80;
+		cv->out = kernels[PICK(out8, level)]->out8;
+	} else {
+		cv->out_flip = sign ? 0 : 0x8000;
+		cv->out = kernels[PICK(out16, level)]->out16;
+	}
+	return OK;
+}
+
+
+void conv_frames(const audio_conv_t *cv, void *dst, const void *src,
+	size_t frames)
+{
+	static i16_t a[2 * CONV_BLOCK];
+	const char *s;
+	char *d;
+	size_t n;
+
+	s = src;
+	d = dst;
+	while (frames > 0) {
+		n = (frames < CONV_BLOCK) ? frames : CONV_BLOCK;
+
+		conv_in(cv, a, s, n);
+		cv->out(d, a, n * cv->out_channels, cv->out_flip);
+
+		s += n * cv->in_frame;
+		d += n * cv->out_frame;
+		frames -= n;
+	}
+}
+
+
+void conv_in(const audio_conv_t *cv, i16_t *dst, const void *src,
+	size_t frames)
+{
+	static i16_t a[2 * CONV_BLOCK];
+	const char *s;
+	size_t n;
+
+	if (cv->chan == NULL) {
+		cv->in(dst, src, frames * cv->in_channels, cv->in_flip);
+		return;
+	}
+
+	s = src;
+	while (frames > 0) {
+		n = (frames < CONV_BLOCK) ? frames : CONV_BLOCK;
+
+		cv->in(a, s, n * cv->in_channels, cv->in_flip);
+		cv->chan(dst, a, n);
+
+		s += n * cv->in_frame;
+		dst += n * cv->out_channels;
+		frames -= n;
+	}
+}
+
+
+void conv_out(const audio_conv_t *cv, void *dst, const i16_t *src,
+	size_t frames)
+{
+	cv->out(dst, src, frames * cv->out_channels, cv->out_flip);
+}
@@ -0,0 +1,64 @@
+/*	audio_conv.h - sample format conversion of the audio framework
+ *
+ * Converts what a client writes, in the format it set with DSPIOFORMAT,
+ * to the format the device plays. Every sample goes through signed 16
+ * bit: wider samples keep their top 16 bits, floats are scaled by 32768,
+ * clipped and rounded half away from zero, and narrower samples are
+ * shifted up. Stereo is mixed down to mono as the average of the two
+ * channels, mono is played on both.
+ */
+
+#ifndef AUDIO_CONV_H
+#define AUDIO_CONV_H
+
+#include <minix/drivers.h>
+
+#define CONV_MAX_FRAME		8		/* bytes in the largest frame */
+#define CONV_BLOCK			256		/* frames converted at a time */
+
+/* the most the kernels may use, for conv_simd */
+#define CONV_SCALAR			0
+#define CONV_SSE2			1
+#define CONV_AVX2			2
+
+typedef struct {
+	u32_t in_frame;					/* bytes per frame written */
+	u32_t out_frame;				/* bytes per frame played */
+	u32_t in_channels;
+	u32_t out_channels;
+	u32_t in_flip;					/* toggled to make samples signed */
+	u32_t out_flip;
+	void (*in)(i16_t *dst, const void *src, size_t n, u32_t flip);
+	void (*chan)(i16_t *dst, const i16_t *src, size_t frames);
+	void (*out)(void *dst, const i16_t *src, size_t n, u32_t flip);
+} audio_conv_t;
+
+/* The kernels of the framework, here and in audio_rate.c and
+ * audio_gain.c, have a plain C version and most have SSE2 and AVX2 ones.
+ * Those are only built when the compiler may use their instructions,
+ * e.g. with -mavx2, and used up to the level in conv_simd. Every one of
+ * them gives the same result, bit for bit. */
+extern int conv_simd;				/* CONV_AVX2 by default */
+
+/* the most the kernels that are built in use */
+extern const int conv_built;
+
+/* bytes per frame of a DSP_FMT_* format, 0 if there is no such format */
+u32_t conv_frame_size(u32_t format, u32_t channels);
+
+/* Set up the conversion from a DSP_FMT_* format to bits and sign as in
+ * struct dsp_params. EINVAL if either side can't be done. */
+int conv_init(audio_conv_t *cv, u32_t format, u32_t in_channels,
+	u32_t bits, u32_t sign, u32_t out_channels);
+
+void conv_frames(const audio_conv_t *cv, void *dst, const void *src,
+	size_t frames);
+
+/* the two halves of conv_frames(), for a stage in between: to signed 16 
+ * bit samples with out_channels, and from those */
+void conv_in(const audio_conv_t *cv, i16_t *dst, const void *src,
+	size_t frames);
+void conv_out(const audio_conv_t *cv, void *dst, const i16_t *src,
+	size_t frames);
+
+#endif /* AUDIO_CONV_H */
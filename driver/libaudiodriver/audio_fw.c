@@ -2,9 +2,20 @@
  *
  * This file contains a standard driver for audio devices.
  * It supports double dma buffering and can be configured to use
- * extra buffer space beside the dma buffer.
+ * extra buffer space beside the dma buffer for recording. Playback
+ * is copied straight into the dma buffer; writes that do not fit 
+ * wait until the hardware has played a fragment.
  * This driver also support sub devices, which can be independently 
  * opened and closed.   
+ * A special file the driver allows it for (drv_get_mix_clients) is
+ * opened by several writers at once; each gets a minor device of its 
+ * own and a ring of its own, and the framework mixes them into the 
+ * playback sub device.
+ * A writer may write in another sample format than the device plays 
+ * (DSPIOFORMAT); the framework converts it on the way into the ring.
+ * It may as well ask for a rate the device can't do, the framework 
+ * resamples it then (DSPIOQUALITY), and set a gain of its own 
+ * (DSPIOGAIN).
  * 
  * The file contains one entry point:
  *
@@ -25,9 +36,134 @@
 #include <minix/endpoint.h>
 #include <minix/ds.h>
 #include <sys/ioccom.h>
+#include <sys/param.h>
+#include <sys/mman.h>
+#include "audio_fw_ext.h"
+#include "ioc_audio.h"
+#include "audio_trace.h"
+#include "audio_mix.h"
+#include "audio_conv.h"
+#include "audio_rate.h"
+#include "audio_gain.h"
 
 #define FUNC_LOG()  printf("FUNC_LOG: [%d], [%s()], [%s]\n", __LINE__, __FUNCTION__, __FILE__)
 
+/* A read or write request that is waiting to be served by a sub device. */
+typedef struct {
+	endpoint_t SourceProcNr;		/* endpoint owning the grant */
+	cp_grant_id_t Grant;			/* grant for the user's buffer */
+	size_t Size;					/* size of the user's buffer */
+	size_t Done;					/* bytes transferred so far */
+	cdev_id_t Id;					/* id to reply to */
+} audio_req_t;
+
+#define NR_PENDING_REQS		8	/* max. queued requests per sub device */
+#define NR_COPY_VEC			8	/* max. pieces in one vectored safecopy; 
+								   enough to wrap both rings */
+
+#define CONV_BUF_FRAMES		1024	/* frames converted per user copy */
+
+/* A stream the framework converts from the format the client writes in,
+ * see DSPIOFORMAT, or from the rate it writes at, see DSPIOQUALITY, or
+ * that has a gain, see DSPIOGAIN. */
+typedef struct {
+	struct dsp_format Format;		/* DSP_FMT_NATIVE if not converted */
+	audio_conv_t Cv;				/* to the format of the sub device */
+	u8_t Part[CONV_MAX_FRAME];		/* a frame a write ended halfway */
+	u32_t PartLen;					/* bytes of it in Part */
+	u32_t Rate;						/* the client's, 0 if the device's */
+	u32_t Quality;					/* DSP_QUALITY_* */
+	int Resample;					/* Rs is set up */
+	audio_rate_t Rs;				/* from Rate to the device's */
+	int Gained;						/* a gain was set, the stream goes 
+									   through Gain until the close */
+	struct dsp_gain GainSet;		/* as the client set it */
+	u32_t Muted;
+	audio_gain_t Gain;
+} conv_stream_t;
+
+#define CONV_ON(cs)	((cs)->Format.format != DSP_FMT_NATIVE || \
+						 (cs)->Rate != 0 || (cs)->Gained)
+
+/* Per sub device state that is private to the framework. sub_dev_t is
+ * shared with the drivers, so anything new is kept here instead. */
+typedef struct {
+	audio_req_t ReqQueue[NR_PENDING_REQS];	/* circular request queue */
+	int ReqReadNext;				/* oldest queued request */
+	int ReqLength;					/* nr. of queued requests */
+	u32_t FillOffset;				/* bytes in fragment being filled */
+	u32_t ReadOffset;				/* bytes taken from oldest fragment */
+	void *MmapAddr;					/* ring as mapped in the client */
+	endpoint_t MmapProcNr;			/* client the ring is mapped in */
+	u32_t MmapLost;					/* fragments overwritten in mmap mode */
+	int DmaCapacity;				/* DmaSize as set by the driver */
+	int DefFragments;				/* NrOfDmaFragments as set by driver */
+	struct dsp_stats Stats;			/* counters for DSPIOSTATS */
+	u64_t LastIrq;					/* tsc of previous interrupt, 0 if the 
+									   sub device was (re)started since */
+	u64_t IrqGapSum;				/* usecs between interrupts, summed */
+	u32_t IrqGaps;					/* nr. of gaps in IrqGapSum */
+	unsigned int SelectOps;			/* CDEV_OP_* a select waits for */
+	endpoint_t SelectProcNr;		/* who to notify when they are ready */
+	devminor_t SelectMinor;			/* minor device it selected on */
+	int OverrunPolicy;				/* DSP_OVERRUN_* for capture */
+	struct dsp_lost Lost;			/* recorded data dropped */
+	char *PoolBuf;					/* extra buffers in extra_pool */
+	int DefExtraBuffers;			/* NrOfExtraBuffers as set by driver */
+	char *SpillBuf;					/* grown extra buffers, or NULL */
+	u64_t FragsDone;				/* fragments the hardware played or 
+									   recorded since it was started */
+	u64_t LastPos;					/* last position reported, in bytes */
+	clock_t PollTicks;				/* poll interval, 0 if the sub device 
+									   interrupts after every fragment */
+	u32_t PollFrag;					/* fragment the dma engine was in at
+									   the previous poll */
+	int DrainPending;				/* a DSPIODRAIN waits for the ring to
+									   play out */
+	endpoint_t DrainProcNr;			/* who to reply to when it has */
+	cdev_id_t DrainId;				/* id to reply to */
+	int LinkedTo;					/* sub device started together with
+									   this one, see DSPIOLINK, or 
+									   NO_CHANNEL */
+	int Mixing;						/* the writes come from mix clients */
+	u32_t MixSample;				/* bytes per sample they mix in */
+	u32_t MixFlip;					/* MIX_FLIP* if samples are signed */
+	u64_t FragsMixed;				/* fragments the mixer put in the ring
+									   since the sub device started */
+	conv_stream_t Conv;				/* what its writer writes */
+} sub_dev_ext_t;
+
+#define NR_MIX_CLIENTS		(DRV_MAX_CARDS * DRV_MAX_MIX_CLIENTS)
+									/* writers mixed, of all cards */
+#define MIX_MINOR			128	/* minor device of the first one; those
+								   of the driver are below it */
+#define IS_MIX_MINOR(m)		((m) >= MIX_MINOR && \
+								 (m) < MIX_MINOR + NR_MIX_CLIENTS)
+
+/* One of the writers that share a playback sub device, see mix_open().
+ * It writes into a ring of its own, which the mixer empties. */
+typedef struct {
+	int InUse;						/* slot taken; after the close until
+									   its ring is mixed */
+	int Opened;
+	int SubDev;						/* playback sub device it mixes onto */
+	devminor_t Minor;				/* special file it was cloned from */
+	char *Ring;						/* in extra_pool, NULL if the slot
+									   is never needed */
+	u32_t RingRead;					/* oldest byte not mixed yet */
+	u32_t RingLength;				/* bytes not mixed yet */
+	int Flush;						/* mix the last incomplete fragment */
+	u64_t LastFrag;					/* FragsMixed its last data went in */
+	audio_req_t Req;				/* a write that waits for room */
+	int ReqPending;
+	int DrainPending;				/* a DSPIODRAIN waits */
+	endpoint_t DrainProcNr;
+	cdev_id_t DrainId;
+	unsigned int SelectOps;			/* CDEV_OP_WR if a select waits */
+	endpoint_t SelectProcNr;
+	conv_stream_t Conv;				/* converted into Ring */
+} mix_client_t;
+
 static int msg_open(devminor_t minor_dev_nr, int access,
 	endpoint_t user_endpt);
 static int msg_close(int minor_dev_nr);
@@ -37,25 +173,141 @@ static ssize_t msg_write(devminor_t minor, u64_t position, endpoint_t endpt,
 	cp_grant_id_t grant, size_t size, int flags, cdev_id_t id);
 static int msg_ioctl(devminor_t minor, unsigned long request, endpoint_t endpt,
 	cp_grant_id_t grant, int flags, endpoint_t user_endpt, cdev_id_t id);
+static int msg_select(devminor_t minor, unsigned int ops, endpoint_t endpt);
 static void msg_hardware(unsigned int mask);
+static void msg_alarm(clock_t stamp);
+static int enable_irq(int sub_dev_nr);
 static int open_sub_dev(int sub_dev_nr, int operation);
 static int close_sub_dev(int sub_dev_nr);
 static void handle_int_write(int sub_dev_nr);
 static void handle_int_read(int sub_dev_nr);
 static void data_to_user(sub_dev_t *sub_dev_ptr);
 static void data_from_user(sub_dev_t *sub_dev_ptr);
+static void copy_from_req(sub_dev_t *subdev, audio_req_t *req);
+static void copy_to_req(sub_dev_t *sub_dev_ptr, audio_req_t *req);
+static void conv_copy_from_req(sub_dev_t *subdev, audio_req_t *req);
+static size_t conv_from_req(conv_stream_t *cs, audio_req_t *req, char *dst,
+	size_t room);
+static size_t rate_from_req(conv_stream_t *cs, audio_req_t *req, char *dst,
+	size_t room);
+static void conv_keep_part(conv_stream_t *cs, audio_req_t *req);
+static void conv_put(conv_stream_t *cs, char *dst, const void *src,
+	size_t frames);
+static int conv_setup(conv_stream_t *cs, int sub_dev_nr, u32_t frag_size);
+static int conv_set_format(conv_stream_t *cs, struct dsp_format *format,
+	int sub_dev_nr);
+static int set_format(sub_dev_t *sub_dev_ptr, struct dsp_format *format);
+static void conv_reset(conv_stream_t *cs);
+static int conv_set_gain(conv_stream_t *cs, struct dsp_gain *gain, 
+	u32_t mute, int sub_dev_nr);
+static int set_gain(sub_dev_t *sub_dev_ptr, struct dsp_gain *gain, 
+	u32_t mute);
+static void add_copy_vec(struct vscp_vec *vec, int *nr, endpoint_t from,
+	endpoint_t to, cp_grant_id_t grant, vir_bytes offset, vir_bytes addr,
+	size_t bytes);
+static void commit_fragment(sub_dev_t *subdev);
+static void flush_partial_fragment(sub_dev_t *subdev);
+static void stash_fragment(sub_dev_t *sub_dev_ptr);
+static int make_room(sub_dev_t *sub_dev_ptr);
+static int spill(sub_dev_t *sub_dev_ptr);
+static void drop_oldest(sub_dev_t *sub_dev_ptr);
+static void free_spill(sub_dev_t *sub_dev_ptr);
+static int set_overrun(sub_dev_t *sub_dev_ptr, u32_t policy);
+static int set_params(sub_dev_t *sub_dev_ptr, struct dsp_params *params);
+static int get_position(sub_dev_t *sub_dev_ptr, struct dsp_position *pos);
+static int get_samples_in_buf(sub_dev_t *sub_dev_ptr, u32_t *frames);
+static void resume_playback(sub_dev_t *subdev);
+static void count_irq(int sub_dev_nr);
+static void ack_int(int sub_dev_nr);
+static int set_poll(sub_dev_t *sub_dev_ptr, u32_t msec);
+static void poll_sub_dev(int sub_dev_nr);
+static void set_poll_alarm(void);
+static void stop_playback(sub_dev_t *subdev);
+static int drain(sub_dev_t *sub_dev_ptr, endpoint_t endpt, cdev_id_t id,
+	int flags);
+static void drain_done(sub_dev_t *sub_dev_ptr, int status);
+static int drop(sub_dev_t *sub_dev_ptr);
+static int set_link(special_file_t *special_file_ptr, u32_t on);
+static void unlink_sub_dev(int sub_dev_nr);
+static void start_linked(sub_dev_t *play_ptr, sub_dev_t *rec_ptr);
+static void dma_started(sub_dev_t *sub_dev_ptr);
+static mix_client_t *get_mix_client(devminor_t minor);
+static int mix_users(int sub_dev_nr);
+static int mix_open(special_file_t *special_file_ptr);
+static int mix_close(mix_client_t *mc);
+static void mix_release(mix_client_t *mc);
+static ssize_t mix_write(mix_client_t *mc, endpoint_t endpt, 
+	cp_grant_id_t grant, size_t size, int flags, cdev_id_t id);
+static int mix_ioctl(mix_client_t *mc, unsigned long request, 
+	endpoint_t endpt, cp_grant_id_t grant, int flags, endpoint_t user_endpt,
+	cdev_id_t id);
+static int mix_select(mix_client_t *mc, unsigned int ops, endpoint_t endpt);
+static int mix_cancel(mix_client_t *mc, endpoint_t endpt, cdev_id_t id);
+static int mix_drain(mix_client_t *mc, endpoint_t endpt, cdev_id_t id, 
+	int flags);
+static int mix_drained(mix_client_t *mc);
+static int mix_set_gain(mix_client_t *mc, struct dsp_gain *gain, 
+	u32_t mute);
+static int mix_flushed(int sub_dev_nr);
+static void mix_drop(mix_client_t *mc);
+static u32_t mix_room(mix_client_t *mc);
+static void mix_copy_in(mix_client_t *mc, audio_req_t *req);
+static int mix_prepare(sub_dev_t *sub_dev_ptr);
+static int mix_ready(sub_dev_t *sub_dev_ptr, int any);
+static void mix_fill(sub_dev_t *sub_dev_ptr);
+static void mix_fragment(sub_dev_t *sub_dev_ptr);
+static void mix_add(sub_dev_ext_t *ext, i32_t *acc, char *src, u32_t bytes);
+static void mix_serve(sub_dev_t *sub_dev_ptr);
+static int select_sub_dev(int chan, unsigned int op, unsigned int ops,
+	devminor_t minor, endpoint_t endpt);
+static unsigned int select_ready(sub_dev_t *sub_dev_ptr);
+static void select_notify(sub_dev_t *sub_dev_ptr);
+static int get_stats(sub_dev_t *sub_dev_ptr, struct dsp_stats *stats);
+static int fw_io_ctl(unsigned long request, void *val, sub_dev_t *sub_dev_ptr,
+	endpoint_t user_endpt);
+static int mmap_ring(sub_dev_t *sub_dev_ptr, endpoint_t user_endpt,
+	struct dsp_mmap_info *info);
+static int munmap_ring(sub_dev_t *sub_dev_ptr);
+static int set_periods(sub_dev_t *sub_dev_ptr, struct dsp_periods *periods);
+static int set_profile(sub_dev_t *sub_dev_ptr, u32_t profile);
+static void reset_periods(sub_dev_t *sub_dev_ptr);
+static int mmap_sync(sub_dev_t *sub_dev_ptr, struct dsp_mmap_sync *sync);
+static int check_minors(void);
+static int init_extra_pool(void);
+static void mix_rings(int *rings, size_t *ring_size);
+static size_t extra_buf_size(sub_dev_t *sub_dev_ptr);
 static int init_buffers(sub_dev_t *sub_dev_ptr);
+static void free_buffers(void);
 static int get_started(sub_dev_t *sub_dev_ptr);
 static int io_ctl_length(int io_request);
 static special_file_t* get_special_file(int minor_dev_nr);
+static int queue_request(sub_dev_t *sub_dev_ptr, endpoint_t endpt,
+	cp_grant_id_t grant, size_t size, cdev_id_t id);
+static void dequeue_request(sub_dev_t *sub_dev_ptr);
+static void flush_requests(sub_dev_t *sub_dev_ptr, int status);
+static int msg_cancel(devminor_t minor, endpoint_t endpt, cdev_id_t id);
 #if defined(__i386__)
+static int alloc_dma_buf(sub_dev_t *sub_dev_ptr);
 static void tell_dev(vir_bytes buf, size_t size, int pci_bus,
 	int pci_dev, int pci_func);
 #endif
 
+static sub_dev_ext_t *sub_dev_ext;	/* one entry per sub device */
+static mix_client_t mix_client[NR_MIX_CLIENTS];
+static char *extra_pool;			/* extra buffers of all sub devices,
+									   and the rings of the mix clients */
+
 static char io_ctl_buf[IOCPARM_MASK];
-static int irq_hook_id = 0;	/* id of irq hook at the kernel */
-static int irq_hook_set = FALSE;
+static i16_t conv_tmp[CONV_BUF_FRAMES * 2];	/* between the resampler and 
+											   the conversions */
+static u8_t conv_buf[CONV_BUF_FRAMES * CONV_MAX_FRAME];	/* converted 
+														   samples come 
+														   from here */
+static int nr_cards;				/* cards the driver serves */
+static int irq_hook_id[DRV_MAX_CARDS];	/* id of the irq hook of each card
+										   at the kernel */
+static int irq_hooks_set = 0;		/* cards whose irq policy is set */
+static int poll_alarm_set = FALSE;	/* an alarm for polling is pending */
 
 /* SEF functions and variables. */
 static void sef_local_startup(void);
@@ -68,7 +320,10 @@ static struct chardriver audio_tab = {
 	.cdr_read	= msg_read,
 	.cdr_write	= msg_write,
 	.cdr_ioctl	= msg_ioctl,
-	.cdr_intr	= msg_hardware
+	.cdr_cancel	= msg_cancel,
+	.cdr_select	= msg_select,
+	.cdr_intr	= msg_hardware,
+	.cdr_alarm	= msg_alarm
 };
 
 int main(void)
@@ -111,7 +366,7 @@ static void sef_local_startup(void)
 static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
 {
 /* Initialize the audio driver framework. */
-	int i; char irq;
+	int i, c; char irq[DRV_MAX_CARDS];
 	static int executed = 0;
 	sub_dev_t* sub_dev_ptr;
 
@@ -121,6 +376,15 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
 		return EIO;
 	}
 
+	if (check_minors() != OK) return EIO;
+
+	/* allocate the framework's own per sub device state */
+	if (sub_dev_ext == NULL && (sub_dev_ext = calloc(drv.NrOfSubDevices,
+			sizeof(sub_dev_ext_t))) == NULL) {
+		printf("%s: Could not allocate sub device state\n", drv.DriverName);
+		return ENOMEM;
+	}
+
 	/* init variables, get dma buffers */
 	for (i = 0; i < drv.NrOfSubDevices; i++) {
 
@@ -137,6 +401,22 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
 		sub_dev_ptr->RevivePending = FALSE;
 		sub_dev_ptr->OutOfData = FALSE;
 		sub_dev_ptr->Nr = i;
+		sub_dev_ext[i].ReqReadNext = 0;
+		sub_dev_ext[i].ReqLength = 0;
+		sub_dev_ext[i].FillOffset = 0;
+		sub_dev_ext[i].ReadOffset = 0;
+		sub_dev_ext[i].MmapAddr = NULL;
+		sub_dev_ext[i].LinkedTo = NO_CHANNEL;
+		/* the driver's ring layout is the most we can ever use */
+		sub_dev_ext[i].DmaCapacity = sub_dev_ptr->DmaSize;
+		sub_dev_ext[i].DefFragments = sub_dev_ptr->NrOfDmaFragments;
+		sub_dev_ext[i].DefExtraBuffers = sub_dev_ptr->NrOfExtraBuffers;
+	}
+
+	/* the extra buffers are kept for the lifetime of the driver */
+	if (init_extra_pool() != OK) {
+		printf("%s: Could not allocate extra buffers\n", drv.DriverName);
+		return ENOMEM;
 	}
 
 	/* initialize hardware*/
@@ -145,22 +425,36 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
 		return EIO;
 	}
 
-	/* get irq from device driver...*/
-	if (drv_get_irq(&irq) != OK) {
-		printf("%s: init driver couldn't get IRQ", drv.DriverName);
+	/* get the irq of every card from device driver...*/
+	nr_cards = drv_get_nr_cards();
+	if (nr_cards < 1 || nr_cards > DRV_MAX_CARDS) {
+		printf("%s: init driver got %d cards", drv.DriverName, nr_cards);
 		return EIO;
 	}
+	for (c = 0; c < nr_cards; c++) {
+		if (drv_get_card_irq(c, &irq[c]) != OK) {
+			printf("%s: init driver couldn't get IRQ of card %d", 
+				drv.DriverName, c);
+			return EIO;
+		}
+	}
 	/* TODO: execute the rest of this function only once 
 	   we don't want to set irq policy twice */
 	if (executed) return OK;
 	executed = TRUE;
 
-	/* ...and register interrupt vector */
-	if ((i=sys_irqsetpolicy(irq, 0, &irq_hook_id )) != OK){
-		printf("%s: init driver couldn't set IRQ policy: %d", drv.DriverName, i);
-		return EIO;
+	/* ...and register an interrupt vector for each. The id a hook is set
+	   with is the bit of its card in the mask msg_hardware() gets. */
+	for (c = 0; c < nr_cards; c++) {
+		irq_hook_id[c] = c;
+		if ((i=sys_irqsetpolicy(irq[c], 0, &irq_hook_id[c])) != OK){
+			printf("%s: init driver couldn't set IRQ policy: %d", 
+				drv.DriverName, i);
+			return EIO;
+		}
+		/* now signal handler knows it must unregister policy*/
+		irq_hooks_set = c + 1;
 	}
-	irq_hook_set = TRUE; /* now signal handler knows it must unregister policy*/
 
 	/* Announce we are up! */
 	chardriver_announce();
@@ -173,7 +467,7 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
  *===========================================================================*/
 static void sef_cb_signal_handler(int signo)
 {
-	int i;
+	int i, c;
 	char irq;
 
 	/* Only check for termination signal, ignore anything else. */
@@ -182,16 +476,17 @@ static void sef_cb_signal_handler(int signo)
 	for (i = 0; i < drv.NrOfSubDevices; i++) {
 		drv_stop(i); /* stop all sub devices */
 	}
-	if (irq_hook_set) {
-		if (sys_irqdisable(&irq_hook_id) != OK) {
+	free_buffers();
+	for (c = 0; c < irq_hooks_set; c++) {
+		if (sys_irqdisable(&irq_hook_id[c]) != OK) {
 			printf("Could not disable IRQ\n");
 		}
 		/* get irq from device driver*/
-		if (drv_get_irq(&irq) != OK) {
+		if (drv_get_card_irq(c, &irq) != OK) {
 			printf("Msg SIG_STOP Couldn't get IRQ");
 		}
 		/* remove the policy */
-		if (sys_irqrmpolicy(&irq_hook_id) != OK) {
+		if (sys_irqrmpolicy(&irq_hook_id[c]) != OK) {
 			printf("%s: Could not disable IRQ\n",drv.DriverName);
 		}
 	}
@@ -200,15 +495,22 @@ static void sef_cb_signal_handler(int signo)
 static int msg_open(devminor_t minor_dev_nr, int UNUSED(access),
 	endpoint_t UNUSED(user_endpt))
 {
-FUNC_LOG();
 	int r, read_chan, write_chan, io_ctl;
 	special_file_t* special_file_ptr;
 
+	TRACE(TRACE_OPEN, TRACE_NO_SUB_DEV, minor_dev_nr);
+
 	special_file_ptr = get_special_file(minor_dev_nr);
 	if(special_file_ptr == NULL) {
 		return EIO;
 	}
 
+	/* a special file several writers can share gives each a minor of 
+	   its own */
+	if (drv_get_mix_clients(minor_dev_nr) > 1) {
+		return mix_open(special_file_ptr);
+	}
+
 	read_chan = special_file_ptr->read_chan;
 	write_chan = special_file_ptr->write_chan;
 	io_ctl = special_file_ptr->io_ctl;
@@ -268,6 +570,24 @@ static int open_sub_dev(int sub_dev_nr, int dma_mode) {
 	sub_dev_ptr->BufLength = 0;
 	sub_dev_ptr->RevivePending = FALSE;
 	sub_dev_ptr->OutOfData = TRUE;
+	sub_dev_ext[sub_dev_nr].ReqReadNext = 0;
+	sub_dev_ext[sub_dev_nr].ReqLength = 0;
+	sub_dev_ext[sub_dev_nr].FillOffset = 0;
+	sub_dev_ext[sub_dev_nr].ReadOffset = 0;
+	sub_dev_ext[sub_dev_nr].MmapAddr = NULL;
+	sub_dev_ext[sub_dev_nr].MmapLost = 0;
+	memset(&sub_dev_ext[sub_dev_nr].Stats, 0, sizeof(struct dsp_stats));
+	sub_dev_ext[sub_dev_nr].LastIrq = 0;
+	sub_dev_ext[sub_dev_nr].IrqGapSum = 0;
+	sub_dev_ext[sub_dev_nr].IrqGaps = 0;
+	sub_dev_ext[sub_dev_nr].SelectOps = 0;
+	sub_dev_ext[sub_dev_nr].OverrunPolicy = DSP_OVERRUN_STOP;
+	memset(&sub_dev_ext[sub_dev_nr].Lost, 0, sizeof(struct dsp_lost));
+	sub_dev_ext[sub_dev_nr].PollTicks = 0;
+	sub_dev_ext[sub_dev_nr].DrainPending = FALSE;
+	sub_dev_ext[sub_dev_nr].LinkedTo = NO_CHANNEL;
+	sub_dev_ext[sub_dev_nr].Mixing = FALSE;
+	conv_reset(&sub_dev_ext[sub_dev_nr].Conv);
 
 	/* arrange DMA */
 	if (dma_mode != NO_DMA) { /* sub device uses DMA */
@@ -284,6 +604,14 @@ static int msg_close(devminor_t minor_dev_nr)
 
 	int r, read_chan, write_chan, io_ctl; 
 	special_file_t* special_file_ptr;
+	mix_client_t *mc;
+
+	TRACE(TRACE_CLOSE, TRACE_NO_SUB_DEV, minor_dev_nr);
+
+	if (IS_MIX_MINOR(minor_dev_nr)) {
+		mc = get_mix_client(minor_dev_nr);
+		return (mc != NULL) ? mix_close(mc) : EIO;
+	}
 
 	special_file_ptr = get_special_file(minor_dev_nr);
 	if(special_file_ptr == NULL) {
@@ -316,9 +644,18 @@ static int msg_close(devminor_t minor_dev_nr)
 
 
 static int close_sub_dev(int sub_dev_nr) {
-	size_t size;
 	sub_dev_t *sub_dev_ptr;
 	sub_dev_ptr = &sub_dev[sub_dev_nr];
+	unlink_sub_dev(sub_dev_nr);
+	/* take the ring away from the client; a mapping left behind would
+	   point at memory we are about to free */
+	munmap_ring(sub_dev_ptr);
+	/* a select can't outlive the open it was done on */
+	sub_dev_ext[sub_dev_nr].SelectOps = 0;
+	if (sub_dev_ptr->DmaMode == WRITE_DMA && sub_dev_ptr->Opened) {
+		/* play what is left of the last, incomplete fragment */
+		flush_partial_fragment(sub_dev_ptr);
+	}
 	if (sub_dev_ptr->DmaMode == WRITE_DMA && !sub_dev_ptr->OutOfData) {
 		/* do nothing, still data in buffers that has to be transferred */
 		sub_dev_ptr->Opened = FALSE;  /* keep DMA busy */
@@ -333,10 +670,10 @@ static int close_sub_dev(int sub_dev_nr) {
 	sub_dev_ptr->DmaBusy = FALSE;
 	/* stop the device */
 	drv_stop(sub_dev_ptr->Nr);
-	/* free the buffers */
-	size= sub_dev_ptr->DmaSize + 64 * 1024;
-	free_contig(sub_dev_ptr->DmaBuf, size);
-	free(sub_dev_ptr->ExtraBuf);
+	/* the next open starts with the driver's ring layout again */
+	reset_periods(sub_dev_ptr);
+	free_spill(sub_dev_ptr);
+	/* the buffers are kept for the next open */
 	return OK;
 }
 
@@ -347,6 +684,12 @@ static int msg_ioctl(devminor_t minor, unsigned long request, endpoint_t endpt,
 	int status, len, chan;
 	sub_dev_t *sub_dev_ptr;
 	special_file_t* special_file_ptr;
+	mix_client_t *mc;
+
+	if (IS_MIX_MINOR(minor)) {
+		if ((mc = get_mix_client(minor)) == NULL) return EIO;
+		return mix_ioctl(mc, request, endpt, grant, flags, user_endpt, id);
+	}
 
 	special_file_ptr = get_special_file(minor);
 	if(special_file_ptr == NULL) {
@@ -367,17 +710,39 @@ static int msg_ioctl(devminor_t minor, unsigned long request, endpoint_t endpt,
 		return EIO;
 	}
 
-	if (request & IOC_IN) { /* if there is data for us, copy it */
-		len = io_ctl_length(request);
+	/* a drain is replied to once the hardware has played everything */
+	if (request == DSPIODRAIN) return drain(sub_dev_ptr, endpt, id, flags);
 
-		if (sys_safecopyfrom(endpt, grant, 0, (vir_bytes)io_ctl_buf,
-		    len) != OK) {
+	len = io_ctl_length(request);
+	if (request & IOC_IN) { /* if there is data for us, copy it */
+		/* io_ctl_buf still holds the last ioctl's, don't act on that */
+		if ((status = sys_safecopyfrom(endpt, grant, 0, 
+				(vir_bytes)io_ctl_buf, len)) != OK) {
 			printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+			return status;
 		}
 	}
 
-	/* all ioctl's are passed to the device specific part of the driver */
-	status = drv_io_ctl(request, (void *)io_ctl_buf, &len, chan);
+	/* the framework serves its own ioctl's, all others are passed to the 
+	   device specific part of the driver */
+	if (request == DSPIOLINK) {
+		/* a link is between the channels of the special file */
+		status = set_link(special_file_ptr, *((u32_t *) io_ctl_buf));
+	} else {
+		status = fw_io_ctl(request, (void *)io_ctl_buf, sub_dev_ptr, 
+				user_endpt);
+	}
+	if (status == ENOTTY) {
+		status = drv_io_ctl(request, (void *)io_ctl_buf, &len, chan);
+	}
+	/* the device plays the rate the client set now */
+	if (status == OK && request == DSPIORATE) sub_dev_ext[chan].Conv.Rate = 0;
+	if (status == OK && request == DSPIOPAUSE) 
+		sub_dev_ext[chan].Stats.pauses += 1;
+	if (status == OK && request == DSPIORESUME) {
+		sub_dev_ext[chan].Stats.resumes += 1;
+		sub_dev_ext[chan].LastIrq = 0;
+	}
 
 	/* IOC_OUT bit -> user expects data */
 	if (status == OK && request & IOC_OUT) {
@@ -393,12 +758,347 @@ static int msg_ioctl(devminor_t minor, unsigned long request, endpoint_t endpt,
 }
 
 
+/* ioctl's served by the framework itself; ENOTTY for all others */
+static int fw_io_ctl(unsigned long request, void *val, sub_dev_t *sub_dev_ptr,
+	endpoint_t user_endpt)
+{
+	struct dsp_gain gain;
+
+	switch(request) {
+		case DSPIOMMAP:
+			return mmap_ring(sub_dev_ptr, user_endpt, 
+					(struct dsp_mmap_info *) val);
+		case DSPIOMUNMAP:
+			return munmap_ring(sub_dev_ptr);
+		case DSPIOMMAPSYNC:
+			return mmap_sync(sub_dev_ptr, (struct dsp_mmap_sync *) val);
+		case DSPIOPERIODS:
+			return set_periods(sub_dev_ptr, (struct dsp_periods *) val);
+		case DSPIOPROFILE:
+			return set_profile(sub_dev_ptr, *((u32_t *) val));
+		case DSPIOSTATS:
+			return get_stats(sub_dev_ptr, (struct dsp_stats *) val);
+		case DSPIOOVERRUN:
+			return set_overrun(sub_dev_ptr, *((u32_t *) val));
+		case DSPIOPARAMS:
+			return set_params(sub_dev_ptr, (struct dsp_params *) val);
+		case DSPIOPOSITION:
+			return get_position(sub_dev_ptr, (struct dsp_position *) val);
+		case DSPIOPOLL:
+			return set_poll(sub_dev_ptr, *((u32_t *) val));
+		case DSPIODROP:
+			return drop(sub_dev_ptr);
+		case DSPIOSAMPLESINBUF:
+			return get_samples_in_buf(sub_dev_ptr, (u32_t *) val);
+		case DSPIOFORMAT:
+			return set_format(sub_dev_ptr, (struct dsp_format *) val);
+		case DSPIOQUALITY:
+			if (sub_dev_ptr->DmaMode != WRITE_DMA || 
+					*((u32_t *) val) > DSP_QUALITY_BEST) {
+				return EINVAL;
+			}
+			sub_dev_ext[sub_dev_ptr->Nr].Conv.Quality = *((u32_t *) val);
+			return OK;
+		case DSPIOGAIN:
+			return set_gain(sub_dev_ptr, (struct dsp_gain *) val, 
+				sub_dev_ext[sub_dev_ptr->Nr].Conv.Muted);
+		case DSPIOMUTE:
+			/* the gain as it is, in a short ramp */
+			gain = sub_dev_ext[sub_dev_ptr->Nr].Conv.GainSet;
+			gain.ramp = 0;
+			return set_gain(sub_dev_ptr, &gain, *((u32_t *) val) != 0);
+		case DSPIOFREEBUF:
+			/* playback has no extra buffers: is there room in the ring? */
+			if (sub_dev_ptr->DmaMode != WRITE_DMA) return ENOTTY;
+			*((u32_t *) val) = (select_ready(sub_dev_ptr) & CDEV_OP_WR) != 0;
+			return OK;
+		case DSPIOLOST:
+			*((struct dsp_lost *) val) = sub_dev_ext[sub_dev_ptr->Nr].Lost;
+			return OK;
+#ifdef AUDIO_TRACE
+		case DSPIOTRACE:
+			return audio_trace_dump((struct dsp_trace *) val);
+#endif
+		default:
+			return ENOTTY;
+	}
+}
+
+
+/* map the dma ring of a sub device into the address space of a client */
+static int mmap_ring(sub_dev_t *sub_dev_ptr, endpoint_t user_endpt,
+	struct dsp_mmap_info *info)
+{
+	void *addr;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode == NO_DMA) return EINVAL;
+	if (ext->MmapAddr != NULL) return EBUSY;
+	/* the client writes the ring itself, there is nothing to convert */
+	if (CONV_ON(&ext->Conv)) return EINVAL;
+
+	/* only on a fresh ring; data that went through read/write would 
+	   otherwise be mixed up with what the client does in the ring */
+	if (sub_dev_ptr->DmaBusy || ext->ReqLength > 0 || ext->FillOffset > 0 ||
+			sub_dev_ptr->DmaLength > 0 || sub_dev_ptr->BufLength > 0) {
+		return EBUSY;
+	}
+	if (drv_get_frag_size(&(sub_dev_ptr->FragSize), sub_dev_ptr->Nr) != OK) {
+		printf("%s: Could not retrieve fragment size!\n", drv.DriverName);
+		return EIO;
+	}
+
+	addr = vm_remap(user_endpt, SELF, NULL, sub_dev_ptr->DmaPtr, 
+			ext->DmaCapacity);
+	if (addr == MAP_FAILED) {
+		printf("%s: Could not map dma buffer into %d\n", 
+				drv.DriverName, user_endpt);
+		return ENOMEM;
+	}
+	ext->MmapAddr = addr;
+	ext->MmapProcNr = user_endpt;
+	ext->MmapLost = 0;
+
+	/* don't show the client what an earlier user left in the ring */
+	memset(sub_dev_ptr->DmaPtr, 0, ext->DmaCapacity);
+
+	info->addr = addr;
+	info->frag_size = sub_dev_ptr->FragSize;
+	info->nr_frags = sub_dev_ptr->NrOfDmaFragments;
+	info->size = info->frag_size * info->nr_frags;
+	return OK;
+}
+
+
+/* take the dma ring away from the client again */
+static int munmap_ring(sub_dev_t *sub_dev_ptr)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+	if (ext->MmapAddr == NULL) return OK;
+
+	/* fails if the client is gone already, which is fine */
+	vm_unmap(ext->MmapProcNr, ext->MmapAddr);
+	ext->MmapAddr = NULL;
+	return OK;
+}
+
+
+/* advance the ring in mmap mode by the fragments the client filled (playback)
+ * or consumed (capture), and tell the client where the ring stands now */
+static int mmap_sync(sub_dev_t *sub_dev_ptr, struct dsp_mmap_sync *sync)
+{
+	u32_t n;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+	if (ext->MmapAddr == NULL) return EINVAL;
+
+	n = sync->commit;
+	if (sub_dev_ptr->DmaMode == WRITE_DMA) {
+		if (n > (u32_t) (sub_dev_ptr->NrOfDmaFragments - 
+				sub_dev_ptr->DmaLength)) {
+			return EINVAL;
+		}
+		sub_dev_ptr->DmaLength += n;
+		sub_dev_ptr->DmaFillNext = (sub_dev_ptr->DmaFillNext + n) % 
+			sub_dev_ptr->NrOfDmaFragments;
+
+		if (!sub_dev_ptr->DmaBusy && sub_dev_ptr->DmaLength > 0) {
+			get_started(sub_dev_ptr);
+		} else {
+			resume_playback(sub_dev_ptr);
+		}
+
+		sync->app_frag = sub_dev_ptr->DmaFillNext;
+		sync->hw_frag = sub_dev_ptr->DmaReadNext;
+		sync->avail = sub_dev_ptr->NrOfDmaFragments - sub_dev_ptr->DmaLength;
+	} else {
+		if (n > (u32_t) sub_dev_ptr->DmaLength) return EINVAL;
+
+		sub_dev_ptr->DmaLength -= n;
+		sub_dev_ptr->DmaReadNext = (sub_dev_ptr->DmaReadNext + n) % 
+			sub_dev_ptr->NrOfDmaFragments;
+
+		/* recording starts with the first sync */
+		if (!sub_dev_ptr->DmaBusy) get_started(sub_dev_ptr);
+
+		sync->app_frag = sub_dev_ptr->DmaReadNext;
+		sync->hw_frag = sub_dev_ptr->DmaFillNext;
+		sync->avail = sub_dev_ptr->DmaLength;
+	}
+	sync->lost = ext->MmapLost;
+	return OK;
+}
+
+
+/* lay out the dma ring of a sub device as count fragments of size bytes;
+ * a count of 0 only reports the current layout */
+static int set_periods(sub_dev_t *sub_dev_ptr, struct dsp_periods *periods)
+{
+	int len;
+	u32_t count, size, max;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode == NO_DMA) return EINVAL;
+
+	count = periods->count;
+	size = periods->size;
+	if (count == 0) {
+		if (drv_get_frag_size(&(sub_dev_ptr->FragSize), 
+					sub_dev_ptr->Nr) != OK) {
+			return EIO;
+		}
+		periods->count = sub_dev_ptr->NrOfDmaFragments;
+		periods->size = sub_dev_ptr->FragSize;
+		return OK;
+	}
+
+	/* the ring can only be laid out anew while nothing is in it */
+	if (sub_dev_ptr->DmaBusy || ext->MmapAddr != NULL || ext->ReqLength > 0 ||
+			ext->FillOffset > 0 || sub_dev_ptr->DmaLength > 0 || 
+			sub_dev_ptr->BufLength > 0) {
+		return EBUSY;
+	}
+
+	/* the fragments must fit in the dma buffer and the hardware must 
+	   interrupt on each of them, unless it is polled. The extra buffers 
+	   were allocated for the driver's fragment size, so that is the 
+	   largest one. */
+	max = (ext->PollTicks > 0) ? (u32_t) ext->DmaCapacity : 
+		(u32_t) drv_get_max_fragments(sub_dev_ptr->Nr);
+	if (max > (u32_t) (ext->DmaCapacity / sub_dev_ptr->MinFragmentSize)) {
+		max = ext->DmaCapacity / sub_dev_ptr->MinFragmentSize;
+	}
+	if (count < 2 || count > max || 
+			size < (u32_t) sub_dev_ptr->MinFragmentSize ||
+			size > (u32_t) (ext->DmaCapacity / ext->DefFragments) ||
+			count * size > (u32_t) ext->DmaCapacity) {
+		return EINVAL;
+	}
+
+	sub_dev_ptr->NrOfDmaFragments = count;
+	sub_dev_ptr->DmaSize = count * size;
+
+	/* the driver interrupts after every fragment of its own size */
+	len = sizeof(size);
+	if (drv_io_ctl(DSPIOSIZE, &size, &len, sub_dev_ptr->Nr) != OK) {
+		reset_periods(sub_dev_ptr);
+		return EINVAL;
+	}
+	sub_dev_ptr->FragSize = size;
+	sub_dev_ptr->DmaReadNext = 0;
+	sub_dev_ptr->DmaFillNext = 0;
+	return OK;
+}
+
+
+/* set the format of a stream and its fragment size in one go; a rate 
+ * the device can't do is resampled, see DSPIOQUALITY */
+static int set_params(sub_dev_t *sub_dev_ptr, struct dsp_params *params)
+{
+	int r;
+	u32_t rate;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode == NO_DMA) return EINVAL;
+
+	/* data already handed over would be played in the wrong format */
+	if (sub_dev_ptr->DmaBusy || ext->MmapAddr != NULL || ext->ReqLength > 0 ||
+			ext->FillOffset > 0 || sub_dev_ptr->DmaLength > 0 || 
+			sub_dev_ptr->BufLength > 0 || ext->Conv.PartLen > 0) {
+		return EBUSY;
+	}
+
+	if (params->frag_size == 0) {
+		params->frag_size = 
+			sub_dev_ptr->DmaSize / sub_dev_ptr->NrOfDmaFragments;
+	}
+	rate = params->rate;
+	if ((r = drv_set_params(params, sub_dev_ptr->Nr)) != OK) return r;
+
+	/* the writer gets the rate it asked for, the device plays its own */
+	ext->Conv.Rate = 0;
+	if (sub_dev_ptr->DmaMode == WRITE_DMA && !ext->Mixing && 
+			params->rate != rate && rate >= RATE_MIN && rate <= RATE_MAX) {
+		ext->Conv.Rate = rate;
+		params->rate = rate;
+	}
+
+	sub_dev_ptr->FragSize = params->frag_size;
+	return OK;
+}
+
+
+/* lay out the dma ring after one of the named presets */
+static int set_profile(sub_dev_t *sub_dev_ptr, u32_t profile)
+{
+	struct dsp_periods periods;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	switch(profile) {
+		case DSP_PROFILE_LOW_LATENCY:
+			/* many of the smallest fragments the device can do */
+			periods.size = sub_dev_ptr->MinFragmentSize;
+			periods.count = MIN(DSP_LOW_LATENCY_FRAGS, 
+					drv_get_max_fragments(sub_dev_ptr->Nr));
+			break;
+		case DSP_PROFILE_THROUGHPUT:
+			/* two fragments as large as possible, the fewest interrupts */
+			periods.size = ext->DmaCapacity / ext->DefFragments;
+			periods.count = 2;
+			break;
+		default:
+			return EINVAL;
+	}
+	return set_periods(sub_dev_ptr, &periods);
+}
+
+
+/* give a sub device back the ring layout its driver set up */
+static void reset_periods(sub_dev_t *sub_dev_ptr)
+{
+	int len;
+	u32_t size;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+	if (sub_dev_ptr->DmaSize == ext->DmaCapacity && 
+			sub_dev_ptr->NrOfDmaFragments == ext->DefFragments) {
+		return;
+	}
+	sub_dev_ptr->DmaSize = ext->DmaCapacity;
+	sub_dev_ptr->NrOfDmaFragments = ext->DefFragments;
+
+	size = ext->DmaCapacity / ext->DefFragments;
+	len = sizeof(size);
+	drv_io_ctl(DSPIOSIZE, &size, &len, sub_dev_ptr->Nr);
+}
+
+
 static ssize_t msg_write(devminor_t minor, u64_t UNUSED(position),
-	endpoint_t endpt, cp_grant_id_t grant, size_t size, int UNUSED(flags),
+	endpoint_t endpt, cp_grant_id_t grant, size_t size, int flags,
 	cdev_id_t id)
 {
 	int chan; sub_dev_t *sub_dev_ptr;
 	special_file_t* special_file_ptr;
+	audio_req_t req;
+	ssize_t r;
+	mix_client_t *mc;
+
+	if (IS_MIX_MINOR(minor)) {
+		if ((mc = get_mix_client(minor)) == NULL) return EIO;
+		return mix_write(mc, endpt, grant, size, flags, id);
+	}
 
 	special_file_ptr = get_special_file(minor);
 	chan = special_file_ptr->write_chan;
@@ -410,45 +1110,71 @@ static ssize_t msg_write(devminor_t minor, u64_t UNUSED(position),
 	/* get pointer to sub device data */
 	sub_dev_ptr = &sub_dev[chan];
 
-	if (!sub_dev_ptr->DmaBusy) { /* get fragment size on first write */
+	/* the client owns the ring while it is mapped */
+	if (sub_dev_ext[chan].MmapAddr != NULL) return EBUSY;
+
+	/* get fragment size on first write, not halfway a fragment */
+	if (!sub_dev_ptr->DmaBusy && sub_dev_ext[chan].FillOffset == 0) {
 		if (drv_get_frag_size(&(sub_dev_ptr->FragSize), sub_dev_ptr->Nr) != OK){
 			printf("%s; Failed to get fragment size!\n", drv.DriverName);
 			return EIO;
 		}
-	}
-	if(size != sub_dev_ptr->FragSize) {
-		printf("Fragment size does not match user's buffer length\n");
-		return EINVAL;
+		/* ...and what to convert to, the format may have changed too */
+		r = conv_setup(&sub_dev_ext[chan].Conv, chan, sub_dev_ptr->FragSize);
+		if (r != OK) return r;
 	}
 	/* if we are busy with something else than writing, return EBUSY */
 	if(sub_dev_ptr->DmaBusy && sub_dev_ptr->DmaMode != WRITE_DMA) {
 		printf("Already busy with something else than writing\n");
 		return EBUSY;
 	}
+	if (size == 0) return 0;
+
+	if (flags & CDEV_NONBLOCK) {
+		/* never overtake writes that are still waiting */
+		if (sub_dev_ext[chan].ReqLength > 0) return EAGAIN;
+
+		/* copy whatever fits right now and tell how much that was */
+		req.SourceProcNr = endpt;
+		req.Grant = grant;
+		req.Size = size;
+		req.Done = 0;
+		req.Id = id;
+		copy_from_req(sub_dev_ptr, &req);
+		resume_playback(sub_dev_ptr);
+		r = (req.Done > 0) ? (ssize_t) req.Done : EAGAIN;
+	} else {
+		if (queue_request(sub_dev_ptr, endpt, grant, size, id) != OK) {
+			printf("%s: Too many pending writes\n", drv.DriverName);
+			return EBUSY;
+		}
 
-	sub_dev_ptr->RevivePending = TRUE;
-	sub_dev_ptr->ReviveId = id;
-	sub_dev_ptr->ReviveGrant = grant;
-	sub_dev_ptr->SourceProcNr = endpt;
+		data_from_user(sub_dev_ptr);
 
-	data_from_user(sub_dev_ptr);
+		/* We may already have replied by now. In any case don't reply here. */
+		r = EDONTREPLY;
+	}
 
-	if(!sub_dev_ptr->DmaBusy) { /* Dma tranfer not yet started */
+	/* start Dma as soon as there is a complete fragment to play */
+	if(!sub_dev_ptr->DmaBusy && sub_dev_ptr->DmaLength > 0) {
 		get_started(sub_dev_ptr);    
 		sub_dev_ptr->DmaMode = WRITE_DMA; /* Dma mode is writing */
 	}
 
-	/* We may already have replied by now. In any case don't reply here. */
-	return EDONTREPLY;
+	return r;
 }
 
 
 static ssize_t msg_read(devminor_t minor, u64_t UNUSED(position),
-	endpoint_t endpt, cp_grant_id_t grant, size_t size, int UNUSED(flags),
+	endpoint_t endpt, cp_grant_id_t grant, size_t size, int flags,
 	cdev_id_t id)
 {
 	int chan; sub_dev_t *sub_dev_ptr;
 	special_file_t* special_file_ptr;
+	audio_req_t req;
+
+	/* the writers that are mixed can only write */
+	if (IS_MIX_MINOR(minor)) return EIO;
 
 	special_file_ptr = get_special_file(minor);
 	chan = special_file_ptr->read_chan;
@@ -460,31 +1186,49 @@ static ssize_t msg_read(devminor_t minor, u64_t UNUSED(position),
 	/* get pointer to sub device data */
 	sub_dev_ptr = &sub_dev[chan];
 
+	/* the client owns the ring while it is mapped */
+	if (sub_dev_ext[chan].MmapAddr != NULL) return EBUSY;
+
 	if (!sub_dev_ptr->DmaBusy) { /* get fragment size on first read */
 		if (drv_get_frag_size(&(sub_dev_ptr->FragSize), sub_dev_ptr->Nr) != OK){
 			printf("%s: Could not retrieve fragment size!\n", drv.DriverName);
 			return EIO;
 		}
 	}
-	if(size != sub_dev_ptr->FragSize) {
-		printf("fragment size does not match message size\n");
-		return EINVAL;
-	}
 	/* if we are busy with something else than reading, reply EBUSY */
 	if(sub_dev_ptr->DmaBusy && sub_dev_ptr->DmaMode != READ_DMA) {
 		return EBUSY;
 	}
+	if (size == 0) return 0;
+
+	if (flags & CDEV_NONBLOCK) {
+		/* never overtake reads that are still waiting */
+		if (sub_dev_ext[chan].ReqLength > 0) return EAGAIN;
+
+		/* hand out whatever has been recorded so far; after an overrun 
+		   the extra buf may hold data while the device is stopped */
+		req.SourceProcNr = endpt;
+		req.Grant = grant;
+		req.Size = size;
+		req.Done = 0;
+		req.Id = id;
+		copy_to_req(sub_dev_ptr, &req);
+
+		if(!sub_dev_ptr->DmaBusy) { /* Dma tranfer not (or no longer) on */
+			get_started(sub_dev_ptr);
+			sub_dev_ptr->DmaMode = READ_DMA; /* Dma mode is reading */
+		}
+		return (req.Done > 0) ? (ssize_t) req.Done : EAGAIN;
+	}
 
-	sub_dev_ptr->RevivePending = TRUE;
-	sub_dev_ptr->ReviveId = id;
-	sub_dev_ptr->ReviveGrant = grant;
-	sub_dev_ptr->SourceProcNr = endpt;
+	if (queue_request(sub_dev_ptr, endpt, grant, size, id) != OK) {
+		printf("%s: Too many pending reads\n", drv.DriverName);
+		return EBUSY;
+	}
 
-	if(!sub_dev_ptr->DmaBusy) { /* Dma tranfer not yet started */
+	if(!sub_dev_ptr->DmaBusy) { /* Dma tranfer not (or no longer) on */
 		get_started(sub_dev_ptr);
 		sub_dev_ptr->DmaMode = READ_DMA; /* Dma mode is reading */
-		/* no need to get data from DMA buffer at this point */
-		return EDONTREPLY;
 	}
 	/* check if data is available and possibly fill user's buffer */
 	data_to_user(sub_dev_ptr);
@@ -494,81 +1238,242 @@ static ssize_t msg_read(devminor_t minor, u64_t UNUSED(position),
 }
 
 
-static void msg_hardware(unsigned int UNUSED(mask))
+static int msg_select(devminor_t minor, unsigned int ops, endpoint_t endpt)
 {
-	int i;
+	unsigned int ready_ops;
+	special_file_t* special_file_ptr;
+	mix_client_t *mc;
+
+	if (IS_MIX_MINOR(minor)) {
+		if ((mc = get_mix_client(minor)) == NULL) return EIO;
+		return mix_select(mc, ops, endpt);
+	}
+
+	special_file_ptr = get_special_file(minor);
+	if(special_file_ptr == NULL) {
+		return EIO;
+	}
+
+	/* errors are reported by read and write themselves */
+	ready_ops = 0;
+	if (ops & CDEV_OP_WR) {
+		ready_ops |= select_sub_dev(special_file_ptr->write_chan, CDEV_OP_WR,
+			ops, minor, endpt);
+	}
+	if (ops & CDEV_OP_RD) {
+		ready_ops |= select_sub_dev(special_file_ptr->read_chan, CDEV_OP_RD,
+			ops, minor, endpt);
+	}
+	return ready_ops;
+}
+
+
+/* check if a read or write on a channel would not block; if it would, 
+ * remember to notify the caller when that changes, if it asked for that */
+static int select_sub_dev(int chan, unsigned int op, unsigned int ops,
+	devminor_t minor, endpoint_t endpt)
+{
+	sub_dev_t *sub_dev_ptr;
+	sub_dev_ext_t *ext;
+
+	/* a read or write that fails right away doesn't block either */
+	if (chan == NO_CHANNEL || !sub_dev[chan].Opened) return op;
+
+	sub_dev_ptr = &sub_dev[chan];
+	ext = &sub_dev_ext[chan];
+
+	/* waiting for recorded data starts the recording, as a read does */
+	if (op == CDEV_OP_RD && !sub_dev_ptr->DmaBusy && 
+			sub_dev_ptr->DmaMode == READ_DMA && ext->MmapAddr == NULL && 
+			drv_get_frag_size(&(sub_dev_ptr->FragSize), chan) == OK) {
+		get_started(sub_dev_ptr);
+	}
+
+	if (select_ready(sub_dev_ptr) & op) return op;
+
+	if (ops & CDEV_NOTIFY) {
+		ext->SelectOps |= op;
+		ext->SelectProcNr = endpt;
+		ext->SelectMinor = minor;
+	}
+	return 0;
+}
+
+
+/* the operations that would not block on a sub device right now */
+static unsigned int select_ready(sub_dev_t *sub_dev_ptr)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode == WRITE_DMA) {
+		/* in mmap mode: a free fragment in the ring */
+		if (ext->MmapAddr != NULL) {
+			return (sub_dev_ptr->DmaLength < sub_dev_ptr->NrOfDmaFragments) ?
+				CDEV_OP_WR : 0;
+		}
+		/* queued writes go first */
+		if (ext->ReqLength > 0) return 0;
+
+		/* room in the fragment being filled, or for a new one; 
+		   the same rule as in copy_from_req() */
+		if (ext->FillOffset > 0 ||
+				sub_dev_ptr->DmaLength < sub_dev_ptr->NrOfDmaFragments) {
+			return CDEV_OP_WR;
+		}
+		return 0;
+	}
+	if (sub_dev_ptr->DmaMode == READ_DMA) {
+		if (ext->MmapAddr == NULL && ext->ReqLength > 0) return 0;
+		if (sub_dev_ptr->DmaLength > 0 || sub_dev_ptr->BufLength > 0)
+			return CDEV_OP_RD;
+		return 0;
+	}
+	return 0;
+}
+
+
+/* tell a waiting select that the operations it waits for became ready */
+static void select_notify(sub_dev_t *sub_dev_ptr)
+{
+	unsigned int ready_ops;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+	if (ext->SelectOps == 0) return;
+
+	ready_ops = select_ready(sub_dev_ptr) & ext->SelectOps;
+	if (ready_ops == 0) return;
+
+	chardriver_reply_select(ext->SelectProcNr, ext->SelectMinor, ready_ops);
+	ext->SelectOps &= ~ready_ops;
+}
+
 
-	/* if we have an interrupt */
-	if (drv_int_sum()) {
-		/* loop over all sub devices */
-		for ( i = 0; i < drv.NrOfSubDevices; i++) {
-			/* if interrupt from sub device and Dma transfer
-			   was actually busy, take care of business */
-			if( drv_int(i) && sub_dev[i].DmaBusy ) {
-				if (sub_dev[i].DmaMode == WRITE_DMA)
-					handle_int_write(i);
-				if (sub_dev[i].DmaMode == READ_DMA)
-					handle_int_read(i);
+static void msg_hardware(unsigned int mask)
+{
+	int i, c;
+
+	TRACE(TRACE_IRQ, TRACE_NO_SUB_DEV, mask);
+
+	/* the cards whose hook went off */
+	for (c = 0; c < nr_cards; c++) {
+		if (!(mask & (1 << c))) continue;
+
+		/* if we have an interrupt */
+		if (drv_card_int_sum(c)) {
+			/* loop over the sub devices of the card */
+			for ( i = 0; i < drv.NrOfSubDevices; i++) {
+				if (drv_get_card(i) != c) continue;
+				/* if interrupt from sub device and Dma transfer
+				   was actually busy, take care of business; polled
+				   sub devices are taken care of by msg_alarm */
+				if( drv_int(i) && sub_dev[i].DmaBusy && 
+						sub_dev_ext[i].PollTicks == 0 ) {
+					count_irq(i);
+					if (sub_dev[i].DmaMode == WRITE_DMA)
+						handle_int_write(i);
+					if (sub_dev[i].DmaMode == READ_DMA)
+						handle_int_read(i);
+					/* wake up a select that waits for space or data */
+					select_notify(&sub_dev[i]);
+				}
 			}
 		}
+
+		/* As IRQ_REENABLE is not on in sys_irqsetpolicy, we must
+		 * re-enable out interrupt after every interrupt.
+		 */
+		if ((sys_irqenable(&irq_hook_id[c])) != OK) {
+		  printf("%s: msg_hardware: Couldn't enable IRQ\n", drv.DriverName);
+		}
 	}
+}
+
+
+/* reenable the irq hook of the card a sub device is on */
+static int enable_irq(int sub_dev_nr)
+{
+	return sys_irqenable(&irq_hook_id[drv_get_card(sub_dev_nr)]);
+}
+
+
+/* the poll alarm went off: catch up with the polled sub devices */
+static void msg_alarm(clock_t UNUSED(stamp))
+{
+	int i;
 
-	/* As IRQ_REENABLE is not on in sys_irqsetpolicy, we must
-	 * re-enable out interrupt after every interrupt.
-	 */
-	if ((sys_irqenable(&irq_hook_id)) != OK) {
-	  printf("%s: msg_hardware: Couldn't enable IRQ\n", drv.DriverName);
+	poll_alarm_set = FALSE;
+	for (i = 0; i < drv.NrOfSubDevices; i++) {
+		if (sub_dev_ext[i].PollTicks > 0 && sub_dev[i].DmaBusy)
+			poll_sub_dev(i);
 	}
+	set_poll_alarm();
 }
 
 
 /* handle interrupt for specified sub device; DmaMode == WRITE_DMA */
 static void handle_int_write(int sub_dev_nr) 
 {
+	int drained;
 	sub_dev_t *sub_dev_ptr;
 
 	sub_dev_ptr = &sub_dev[sub_dev_nr];
+	sub_dev_ext[sub_dev_nr].FragsDone += 1;
 
 	sub_dev_ptr->DmaReadNext = 
 		(sub_dev_ptr->DmaReadNext + 1) % sub_dev_ptr->NrOfDmaFragments;
 	sub_dev_ptr->DmaLength -= 1;
-
-	if (sub_dev_ptr->BufLength != 0) { /* Data in extra buf, copy to Dma buf */
-
-		memcpy(sub_dev_ptr->DmaPtr + 
-				sub_dev_ptr->DmaFillNext * sub_dev_ptr->FragSize, 
-				sub_dev_ptr->ExtraBuf + 
-				sub_dev_ptr->BufReadNext * sub_dev_ptr->FragSize, 
-				sub_dev_ptr->FragSize);
-
-		sub_dev_ptr->BufReadNext = 
-			(sub_dev_ptr->BufReadNext + 1) % sub_dev_ptr->NrOfExtraBuffers;
-		sub_dev_ptr->DmaFillNext = 
-			(sub_dev_ptr->DmaFillNext + 1) % sub_dev_ptr->NrOfDmaFragments;
-
-		sub_dev_ptr->BufLength -= 1;
-		sub_dev_ptr->DmaLength += 1;
-	} 
-
-	/* space became available, possibly copy new data from user */
-	data_from_user(sub_dev_ptr);
+	TRACE(TRACE_INT_WRITE, sub_dev_nr, sub_dev_ptr->DmaLength);
+
+	if (sub_dev_ext[sub_dev_nr].Mixing) {
+		/* a fragment became free, mix the writers into it; rather than
+		   run dry, play what they have */
+		mix_fill(sub_dev_ptr);
+		if (sub_dev_ptr->DmaLength <= 1 && mix_ready(sub_dev_ptr, TRUE))
+			mix_fragment(sub_dev_ptr);
+		mix_serve(sub_dev_ptr);
+	} else if (sub_dev_ext[sub_dev_nr].MmapAddr == NULL) {
+		/* in mmap mode the client fills the ring itself */
+		/* a fragment became free, copy queued data from user into it */
+		data_from_user(sub_dev_ptr);
+		/* a drain plays the last, incomplete fragment too, once the 
+		   writes before it are in */
+		if (sub_dev_ext[sub_dev_nr].DrainPending && 
+				sub_dev_ext[sub_dev_nr].ReqLength == 0) {
+			flush_partial_fragment(sub_dev_ptr);
+		}
+	}
 
 	if(sub_dev_ptr->DmaLength == 0) { /* Dma buffer empty, stop Dma transfer */
 
 		sub_dev_ptr->OutOfData = TRUE; /* we're out of data */
+		drained = sub_dev_ext[sub_dev_nr].DrainPending;
+		if (drained) drain_done(sub_dev_ptr, OK);
+		/* so have mixed writers that all drained or closed */
+		if (sub_dev_ext[sub_dev_nr].Mixing && mix_flushed(sub_dev_nr)) 
+			drained = TRUE;
 		if (!sub_dev_ptr->Opened) {
 			close_sub_dev(sub_dev_ptr->Nr);
 			return;
 		}
+		/* a drained stream has ended, it didn't run short */
+		if (!drained) sub_dev_ext[sub_dev_nr].Stats.underruns += 1;
+		if (sub_dev_ext[sub_dev_nr].PollTicks > 0) {
+			stop_playback(sub_dev_ptr);
+			return;
+		}
+		sub_dev_ext[sub_dev_nr].Stats.pauses += 1;
 		drv_pause(sub_dev_ptr->Nr);
 		return;
 	}
 
 	/* confirm and reenable interrupt from this sub dev */
-	drv_reenable_int(sub_dev_nr);
+	ack_int(sub_dev_nr);
 #if 0
 	/* reenable irq_hook*/
-	if (sys_irqenable(&irq_hook_id != OK) {
+	if (enable_irq(sub_dev_nr) != OK) {
 		printf("%s Couldn't enable IRQ\n", drv.DriverName);
 	}
 #endif
@@ -581,10 +1486,28 @@ static void handle_int_read(int sub_dev_nr)
 	sub_dev_t *sub_dev_ptr;
 
 	sub_dev_ptr = &sub_dev[sub_dev_nr];
+	sub_dev_ext[sub_dev_nr].FragsDone += 1;
 
 	sub_dev_ptr->DmaLength += 1; 
 	sub_dev_ptr->DmaFillNext = 
 		(sub_dev_ptr->DmaFillNext + 1) % sub_dev_ptr->NrOfDmaFragments;
+	TRACE(TRACE_INT_READ, sub_dev_nr, sub_dev_ptr->DmaLength);
+
+	if (sub_dev_ext[sub_dev_nr].MmapAddr != NULL) {
+		/* the client reads the ring itself; if it lags behind a full 
+		   ring the hardware overwrites its oldest fragment */
+		if (sub_dev_ptr->DmaLength > sub_dev_ptr->NrOfDmaFragments - 1) {
+			sub_dev_ptr->DmaLength -= 1;
+			sub_dev_ptr->DmaReadNext = (sub_dev_ptr->DmaReadNext + 1) %
+				sub_dev_ptr->NrOfDmaFragments;
+			sub_dev_ext[sub_dev_nr].MmapLost += 1;
+			sub_dev_ext[sub_dev_nr].Lost.frags += 1;
+			sub_dev_ext[sub_dev_nr].Lost.bytes += sub_dev_ptr->FragSize;
+			sub_dev_ext[sub_dev_nr].Stats.overruns += 1;
+		}
+		ack_int(sub_dev_ptr->Nr);
+		return;
+	}
 
 	/* possibly copy data to user (if it is waiting for us) */
 	data_to_user(sub_dev_ptr);
@@ -592,169 +1515,2032 @@ static void handle_int_read(int sub_dev_nr)
 	if (sub_dev_ptr->DmaLength == sub_dev_ptr->NrOfDmaFragments) { 
 		/* if dma buffer full */
 
-		if (sub_dev_ptr->BufLength == sub_dev_ptr->NrOfExtraBuffers) {
+		if (sub_dev_ptr->BufLength == sub_dev_ptr->NrOfExtraBuffers &&
+				!make_room(sub_dev_ptr)) {
 			printf("All buffers full, we have a problem.\n");
+			sub_dev_ext[sub_dev_nr].Stats.overruns += 1;
 			drv_stop(sub_dev_nr);        /* stop the sub device */
 			sub_dev_ptr->DmaBusy = FALSE;
+			/* the next read starts the device at the head of an empty 
+			   ring; what is left in it would be read out of order */
+			sub_dev_ptr->DmaLength = 0;
+			sub_dev_ptr->DmaReadNext = 0;
+			sub_dev_ptr->DmaFillNext = 0;
+			if (sub_dev_ptr->BufLength == 0) 
+				sub_dev_ext[sub_dev_nr].ReadOffset = 0;
 			/* no data for user, this is a sad story */
-			chardriver_reply_task(sub_dev_ptr->SourceProcNr,
-				sub_dev_ptr->ReviveId, 0);
+			flush_requests(sub_dev_ptr, 0);
 			return;
 		} 
-		else { /* dma full, still room in extra buf; 
-				  copy from dma to extra buf */
-			memcpy(sub_dev_ptr->ExtraBuf + 
-					sub_dev_ptr->BufFillNext * sub_dev_ptr->FragSize, 
-					sub_dev_ptr->DmaPtr + 
-					sub_dev_ptr->DmaReadNext * sub_dev_ptr->FragSize,
-					sub_dev_ptr->FragSize);
-			sub_dev_ptr->DmaLength -= 1;
-			sub_dev_ptr->DmaReadNext = 
-				(sub_dev_ptr->DmaReadNext + 1) % sub_dev_ptr->NrOfDmaFragments;
-			sub_dev_ptr->BufLength += 1;
-			sub_dev_ptr->BufFillNext = 
-				(sub_dev_ptr->BufFillNext + 1) % sub_dev_ptr->NrOfExtraBuffers;
+		if (sub_dev_ptr->DmaLength == sub_dev_ptr->NrOfDmaFragments) {
+			/* dma full, still room in extra buf */
+			stash_fragment(sub_dev_ptr);
 		}
 	}
 	/* confirm interrupt, and reenable interrupt from this sub dev*/
-	drv_reenable_int(sub_dev_ptr->Nr);
+	ack_int(sub_dev_ptr->Nr);
 
 #if 0
 	/* reenable irq_hook*/
-	if (sys_irqenable(&irq_hook_id) != OK) {
+	if (enable_irq(sub_dev_ptr->Nr) != OK) {
 		printf("%s: Couldn't reenable IRQ", drv.DriverName);
 	}
 #endif
 }
 
 
-static int get_started(sub_dev_t *sub_dev_ptr) {
-	u32_t i;
+/* move the oldest recorded fragment out of a full dma ring into the extra
+ * buf, before the hardware records over it. Queued reads have just been
+ * served straight from the ring, so this only happens while no read is 
+ * waiting. */
+static void stash_fragment(sub_dev_t *sub_dev_ptr)
+{
+	u32_t offset;
+	sub_dev_ext_t *ext;
 
-	/* enable interrupt messages from MINIX */
-	if ((i=sys_irqenable(&irq_hook_id)) != OK) {
-		printf("%s: Couldn't enable IRQs: error code %u",drv.DriverName, (unsigned int) i);
-		return EIO;
-	}
-	/* let the lower part of the driver start the device */
-	if (drv_start(sub_dev_ptr->Nr, sub_dev_ptr->DmaMode) != OK) {
-		printf("%s: Could not start device %d\n", 
-				drv.DriverName, sub_dev_ptr->Nr);
-	}
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
 
-	sub_dev_ptr->DmaBusy = TRUE;     /* Dma is busy from now on */
-	sub_dev_ptr->DmaReadNext = 0;    
-	return OK;
+	/* A partly read fragment can only be at the head of an empty extra 
+	   buf and keeps its read offset there; what was read is not copied */
+	offset = (sub_dev_ptr->BufLength == 0) ? ext->ReadOffset : 0;
+	memcpy(sub_dev_ptr->ExtraBuf + 
+			sub_dev_ptr->BufFillNext * sub_dev_ptr->FragSize + offset, 
+			sub_dev_ptr->DmaPtr + 
+			sub_dev_ptr->DmaReadNext * sub_dev_ptr->FragSize + offset,
+			sub_dev_ptr->FragSize - offset);
+	ext->Stats.frags_buffered += 1;
+
+	sub_dev_ptr->DmaLength -= 1;
+	sub_dev_ptr->DmaReadNext = 
+		(sub_dev_ptr->DmaReadNext + 1) % sub_dev_ptr->NrOfDmaFragments;
+	sub_dev_ptr->BufLength += 1;
+	sub_dev_ptr->BufFillNext = 
+		(sub_dev_ptr->BufFillNext + 1) % sub_dev_ptr->NrOfExtraBuffers;
 }
 
 
-static void data_from_user(sub_dev_t *subdev)
+/* all buffers of a recording sub device are full: make room for the 
+ * next fragment as the overrun policy says. FALSE if recording must stop. */
+static int make_room(sub_dev_t *sub_dev_ptr)
 {
-	int r;
-
-	if (subdev->DmaLength == subdev->NrOfDmaFragments &&
-			subdev->BufLength == subdev->NrOfExtraBuffers) return;/* no space */
+	switch(sub_dev_ext[sub_dev_ptr->Nr].OverrunPolicy) {
+		case DSP_OVERRUN_SPILL:
+			if (spill(sub_dev_ptr) == OK) return TRUE;
+			/* can't grow any further, drop data after all */
+			/* fall through */
+		case DSP_OVERRUN_OVERWRITE:
+			drop_oldest(sub_dev_ptr);
+			sub_dev_ext[sub_dev_ptr->Nr].Stats.overruns += 1;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
 
-	if (!subdev->RevivePending) return; /* no new data waiting to be copied */
 
-	if (subdev->DmaLength < subdev->NrOfDmaFragments) { /* room in dma buf */
+/* grow the extra buffers of a recording sub device to twice their size, 
+ * with the recorded data moved to the start */
+static int spill(sub_dev_t *sub_dev_ptr)
+{
+	int i, nr;
+	char *buf;
+	sub_dev_ext_t *ext;
 
-		r = sys_safecopyfrom(subdev->SourceProcNr,
-				(vir_bytes)subdev->ReviveGrant, 0, 
-				(vir_bytes)subdev->DmaPtr + 
-				subdev->DmaFillNext * subdev->FragSize,
-				(phys_bytes)subdev->FragSize);
-		if (r != OK)
-			printf("%s:%d: safecopy failed\n", __FILE__, __LINE__);
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
 
+	if (sub_dev_ptr->NrOfExtraBuffers >= DSP_SPILL_MAX) return ENOMEM;
+	nr = MIN(MAX(2 * sub_dev_ptr->NrOfExtraBuffers, 2), DSP_SPILL_MAX);
+	if ((buf = malloc(nr * sub_dev_ptr->FragSize)) == NULL) return ENOMEM;
 
-		subdev->DmaLength += 1;
-		subdev->DmaFillNext = 
-			(subdev->DmaFillNext + 1) % subdev->NrOfDmaFragments;
+	for (i = 0; i < sub_dev_ptr->BufLength; i++) {
+		memcpy(buf + i * sub_dev_ptr->FragSize, sub_dev_ptr->ExtraBuf + 
+				((sub_dev_ptr->BufReadNext + i) % 
+				 sub_dev_ptr->NrOfExtraBuffers) * sub_dev_ptr->FragSize,
+				sub_dev_ptr->FragSize);
+	}
+	free(ext->SpillBuf);
+	ext->SpillBuf = buf;
+	sub_dev_ptr->ExtraBuf = buf;
+	sub_dev_ptr->NrOfExtraBuffers = nr;
+	sub_dev_ptr->BufReadNext = 0;
+	sub_dev_ptr->BufFillNext = sub_dev_ptr->BufLength;
+	return OK;
+}
+
+
+/* drop the oldest recorded fragment to make room for a new one */
+static void drop_oldest(sub_dev_t *sub_dev_ptr)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	/* whatever of it the client has not read yet is lost */
+	ext->Lost.frags += 1;
+	ext->Lost.bytes += sub_dev_ptr->FragSize - ext->ReadOffset;
+	ext->ReadOffset = 0;
+
+	if (sub_dev_ptr->BufLength > 0) {
+		sub_dev_ptr->BufReadNext = (sub_dev_ptr->BufReadNext + 1) % 
+			sub_dev_ptr->NrOfExtraBuffers;
+		sub_dev_ptr->BufLength -= 1;
+	} else { /* no extra buffers at all */
+		sub_dev_ptr->DmaReadNext = (sub_dev_ptr->DmaReadNext + 1) % 
+			sub_dev_ptr->NrOfDmaFragments;
+		sub_dev_ptr->DmaLength -= 1;
+	}
+}
+
+
+/* give a sub device back the extra buffers its driver set up */
+static void free_spill(sub_dev_t *sub_dev_ptr)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+	if (ext->SpillBuf == NULL) return;
+
+	free(ext->SpillBuf);
+	ext->SpillBuf = NULL;
+	sub_dev_ptr->ExtraBuf = ext->PoolBuf;
+	sub_dev_ptr->NrOfExtraBuffers = ext->DefExtraBuffers;
+	sub_dev_ptr->BufReadNext = 0;
+	sub_dev_ptr->BufFillNext = 0;
+	sub_dev_ptr->BufLength = 0;
+}
+
+
+/* choose what capture does when the client can't keep up */
+static int set_overrun(sub_dev_t *sub_dev_ptr, u32_t policy)
+{
+	if (sub_dev_ptr->DmaMode != READ_DMA) return EINVAL;
+	if (policy != DSP_OVERRUN_STOP && policy != DSP_OVERRUN_OVERWRITE &&
+			policy != DSP_OVERRUN_SPILL) {
+		return EINVAL;
+	}
+	sub_dev_ext[sub_dev_ptr->Nr].OverrunPolicy = policy;
+	return OK;
+}
+
+
+static int get_started(sub_dev_t *sub_dev_ptr) {
+	u32_t i;
+	sub_dev_t *link_ptr;
+
+	link_ptr = NULL;
+	if (sub_dev_ext[sub_dev_ptr->Nr].LinkedTo != NO_CHANNEL) {
+		link_ptr = &sub_dev[sub_dev_ext[sub_dev_ptr->Nr].LinkedTo];
+		/* once one of them runs, the other starts on its own */
+		if (link_ptr->DmaBusy) link_ptr = NULL;
+	}
+	/* a linked capture waits for its playback to start it */
+	if (link_ptr != NULL && sub_dev_ptr->DmaMode == READ_DMA) return OK;
+
+	/* enable interrupt messages from MINIX */
+	if ((i=enable_irq(sub_dev_ptr->Nr)) != OK) {
+		printf("%s: Couldn't enable IRQs: error code %u",drv.DriverName, (unsigned int) i);
+		return EIO;
+	}
+	/* make the hardware ring exactly as long as the fragments in it */
+	drv_set_dma(sub_dev_ptr->DmaPhys, 
+			sub_dev_ptr->NrOfDmaFragments * sub_dev_ptr->FragSize, 
+			sub_dev_ptr->Nr);
+
+	if (link_ptr != NULL) {
+		start_linked(sub_dev_ptr, link_ptr);
+		return OK;
+	}
+
+	/* let the lower part of the driver start the device */
+	if (drv_start(sub_dev_ptr->Nr, sub_dev_ptr->DmaMode) != OK) {
+		printf("%s: Could not start device %d\n", 
+				drv.DriverName, sub_dev_ptr->Nr);
+	}
+	dma_started(sub_dev_ptr);
+	return OK;
+}
+
+
+/* start a playback and the capture linked to it in one go, so that the 
+ * two streams keep a fixed offset from their first sample on */
+static void start_linked(sub_dev_t *play_ptr, sub_dev_t *rec_ptr)
+{
+	int r;
+
+	/* the capture may not have been read from yet */
+	if (drv_get_frag_size(&(rec_ptr->FragSize), rec_ptr->Nr) != OK) {
+		printf("%s: Could not retrieve fragment size!\n", drv.DriverName);
+	}
+	drv_set_dma(rec_ptr->DmaPhys, 
+			rec_ptr->NrOfDmaFragments * rec_ptr->FragSize, rec_ptr->Nr);
+
+	r = drv_start_linked(play_ptr->Nr, rec_ptr->Nr);
+	if (r == ENOSYS) {
+		/* the hardware can't, get them as close as we can */
+		r = drv_start(play_ptr->Nr, WRITE_DMA);
+		if (drv_start(rec_ptr->Nr, READ_DMA) != OK) r = EIO;
+	}
+	if (r != OK) {
+		printf("%s: Could not start devices %d and %d\n", 
+				drv.DriverName, play_ptr->Nr, rec_ptr->Nr);
+	}
+	dma_started(play_ptr);
+	dma_started(rec_ptr);
+}
+
+
+/* set up the framework's side of a sub device the driver just started */
+static void dma_started(sub_dev_t *sub_dev_ptr)
+{
+	sub_dev_ptr->DmaBusy = TRUE;     /* Dma is busy from now on */
+	sub_dev_ext[sub_dev_ptr->Nr].LastIrq = 0;
+	sub_dev_ext[sub_dev_ptr->Nr].FragsDone = 0;	/* a new stream starts */
+	sub_dev_ext[sub_dev_ptr->Nr].LastPos = 0;
+	sub_dev_ptr->DmaReadNext = 0;    
+
+	if (sub_dev_ext[sub_dev_ptr->Nr].PollTicks > 0) {
+		/* the timer takes over from the interrupt drv_start enabled */
+		drv_disable_int(sub_dev_ptr->Nr);
+		sub_dev_ext[sub_dev_ptr->Nr].PollFrag = 0;
+		set_poll_alarm();
+	}
+}
+
+
+static void data_from_user(sub_dev_t *subdev)
+{
+	audio_req_t *req;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[subdev->Nr];
+
+	/* serve the queued writes in order, as long as there is space */
+	while (ext->ReqLength > 0) {
+		req = &ext->ReqQueue[ext->ReqReadNext];
+
+		copy_from_req(subdev, req);
+		if (req->Done < req->Size) break; /* no space for the rest */
+
+		TRACE(TRACE_REPLY, subdev->Nr, req->Size);
+		chardriver_reply_task(req->SourceProcNr, req->Id, req->Size);
+
+		dequeue_request(subdev);
+	}
+
+	resume_playback(subdev);
+}
+
+
+/* copy as much of a write request into the dma ring as fits; the rest 
+ * stays in the client's buffer until the hardware frees more fragments */
+static void copy_from_req(sub_dev_t *subdev, audio_req_t *req)
+{
+	int r, nr;
+	size_t chunk, start;
+	char *dst;
+	struct vscp_vec vec[NR_COPY_VEC];
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[subdev->Nr];
+
+	if (CONV_ON(&ext->Conv)) {
+		conv_copy_from_req(subdev, req);
+		return;
+	}
+
+	do {
+		/* collect the pieces of the rings this request goes into */
+		nr = 0;
+		start = req->Done;
+		while (req->Done < req->Size && nr < NR_COPY_VEC) {
+			/* a new fragment needs a free slot in the ring */
+			if (ext->FillOffset == 0 && 
+					subdev->DmaLength == subdev->NrOfDmaFragments) {
+				break;
+			}
+
+			dst = subdev->DmaPtr + subdev->DmaFillNext * subdev->FragSize;
+			chunk = MIN(subdev->FragSize - ext->FillOffset, 
+					req->Size - req->Done);
+
+			add_copy_vec(vec, &nr, req->SourceProcNr, SELF, req->Grant,
+				(vir_bytes)req->Done, (vir_bytes)dst + ext->FillOffset, 
+				chunk);
+
+			req->Done += chunk;
+			ext->FillOffset += chunk;
+
+			if (ext->FillOffset == subdev->FragSize) commit_fragment(subdev);
+		}
+		if (nr == 0) break;
+
+		/* ...and copy them all with a single kernel call */
+		TRACE(TRACE_COPY_START, subdev->Nr, req->Done - start);
+		r = sys_vsafecopy(vec, nr);
+		TRACE(TRACE_COPY_END, subdev->Nr, r);
+		if (r != OK)
+			printf("%s:%d: safecopy failed\n", __FILE__, __LINE__);
+
+	} while (req->Done < req->Size && nr == NR_COPY_VEC);
+}
+
+
+/* copy_from_req() for a stream that is converted: the samples go 
+ * through conv_buf, a fragment at a time */
+static void conv_copy_from_req(sub_dev_t *subdev, audio_req_t *req)
+{
+	size_t bytes;
+	char *dst;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[subdev->Nr];
+
+	while (req->Done < req->Size) {
+		/* a new fragment needs a free slot in the ring */
+		if (ext->FillOffset == 0 && 
+				subdev->DmaLength == subdev->NrOfDmaFragments) {
+			break;
+		}
+
+		dst = subdev->DmaPtr + subdev->DmaFillNext * subdev->FragSize +
+			ext->FillOffset;
+		TRACE(TRACE_COPY_START, subdev->Nr, req->Size - req->Done);
+		bytes = conv_from_req(&ext->Conv, req, dst, 
+			subdev->FragSize - ext->FillOffset);
+		TRACE(TRACE_COPY_END, subdev->Nr, bytes);
+
+		ext->FillOffset += bytes;
+		if (ext->FillOffset == subdev->FragSize) commit_fragment(subdev);
+		else if (bytes == 0) break;
+	}
+}
+
+
+/* convert as many whole frames of a write request as room bytes at dst
+ * take; the start of a frame the request ends with is kept for the next
+ * one. Returns the bytes put at dst. */
+static size_t conv_from_req(conv_stream_t *cs, audio_req_t *req, char *dst,
+	size_t room)
+{
+	size_t frames, bytes, out;
+	audio_conv_t *cv;
+
+	if (cs->Resample) return rate_from_req(cs, req, dst, room);
+
+	cv = &cs->Cv;
+	out = 0;
+
+	/* first the frame the previous write ended in */
+	if (cs->PartLen > 0) {
+		if (room < cv->out_frame) return 0;
+		bytes = MIN(cv->in_frame - cs->PartLen, req->Size - req->Done);
+		if (sys_safecopyfrom(req->SourceProcNr, req->Grant, req->Done,
+				(vir_bytes)cs->Part + cs->PartLen, bytes) != OK) {
+			printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+		}
+		req->Done += bytes;
+		cs->PartLen += bytes;
+		if (cs->PartLen < cv->in_frame) return 0;
+
+		conv_put(cs, dst, cs->Part, 1);
+		cs->PartLen = 0;
+		out = cv->out_frame;
+	}
+
+	for (;;) {
+		frames = MIN((room - out) / cv->out_frame, 
+			(req->Size - req->Done) / cv->in_frame);
+		frames = MIN(frames, CONV_BUF_FRAMES);
+		if (frames == 0) break;
+
+		bytes = frames * cv->in_frame;
+		if (sys_safecopyfrom(req->SourceProcNr, req->Grant, req->Done,
+				(vir_bytes)conv_buf, bytes) != OK) {
+			printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+		}
+		conv_put(cs, dst + out, conv_buf, frames);
+		req->Done += bytes;
+		out += frames * cv->out_frame;
+	}
+
+	conv_keep_part(cs, req);
+	return out;
+}
+
+
+/* conv_from_req() for a stream that is resampled: output the filter has
+ * ready goes to dst, until it needs more of the request */
+static size_t rate_from_req(conv_stream_t *cs, audio_req_t *req, char *dst,
+	size_t room)
+{
+	size_t frames, bytes, out;
+	audio_conv_t *cv;
+
+	cv = &cs->Cv;
+	out = 0;
+
+	for (;;) {
+		frames = MIN((room - out) / cv->out_frame, CONV_BUF_FRAMES);
+		frames = rate_pull(&cs->Rs, conv_tmp, frames);
+		if (frames > 0) {
+			if (cs->Gained) 
+				gain_apply(&cs->Gain, conv_tmp, frames, cv->out_channels);
+			conv_out(cv, dst + out, conv_tmp, frames);
+			out += frames * cv->out_frame;
+			continue;
+		}
+		if (room - out < cv->out_frame) break;
+
+		/* the filter waits for input, first the frame the previous 
+		   write ended in; while it waits, it has room for a frame */
+		if (cs->PartLen > 0) {
+			bytes = MIN(cv->in_frame - cs->PartLen, req->Size - req->Done);
+			if (sys_safecopyfrom(req->SourceProcNr, req->Grant, req->Done,
+					(vir_bytes)cs->Part + cs->PartLen, bytes) != OK) {
+				printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+			}
+			req->Done += bytes;
+			cs->PartLen += bytes;
+			if (cs->PartLen < cv->in_frame) break;
+
+			conv_in(cv, conv_tmp, cs->Part, 1);
+			rate_push(&cs->Rs, conv_tmp, 1);
+			cs->PartLen = 0;
+			continue;
+		}
+
+		frames = MIN((req->Size - req->Done) / cv->in_frame, 
+			rate_room(&cs->Rs));
+		frames = MIN(frames, CONV_BUF_FRAMES);
+		/* no more than dst takes: a write that is done is in the ring,
+		   but for the frames the filter looks ahead */
+		frames = MIN(frames, (u64_t) (room - out) / cv->out_frame * 
+			cs->Rs.num / cs->Rs.den + cs->Rs.taps);
+		if (frames == 0) break;
+
+		bytes = frames * cv->in_frame;
+		if (sys_safecopyfrom(req->SourceProcNr, req->Grant, req->Done,
+				(vir_bytes)conv_buf, bytes) != OK) {
+			printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+		}
+		conv_in(cv, conv_tmp, conv_buf, frames);
+		rate_push(&cs->Rs, conv_tmp, frames);
+		req->Done += bytes;
+	}
+
+	conv_keep_part(cs, req);
+	return out;
+}
+
+
+/* convert frames to the format of the sub device, through the gain if
+ * it does something */
+static void conv_put(conv_stream_t *cs, char *dst, const void *src,
+	size_t frames)
+{
+	if (!cs->Gained || gain_unity(&cs->Gain, cs->Cv.out_channels)) {
+		conv_frames(&cs->Cv, dst, src, frames);
+		return;
+	}
+	conv_in(&cs->Cv, conv_tmp, src, frames);
+	gain_apply(&cs->Gain, conv_tmp, frames, cs->Cv.out_channels);
+	conv_out(&cs->Cv, dst, conv_tmp, frames);
+}
+
+
+/* keep the start of a frame a request ends with, for the next one */
+static void conv_keep_part(conv_stream_t *cs, audio_req_t *req)
+{
+	size_t bytes;
+
+	bytes = req->Size - req->Done;
+	if (bytes > 0 && bytes < cs->Cv.in_frame) {
+		if (sys_safecopyfrom(req->SourceProcNr, req->Grant, req->Done,
+				(vir_bytes)cs->Part, bytes) != OK) {
+			printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+		}
+		req->Done += bytes;
+		cs->PartLen = bytes;
+	}
+}
+
+
+/* set up the conversion of a stream to the format of its sub device, 
+ * before the stream starts; a frame must not straddle two fragments. 
+ * The resampler is only set up again if its rates or filter changed, 
+ * what it holds is the start of the stream. */
+static int conv_setup(conv_stream_t *cs, int sub_dev_nr, u32_t frag_size)
+{
+	int r;
+	u32_t format, channels;
+	struct dsp_params params;
+
+	if (!CONV_ON(cs)) return OK;
+
+	if (drv_get_params(&params, sub_dev_nr) != OK) {
+		printf("%s: Could not retrieve the format!\n", drv.DriverName);
+		return EIO;
+	}
+	format = cs->Format.format;
+	channels = cs->Format.channels;
+	if (format == DSP_FMT_NATIVE) {
+		/* only resampled, the samples are as the device plays them */
+		if (params.bits == 8) 
+			format = params.sign ? DSP_FMT_S8 : DSP_FMT_U8;
+		else
+			format = params.sign ? DSP_FMT_S16_LE : DSP_FMT_U16_LE;
+		channels = params.stereo ? 2 : 1;
+	}
+	r = conv_init(&cs->Cv, format, channels, params.bits, params.sign, 
+		params.stereo ? 2 : 1);
+	if (r != OK) return r;
+	if (frag_size % cs->Cv.out_frame != 0) return EINVAL;
+
+	if (cs->Rate == 0 || cs->Rate == params.rate) {
+		if (cs->Resample) rate_free(&cs->Rs);
+		cs->Resample = FALSE;
+		return OK;
+	}
+	if (cs->Resample && cs->Rs.in_rate == cs->Rate && 
+			cs->Rs.out_rate == params.rate && 
+			cs->Rs.channels == cs->Cv.out_channels &&
+			cs->Rs.quality == cs->Quality) {
+		return OK;
+	}
+	if (cs->Resample) rate_free(&cs->Rs);
+	cs->Resample = FALSE;
+	r = rate_init(&cs->Rs, cs->Rate, params.rate, cs->Cv.out_channels, 
+		cs->Quality);
+	if (r != OK) return r;
+	cs->Resample = TRUE;
+	return OK;
+}
+
+
+/* take the format a client writes in, if it can be converted to the 
+ * format the sub device is set to now */
+static int conv_set_format(conv_stream_t *cs, struct dsp_format *format,
+	int sub_dev_nr)
+{
+	int r;
+	conv_stream_t new_cs;
+
+	if (format->format != DSP_FMT_NATIVE && 
+			conv_frame_size(format->format, format->channels) == 0) {
+		return EINVAL;
+	}
+	/* the resampler is set up with the stream */
+	new_cs.Format = *format;
+	new_cs.Rate = 0;
+	new_cs.Resample = FALSE;
+	new_cs.Gained = cs->Gained;
+	if ((r = conv_setup(&new_cs, sub_dev_nr, 0)) != OK) return r;
+
+	cs->Format = new_cs.Format;
+	cs->Cv = new_cs.Cv;
+	cs->PartLen = 0;
+	return OK;
+}
+
+
+/* a stream as after the open: native, at the device's rate and gain */
+static void conv_reset(conv_stream_t *cs)
+{
+	cs->Format.format = DSP_FMT_NATIVE;
+	cs->PartLen = 0;
+	cs->Rate = 0;
+	cs->Quality = DSP_QUALITY_GOOD;
+	if (cs->Resample) rate_free(&cs->Rs);
+	cs->Resample = FALSE;
+	cs->Gained = FALSE;
+	cs->GainSet.left = cs->GainSet.right = DSP_GAIN_UNITY;
+	cs->GainSet.ramp = 0;
+	cs->Muted = FALSE;
+	gain_init(&cs->Gain);
+}
+
+
+/* set the gain of a stream, or mute it, see DSPIOGAIN; from now on it 
+ * goes through the conversion. The ramp is counted in frames of the 
+ * sub device, the gain works after the resampler. */
+static int conv_set_gain(conv_stream_t *cs, struct dsp_gain *gain, 
+	u32_t mute, int sub_dev_nr)
+{
+	int r;
+	u32_t ramp;
+	i32_t left, right;
+	struct dsp_params params;
+
+	if (gain->left > DSP_GAIN_MAX || gain->right > DSP_GAIN_MAX || 
+			gain->ramp > DSP_GAIN_MAX_RAMP) {
+		return EINVAL;
+	}
+	if (drv_get_params(&params, sub_dev_nr) != OK) {
+		printf("%s: Could not retrieve the format!\n", drv.DriverName);
+		return EIO;
+	}
+	if (!cs->Gained) {
+		cs->Gained = TRUE;
+		if ((r = conv_setup(cs, sub_dev_nr, 0)) != OK) {
+			cs->Gained = FALSE;
+			return r;
+		}
+	}
+
+	cs->GainSet = *gain;
+	cs->Muted = mute;
+	ramp = (u64_t) (gain->ramp ? gain->ramp : DSP_GAIN_RAMP) * 
+		params.rate / 1000;
+	left = mute ? 0 : (i32_t) gain->left << (GAIN_SHIFT - 16);
+	right = mute ? 0 : (i32_t) gain->right << (GAIN_SHIFT - 16);
+	gain_set(&cs->Gain, left, right, ramp);
+	return OK;
+}
+
+
+/* set the gain of the writer of a sub device. A stream that goes through
+ * the conversion from now on takes the start of a frame that was copied
+ * into the ring as it was back into Part; the conversion finishes it. */
+static int set_gain(sub_dev_t *sub_dev_ptr, struct dsp_gain *gain, 
+	u32_t mute)
+{
+	int r, was_on;
+	u32_t rem;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode != WRITE_DMA || ext->MmapAddr != NULL) 
+		return EINVAL;
+
+	was_on = CONV_ON(&ext->Conv);
+	if ((r = conv_set_gain(&ext->Conv, gain, mute, sub_dev_ptr->Nr)) != OK)
+		return r;
+
+	rem = ext->FillOffset % ext->Conv.Cv.out_frame;
+	if (!was_on && rem > 0) {
+		ext->FillOffset -= rem;
+		memcpy(ext->Conv.Part, sub_dev_ptr->DmaPtr + 
+			sub_dev_ptr->DmaFillNext * sub_dev_ptr->FragSize + 
+			ext->FillOffset, rem);
+		ext->Conv.PartLen = rem;
+	}
+	return OK;
+}
+
+
+/* set the format the writer of a sub device writes in, see DSPIOFORMAT */
+static int set_format(sub_dev_t *sub_dev_ptr, struct dsp_format *format)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode != WRITE_DMA) return EINVAL;
+
+	/* data already handed over is in the old format */
+	if (sub_dev_ptr->DmaBusy || ext->MmapAddr != NULL || ext->ReqLength > 0 ||
+			ext->FillOffset > 0 || sub_dev_ptr->DmaLength > 0 || 
+			ext->Conv.PartLen > 0) {
+		return EBUSY;
+	}
+	return conv_set_format(&ext->Conv, format, sub_dev_ptr->Nr);
+}
+
+
+/* add a piece of a user copy to a copy vector; it is merged with the 
+ * previous piece if both are contiguous on either side */
+static void add_copy_vec(struct vscp_vec *vec, int *nr, endpoint_t from, 
+	endpoint_t to, cp_grant_id_t grant, vir_bytes offset, vir_bytes addr, 
+	size_t bytes)
+{
+	struct vscp_vec *prev;
+
+	if (*nr > 0) {
+		prev = &vec[*nr - 1];
+		if (prev->v_gid == grant && prev->v_from == from && 
+				prev->v_offset + prev->v_bytes == offset &&
+				prev->v_addr + prev->v_bytes == addr) {
+			prev->v_bytes += bytes;
+			return;
+		}
+	}
+	vec[*nr].v_from = from;
+	vec[*nr].v_to = to;
+	vec[*nr].v_gid = grant;
+	vec[*nr].v_offset = offset;
+	vec[*nr].v_addr = addr;
+	vec[*nr].v_bytes = bytes;
+	*nr += 1;
+}
+
+
+/* a fragment has been filled completely, hand it to the dma ring */
+static void commit_fragment(sub_dev_t *subdev)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[subdev->Nr];
+	ext->FillOffset = 0;
+	ext->Stats.frags_from_user += 1;
+
+	subdev->DmaLength += 1;
+	subdev->DmaFillNext = (subdev->DmaFillNext + 1) % subdev->NrOfDmaFragments;
+}
+
+
+/* pad a partly filled fragment at the end of a stream and play it */
+static void flush_partial_fragment(sub_dev_t *subdev)
+{
+	char *frag;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[subdev->Nr];
+	/* the input the resampler still waits on ends with the stream */
+	if (ext->Conv.Resample) rate_reset(&ext->Conv.Rs);
+	if (ext->FillOffset == 0) return;
+
+	frag = subdev->DmaPtr + subdev->DmaFillNext * subdev->FragSize;
+	/* in PCM, silence means: repeat the last played value */
+	memset(frag + ext->FillOffset, frag[ext->FillOffset - 1],
+		subdev->FragSize - ext->FillOffset);
+	commit_fragment(subdev);
+
+	resume_playback(subdev);
+	if (!subdev->DmaBusy) get_started(subdev);
+}
+
+
+/* restart a sub device that was paused for lack of data */
+static void resume_playback(sub_dev_t *subdev)
+{
+	if (!subdev->OutOfData || subdev->DmaLength == 0) return;
+
+	subdev->OutOfData = FALSE;
+	/* the first fragment of a stream ends the pause the sub device was 
+	   opened in; only count real resumes */
+	if (subdev->DmaBusy) sub_dev_ext[subdev->Nr].Stats.resumes += 1;
+	sub_dev_ext[subdev->Nr].LastIrq = 0;	/* the pause is no irq gap */
+	ack_int(subdev->Nr);
+	/* reenable irq_hook*/
+	if ((enable_irq(subdev->Nr)) != OK) {
+		printf("%s: Couldn't enable IRQ", drv.DriverName);
+	}
+	drv_resume(subdev->Nr);  /* resume resume the sub device */
+	if (sub_dev_ext[subdev->Nr].PollTicks > 0) drv_disable_int(subdev->Nr);
+}
+
+
+/* account for an interrupt of a sub device and the time since the last one */
+static void count_irq(int sub_dev_nr)
+{
+	u64_t now;
+	u32_t gap;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_nr];
+	ext->Stats.interrupts += 1;
+
+	read_tsc_64(&now);
+	if (ext->LastIrq != 0) {
+		gap = tsc_64_to_micros(now - ext->LastIrq);
+		if (gap > ext->Stats.irq_gap_max) ext->Stats.irq_gap_max = gap;
+		ext->IrqGapSum += gap;
+		ext->IrqGaps += 1;
+	}
+	ext->LastIrq = now;
+}
+
+
+/* confirm the interrupt of a sub device and let it interrupt again; a 
+ * polled sub device keeps its interrupt off */
+static void ack_int(int sub_dev_nr)
+{
+	if (sub_dev_ext[sub_dev_nr].PollTicks > 0)
+		drv_disable_int(sub_dev_nr);
+	else
+		drv_reenable_int(sub_dev_nr);
+}
+
+
+/* poll the dma position of a sub device every msec milliseconds instead 
+ * of taking an interrupt for every fragment; 0 goes back to interrupts */
+static int set_poll(sub_dev_t *sub_dev_ptr, u32_t msec)
+{
+	if (sub_dev_ptr->DmaMode == NO_DMA) return EINVAL;
+	if (sub_dev_ptr->DmaBusy) return EBUSY;
+	if (msec > 1000) return EINVAL;
+	/* without polling the hardware must interrupt on every fragment */
+	if (msec == 0 && sub_dev_ptr->NrOfDmaFragments > 
+			drv_get_max_fragments(sub_dev_ptr->Nr)) {
+		return EINVAL;
+	}
+
+	/* the alarm counts in clock ticks, round up */
+	sub_dev_ext[sub_dev_ptr->Nr].PollTicks = 
+		(clock_t) ((msec * sys_hz() + 999) / 1000);
+	return OK;
+}
+
+
+/* handle the fragments a polled sub device finished since the previous 
+ * poll, as if an interrupt had come for each of them. The dma engine 
+ * must not have gone round the ring in the meantime. */
+static void poll_sub_dev(int sub_dev_nr)
+{
+	sub_dev_t *sub_dev_ptr;
+	sub_dev_ext_t *ext;
+	u32_t offset, frag, done;
+
+	sub_dev_ptr = &sub_dev[sub_dev_nr];
+	ext = &sub_dev_ext[sub_dev_nr];
+	ext->Stats.polls += 1;
+
+	if (drv_get_dma_offset(sub_dev_nr, &offset) != OK) return;
+	frag = (offset / sub_dev_ptr->FragSize) % sub_dev_ptr->NrOfDmaFragments;
+	done = (frag + sub_dev_ptr->NrOfDmaFragments - ext->PollFrag) % 
+		sub_dev_ptr->NrOfDmaFragments;
+	TRACE(TRACE_POLL, sub_dev_nr, done);
+	if (done == 0) return;
+	ext->PollFrag = frag;
+
+	/* stop early if a fragment stops the sub device */
+	while (done-- > 0 && sub_dev_ptr->DmaBusy && 
+			!(sub_dev_ptr->DmaMode == WRITE_DMA && sub_dev_ptr->OutOfData)) {
+		if (sub_dev_ptr->DmaMode == WRITE_DMA)
+			handle_int_write(sub_dev_nr);
+		else
+			handle_int_read(sub_dev_nr);
+	}
+	select_notify(sub_dev_ptr);
+}
+
+
+/* (re)arm the alarm for the shortest poll interval of the sub devices
+ * that are running polled, or cancel it if there are none */
+static void set_poll_alarm(void)
+{
+	int i;
+	clock_t ticks;
+
+	ticks = 0;
+	for (i = 0; i < drv.NrOfSubDevices; i++) {
+		if (sub_dev_ext[i].PollTicks == 0 || !sub_dev[i].DmaBusy) continue;
+		if (ticks == 0 || sub_dev_ext[i].PollTicks < ticks)
+			ticks = sub_dev_ext[i].PollTicks;
+	}
+	if (ticks == 0 && !poll_alarm_set) return;
+
+	if (sys_setalarm(ticks, 0) != OK) {
+		printf("%s: Couldn't set alarm\n", drv.DriverName);
+		ticks = 0;
+	}
+	poll_alarm_set = (ticks != 0);
+}
+
+
+/* A polled sub device that ran out of data has played on into fragments
+ * it had no data for before the poll noticed, and it isn't at a fragment
+ * boundary. Stop it instead of pausing it there; the next data starts 
+ * it again at the head of the ring. */
+static void stop_playback(sub_dev_t *subdev)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[subdev->Nr];
+	drv_stop(subdev->Nr);
+	subdev->DmaBusy = FALSE;
+
+	/* the ring is empty but for a fragment being filled */
+	if (ext->FillOffset > 0 && subdev->DmaFillNext != 0) {
+		memmove(subdev->DmaPtr, 
+			subdev->DmaPtr + subdev->DmaFillNext * subdev->FragSize,
+			ext->FillOffset);
+	}
+	subdev->DmaFillNext = 0;
+	subdev->DmaReadNext = 0;
+}
+
+
+/* wait until all that was written has been played, including queued 
+ * writes and the last, incomplete fragment */
+static int drain(sub_dev_t *sub_dev_ptr, endpoint_t endpt, cdev_id_t id,
+	int flags)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode != WRITE_DMA) return EINVAL;
+	if (ext->MmapAddr != NULL || ext->DrainPending) return EBUSY;
+
+	/* the writes still queued come before the incomplete fragment */
+	if (ext->ReqLength == 0) flush_partial_fragment(sub_dev_ptr);
+
+	/* playback has no extra buffers, so BufLength is 0 */
+	if (sub_dev_ptr->DmaLength == 0 && ext->ReqLength == 0 &&
+			ext->FillOffset == 0) {
+		return OK;
+	}
+	if (flags & CDEV_NONBLOCK) return EAGAIN;
+
+	ext->DrainPending = TRUE;
+	ext->DrainProcNr = endpt;
+	ext->DrainId = id;
+	return EDONTREPLY;
+}
+
+
+/* for live update: a DSPIODRAIN, and the writes and drains of mix 
+ * clients, are held back without a RevivePending */
+int fw_reply_pending(int dma_mode)
+{
+	int i;
+
+	if (dma_mode != WRITE_DMA || sub_dev_ext == NULL) return FALSE;
+	for (i = 0; i < drv.NrOfSubDevices; i++) {
+		if (sub_dev_ext[i].DrainPending) return TRUE;
+	}
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		if (mix_client[i].InUse && (mix_client[i].ReqPending || 
+				mix_client[i].DrainPending)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+
+static void drain_done(sub_dev_t *sub_dev_ptr, int status)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+	ext->DrainPending = FALSE;
+	TRACE(TRACE_REPLY, sub_dev_ptr->Nr, status);
+	chardriver_reply_task(ext->DrainProcNr, ext->DrainId, status);
+}
+
+
+/* throw away all that is buffered right now, in either direction, and 
+ * stop the device; the next read or write starts it again */
+static int drop(sub_dev_t *sub_dev_ptr)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (sub_dev_ptr->DmaMode == NO_DMA) return EINVAL;
+	if (ext->MmapAddr != NULL) return EBUSY;
+
+	if (sub_dev_ptr->DmaBusy) {
+		drv_stop(sub_dev_ptr->Nr);
+		sub_dev_ptr->DmaBusy = FALSE;
+	}
+	/* waiting writes return what they got into the ring, reads what 
+	   they got out of it */
+	flush_requests(sub_dev_ptr, EINTR);
+	if (ext->DrainPending) drain_done(sub_dev_ptr, EINTR);
+
+	sub_dev_ptr->DmaLength = 0;
+	sub_dev_ptr->DmaReadNext = 0;
+	sub_dev_ptr->DmaFillNext = 0;
+	sub_dev_ptr->BufLength = 0;
+	sub_dev_ptr->BufReadNext = 0;
+	sub_dev_ptr->BufFillNext = 0;
+	ext->FillOffset = 0;
+	ext->ReadOffset = 0;
+	ext->Conv.PartLen = 0;
+	if (ext->Conv.Resample) rate_reset(&ext->Conv.Rs);
+	/* as after the open: the first fragment written starts playback */
+	if (sub_dev_ptr->DmaMode == WRITE_DMA) sub_dev_ptr->OutOfData = TRUE;
+
+	select_notify(sub_dev_ptr);
+	return OK;
+}
+
+
+/* link the playback and capture channel of a special file, so that the 
+ * first fragment written starts both; on is 0 to unlink them */
+static int set_link(special_file_t *special_file_ptr, u32_t on)
+{
+	int play, rec;
+
+	play = special_file_ptr->write_chan;
+	rec = special_file_ptr->read_chan;
+	if (play == NO_CHANNEL || rec == NO_CHANNEL) return EINVAL;
+	if (sub_dev[play].DmaBusy || sub_dev[rec].DmaBusy) return EBUSY;
+
+	if (!on) {
+		unlink_sub_dev(play);
+		return OK;
+	}
+	sub_dev_ext[play].LinkedTo = rec;
+	sub_dev_ext[rec].LinkedTo = play;
+	return OK;
+}
+
+
+static void unlink_sub_dev(int sub_dev_nr)
+{
+	int link;
+
+	link = sub_dev_ext[sub_dev_nr].LinkedTo;
+	if (link == NO_CHANNEL) return;
+	sub_dev_ext[link].LinkedTo = NO_CHANNEL;
+	sub_dev_ext[sub_dev_nr].LinkedTo = NO_CHANNEL;
+}
+
+
+/* the mix client a minor device handed out by mix_open() stands for */
+static mix_client_t *get_mix_client(devminor_t minor)
+{
+	mix_client_t *mc;
+
+	if (!IS_MIX_MINOR(minor)) return NULL;
+	mc = &mix_client[minor - MIX_MINOR];
+	return (mc->InUse && mc->Opened) ? mc : NULL;
+}
+
+
+/* nr. of mix clients that hold a playback sub device, closed ones whose
+ * data is still being mixed included */
+static int mix_users(int sub_dev_nr)
+{
+	int i, users;
+
+	users = 0;
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		if (mix_client[i].InUse && mix_client[i].SubDev == sub_dev_nr) 
+			users++;
+	}
+	return users;
+}
+
+
+/* open a special file that several writers may share: each open gets a 
+ * minor device of its own, the first one opens the sub device */
+static int mix_open(special_file_t *special_file_ptr)
+{
+	int i, r, chan, slot;
+	mix_client_t *mc;
+
+	chan = special_file_ptr->write_chan;
+	if (chan == NO_CHANNEL || special_file_ptr->read_chan != NO_CHANNEL ||
+			special_file_ptr->io_ctl != chan) {
+		printf("%s: Minor device %d can't be mixed!\n", drv.DriverName,
+				special_file_ptr->minor_dev_nr);
+		return EIO;
+	}
+
+	/* there is a ring for every writer the driver allows */
+	slot = -1;
+	for (i = 0; i < NR_MIX_CLIENTS && slot < 0; i++) {
+		if (!mix_client[i].InUse && mix_client[i].Ring != NULL) slot = i;
+	}
+	if (slot < 0 || mix_users(chan) >= 
+			drv_get_mix_clients(special_file_ptr->minor_dev_nr)) {
+		return EBUSY;
+	}
+	mc = &mix_client[slot];
+
+	if (mix_users(chan) == 0) {
+		if (sub_dev_ext[chan].Mixing && sub_dev[chan].DmaBusy && 
+				!sub_dev[chan].Opened) {
+			/* still playing what the last writer left, carry on */
+			sub_dev[chan].Opened = TRUE;
+		} else {
+			if ((r = open_sub_dev(chan, WRITE_DMA)) != OK) return r;
+			sub_dev_ext[chan].Mixing = TRUE;
+			sub_dev_ext[chan].MixSample = 1;
+			sub_dev_ext[chan].MixFlip = 0;
+			sub_dev_ext[chan].FragsMixed = 0;
+		}
+	}
+
+	mc->InUse = TRUE;
+	mc->Opened = TRUE;
+	mc->SubDev = chan;
+	mc->Minor = special_file_ptr->minor_dev_nr;
+	mc->RingRead = 0;
+	mc->RingLength = 0;
+	mc->Flush = FALSE;
+	mc->LastFrag = 0;
+	mc->ReqPending = FALSE;
+	mc->DrainPending = FALSE;
+	mc->SelectOps = 0;
+	conv_reset(&mc->Conv);
+	return CDEV_CLONED | (MIX_MINOR + slot);
+}
+
+
+/* a mix client is closed; what it wrote is still played */
+static int mix_close(mix_client_t *mc)
+{
+	mc->Opened = FALSE;
+	mc->SelectOps = 0;
+	mc->Flush = TRUE;
+	mix_fill(&sub_dev[mc->SubDev]);
+
+	/* else mix_serve() lets go of it once its ring is mixed */
+	if (mc->RingLength < sub_dev_ext[mc->SubDev].MixSample) 
+		mix_release(mc);
+	return OK;
+}
+
+
+/* free the slot of a closed mix client; the last one closes the sub 
+ * device, which plays out the fragments already mixed */
+static void mix_release(mix_client_t *mc)
+{
+	mc->InUse = FALSE;
+	if (mix_users(mc->SubDev) == 0) close_sub_dev(mc->SubDev);
+}
+
+
+static ssize_t mix_write(mix_client_t *mc, endpoint_t endpt, 
+	cp_grant_id_t grant, size_t size, int flags, cdev_id_t id)
+{
+	int r;
+	sub_dev_t *sub_dev_ptr;
+	audio_req_t req;
+
+	sub_dev_ptr = &sub_dev[mc->SubDev];
+
+	/* a writer has one write in progress at a time */
+	if (mc->ReqPending) return (flags & CDEV_NONBLOCK) ? EAGAIN : EBUSY;
+
+	/* the format may have changed while the sub device was idle */
+	if (!sub_dev_ptr->DmaBusy && sub_dev_ptr->DmaLength == 0) {
+		if (mix_prepare(sub_dev_ptr) != OK) return EIO;
+		if ((r = conv_setup(&mc->Conv, mc->SubDev, 0)) != OK) return r;
+	}
+	if (size == 0) return 0;
+
+	req.SourceProcNr = endpt;
+	req.Grant = grant;
+	req.Size = size;
+	req.Done = 0;
+	req.Id = id;
+
+	mc->Flush = FALSE;
+	mix_copy_in(mc, &req);
+	mix_fill(sub_dev_ptr);
+
+	if (req.Done == req.Size) return req.Size;
+	if (flags & CDEV_NONBLOCK) 
+		return (req.Done > 0) ? (ssize_t) req.Done : EAGAIN;
+
+	/* the rest goes in as the mixer makes room */
+	mc->Req = req;
+	mc->ReqPending = TRUE;
+	return EDONTREPLY;
+}
+
+
+/* ioctl's on a mix client: the end of a stream is its own, and so is 
+ * the format it writes in; the format of the device is shared with the 
+ * other writers and set only while it is alone */
+static int mix_ioctl(mix_client_t *mc, unsigned long request, 
+	endpoint_t endpt, cp_grant_id_t grant, int flags, endpoint_t user_endpt,
+	cdev_id_t id)
+{
+	u32_t free_buf, mute;
+	struct dsp_format format;
+	struct dsp_gain gain;
+	int r;
+
+	switch(request) {
+		case DSPIOFORMAT:
+			if (mc->RingLength > 0 || mc->ReqPending || mc->Conv.PartLen > 0)
+				return EBUSY;
+			if ((r = sys_safecopyfrom(endpt, grant, 0, (vir_bytes)&format, 
+					sizeof(format))) != OK) {
+				printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+				return r;
+			}
+			return conv_set_format(&mc->Conv, &format, mc->SubDev);
+		case DSPIOGAIN:
+			if ((r = sys_safecopyfrom(endpt, grant, 0, (vir_bytes)&gain, 
+					sizeof(gain))) != OK) {
+				printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+				return r;
+			}
+			return mix_set_gain(mc, &gain, mc->Conv.Muted);
+		case DSPIOMUTE:
+			if ((r = sys_safecopyfrom(endpt, grant, 0, (vir_bytes)&mute, 
+					sizeof(mute))) != OK) {
+				printf("%s:%d: safecopyfrom failed\n", __FILE__, __LINE__);
+				return r;
+			}
+			gain = mc->Conv.GainSet;
+			gain.ramp = 0;
+			return mix_set_gain(mc, &gain, mute != 0);
+		case DSPIODRAIN:
+			return mix_drain(mc, endpt, id, flags);
+		case DSPIODROP:
+			mix_drop(mc);
+			return OK;
+		case DSPIOFREEBUF:
+			free_buf = (!mc->ReqPending && mix_room(mc) > 0);
+			if ((r = sys_safecopyto(endpt, grant, 0, (vir_bytes)&free_buf, 
+					sizeof(free_buf))) != OK) {
+				printf("%s:%d: safecopyto failed\n", __FILE__, __LINE__);
+			}
+			return r;
+		case DSPIOMMAP:
+		case DSPIOMMAPSYNC:
+		case DSPIOLINK:
+			return EINVAL;
+		case DSPIORATE:
+		case DSPIOSTEREO:
+		case DSPIOBITS:
+		case DSPIOSIGN:
+		case DSPIOSIZE:
+		case DSPIOPARAMS:
+		case DSPIOPERIODS:
+		case DSPIOPROFILE:
+		case DSPIOPOLL:
+			if (mix_users(mc->SubDev) > 1 || sub_dev[mc->SubDev].DmaBusy)
+				return EBUSY;
+			break;
+	}
+	return msg_ioctl(mc->Minor, request, endpt, grant, flags, user_endpt, 
+		id);
+}
+
+
+static int mix_select(mix_client_t *mc, unsigned int ops, endpoint_t endpt)
+{
+	unsigned int ready_ops;
+
+	/* a read fails right away, it doesn't block */
+	ready_ops = ops & CDEV_OP_RD;
+	if (ops & CDEV_OP_WR) {
+		if (!mc->ReqPending && mix_room(mc) > 0) {
+			ready_ops |= CDEV_OP_WR;
+		} else if (ops & CDEV_NOTIFY) {
+			mc->SelectOps = CDEV_OP_WR;
+			mc->SelectProcNr = endpt;
+		}
+	}
+	return ready_ops;
+}
 
-	} else { /* room in extra buf */ 
 
-		r = sys_safecopyfrom(subdev->SourceProcNr,
-				(vir_bytes)subdev->ReviveGrant, 0,
-				(vir_bytes)subdev->ExtraBuf + 
-				subdev->BufFillNext * subdev->FragSize, 
-				(phys_bytes)subdev->FragSize);
-		if (r != OK)
-			printf("%s:%d: safecopy failed\n", __FILE__, __LINE__);
+static int mix_cancel(mix_client_t *mc, endpoint_t endpt, cdev_id_t id)
+{
+	if (mc->DrainPending && mc->DrainProcNr == endpt && mc->DrainId == id) {
+		mc->DrainPending = FALSE;
+		return EINTR;
+	}
+	if (mc->ReqPending && mc->Req.SourceProcNr == endpt && 
+			mc->Req.Id == id) {
+		mc->ReqPending = FALSE;
+		/* an interrupted write returns what it got so far */
+		return (mc->Req.Done > 0) ? (int) mc->Req.Done : EINTR;
+	}
+	/* not found; the request was already replied to */
+	return EDONTREPLY;
+}
+
+
+/* wait until all a mix client wrote has been played */
+static int mix_drain(mix_client_t *mc, endpoint_t endpt, cdev_id_t id, 
+	int flags)
+{
+	if (mc->DrainPending) return EBUSY;
+
+	/* its last fragment is mixed in even if it is incomplete */
+	mc->Flush = TRUE;
+	mix_fill(&sub_dev[mc->SubDev]);
+
+	if (mix_drained(mc)) return OK;
+	if (flags & CDEV_NONBLOCK) return EAGAIN;
+
+	mc->DrainPending = TRUE;
+	mc->DrainProcNr = endpt;
+	mc->DrainId = id;
+	return EDONTREPLY;
+}
+
+
+/* all of a mix client is mixed, and the fragments it went into have 
+ * been played */
+static int mix_drained(mix_client_t *mc)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[mc->SubDev];
+	return !mc->ReqPending && mc->RingLength < ext->MixSample &&
+		ext->FragsMixed - sub_dev[mc->SubDev].DmaLength >= mc->LastFrag;
+}
+
+
+/* set the gain of a mix client, as set_gain() does for a sub device. The
+ * mixer takes a sample at a time; once it took the start of a frame, the
+ * rest has to be written as it is. */
+static int mix_set_gain(mix_client_t *mc, struct dsp_gain *gain, 
+	u32_t mute)
+{
+	int r, was_on;
+	u32_t fill, rem;
+	struct dsp_params params;
+
+	fill = (mc->RingRead + mc->RingLength) % 
+		sub_dev_ext[mc->SubDev].DmaCapacity;
+	rem = 0;
+	was_on = CONV_ON(&mc->Conv);
+	if (!was_on) {
+		if (drv_get_params(&params, mc->SubDev) != OK) {
+			printf("%s: Could not retrieve the format!\n", drv.DriverName);
+			return EIO;
+		}
+		rem = fill % ((params.stereo ? 2 : 1) * (params.bits / 8));
+		if (rem > mc->RingLength) return EBUSY;
+	}
+	if ((r = conv_set_gain(&mc->Conv, gain, mute, mc->SubDev)) != OK) 
+		return r;
+
+	if (rem > 0) {
+		memcpy(mc->Conv.Part, mc->Ring + fill - rem, rem);
+		mc->Conv.PartLen = rem;
+		mc->RingLength -= rem;
+	}
+	return OK;
+}
+
+
+/* have all the writers of a sub device ended their streams, with a 
+ * drain or a close */
+static int mix_flushed(int sub_dev_nr)
+{
+	int i;
 
-		subdev->BufLength += 1;
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		if (mix_client[i].InUse && mix_client[i].SubDev == sub_dev_nr &&
+				!mix_client[i].Flush) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
 
-		subdev->BufFillNext = 
-			(subdev->BufFillNext + 1) % subdev->NrOfExtraBuffers;
 
+/* throw away what a mix client wrote and did not get mixed yet; the 
+ * fragments already mixed are the other writers' too, they play on */
+static void mix_drop(mix_client_t *mc)
+{
+	mc->RingRead = 0;
+	mc->RingLength = 0;
+	mc->Conv.PartLen = 0;
+	if (mc->ReqPending) {
+		mc->ReqPending = FALSE;
+		chardriver_reply_task(mc->Req.SourceProcNr, mc->Req.Id,
+			mc->Req.Done > 0 ? (int) mc->Req.Done : EINTR);
 	}
-	if(subdev->OutOfData) { /* if device paused (because of lack of data) */
-		subdev->OutOfData = FALSE;
-		drv_reenable_int(subdev->Nr);
-		/* reenable irq_hook*/
-		if ((sys_irqenable(&irq_hook_id)) != OK) {
-			printf("%s: Couldn't enable IRQ", drv.DriverName);
+	if (mc->DrainPending) {
+		mc->DrainPending = FALSE;
+		chardriver_reply_task(mc->DrainProcNr, mc->DrainId, EINTR);
+	}
+}
+
+
+/* bytes a mix client can write; it buffers as much as the dma ring */
+static u32_t mix_room(mix_client_t *mc)
+{
+	u32_t size;
+	sub_dev_t *sub_dev_ptr;
+
+	sub_dev_ptr = &sub_dev[mc->SubDev];
+	size = sub_dev_ptr->NrOfDmaFragments * sub_dev_ptr->FragSize;
+	if (size == 0 || size > (u32_t) sub_dev_ext[mc->SubDev].DmaCapacity) 
+		size = sub_dev_ext[mc->SubDev].DmaCapacity;
+	return (mc->RingLength < size) ? size - mc->RingLength : 0;
+}
+
+
+/* copy as much of a write into the ring of a mix client as fits */
+static void mix_copy_in(mix_client_t *mc, audio_req_t *req)
+{
+	int nr;
+	u32_t cap, fill, bytes, first, room;
+	struct vscp_vec vec[2];
+
+	cap = sub_dev_ext[mc->SubDev].DmaCapacity;
+
+	if (CONV_ON(&mc->Conv)) {
+		/* up to the end of the ring, then from its start */
+		while (req->Done < req->Size && (room = mix_room(mc)) > 0) {
+			fill = (mc->RingRead + mc->RingLength) % cap;
+			bytes = conv_from_req(&mc->Conv, req, mc->Ring + fill, 
+				MIN(room, cap - fill));
+			mc->RingLength += bytes;
+			if (bytes == 0) break;
 		}
-		drv_resume(subdev->Nr);  /* resume resume the sub device */
+		return;
 	}
 
-	chardriver_reply_task(subdev->SourceProcNr, subdev->ReviveId,
-		subdev->FragSize);
+	bytes = MIN(mix_room(mc), req->Size - req->Done);
+	if (bytes == 0) return;
+
+	/* the free part of the ring may wrap around its end */
+	nr = 0;
+	fill = (mc->RingRead + mc->RingLength) % cap;
+	first = MIN(bytes, cap - fill);
+	add_copy_vec(vec, &nr, req->SourceProcNr, SELF, req->Grant,
+		(vir_bytes)req->Done, (vir_bytes)mc->Ring + fill, first);
+	if (bytes > first) {
+		add_copy_vec(vec, &nr, req->SourceProcNr, SELF, req->Grant,
+			(vir_bytes)req->Done + first, (vir_bytes)mc->Ring, 
+			bytes - first);
+	}
+	if (sys_vsafecopy(vec, nr) != OK)
+		printf("%s:%d: safecopy failed\n", __FILE__, __LINE__);
 
-	/* reset variables */
-	subdev->RevivePending = 0;
+	req->Done += bytes;
+	mc->RingLength += bytes;
 }
 
 
-static void data_to_user(sub_dev_t *sub_dev_ptr)
+/* take over fragment size and sample format before a stream starts */
+static int mix_prepare(sub_dev_t *sub_dev_ptr)
+{
+	struct dsp_params params;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (drv_get_frag_size(&(sub_dev_ptr->FragSize), sub_dev_ptr->Nr) != OK ||
+			drv_get_params(&params, sub_dev_ptr->Nr) != OK) {
+		printf("%s: Could not retrieve the format!\n", drv.DriverName);
+		return EIO;
+	}
+	if (params.bits != 8 && params.bits != 16) return EINVAL;
+
+	ext->MixSample = params.bits / 8;
+	ext->MixFlip = 0;
+	if (params.sign) ext->MixFlip = (params.bits == 8) ? MIX_FLIP8 : MIX_FLIP16;
+	return OK;
+}
+
+
+/* is there a free fragment in the dma ring and should the next one be
+ * mixed now: once every writer has a complete fragment, or one that 
+ * ended its stream the rest of it; or, to get the device going, once a 
+ * writer runs out of room. With any, mix whatever the writers have, 
+ * rather than run dry. While the device plays, a writer that is out of 
+ * room waits for the others: they may need more writes for the same 
+ * fragment, e.g. when their samples are converted. */
+static int mix_ready(sub_dev_t *sub_dev_ptr, int any)
+{
+	int i, has, waiting, full;
+	u32_t sample;
+	mix_client_t *mc;
+
+	if (sub_dev_ptr->DmaLength == sub_dev_ptr->NrOfDmaFragments) return FALSE;
+
+	sample = sub_dev_ext[sub_dev_ptr->Nr].MixSample;
+	has = waiting = full = FALSE;
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		mc = &mix_client[i];
+		if (!mc->InUse || mc->SubDev != sub_dev_ptr->Nr) continue;
+		if (mc->RingLength >= sub_dev_ptr->FragSize) {
+			has = TRUE;
+			if (mix_room(mc) == 0 && !sub_dev_ptr->DmaBusy) full = TRUE;
+		} else if (mc->Flush || any) {
+			if (mc->RingLength >= sample) has = TRUE;
+		} else {
+			waiting = TRUE;
+		}
+	}
+	return has && (!waiting || full || any);
+}
+
+
+/* mix all complete fragments the dma ring has room for, and start or 
+ * resume playback if that gave it something to play */
+static void mix_fill(sub_dev_t *sub_dev_ptr)
+{
+	while (mix_ready(sub_dev_ptr, FALSE)) mix_fragment(sub_dev_ptr);
+
+	resume_playback(sub_dev_ptr);
+	if (!sub_dev_ptr->DmaBusy && sub_dev_ptr->DmaLength > 0) 
+		get_started(sub_dev_ptr);
+}
+
+
+/* mix the next fragment of every writer into the dma ring; a writer 
+ * that has less adds silence for the rest */
+static void mix_fragment(sub_dev_t *sub_dev_ptr)
+{
+	static i32_t acc[MIX_BLOCK];
+	int i;
+	u32_t off, block, take[NR_MIX_CLIENTS], cap, pos, n, first;
+	char *frag;
+	mix_client_t *mc;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+	cap = ext->DmaCapacity;
+	frag = sub_dev_ptr->DmaPtr + 
+		sub_dev_ptr->DmaFillNext * sub_dev_ptr->FragSize;
+
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		mc = &mix_client[i];
+		take[i] = 0;
+		if (!mc->InUse || mc->SubDev != sub_dev_ptr->Nr) continue;
+		take[i] = MIN(mc->RingLength, sub_dev_ptr->FragSize);
+		take[i] -= take[i] % ext->MixSample;
+	}
+
+	/* a block at a time, so that the sums stay in the cache */
+	for (off = 0; off < sub_dev_ptr->FragSize; off += block) {
+		block = MIN(MIX_BLOCK * ext->MixSample, sub_dev_ptr->FragSize - off);
+		memset(acc, 0, sizeof(acc));
+
+		for (i = 0; i < NR_MIX_CLIENTS; i++) {
+			if (take[i] <= off) continue;
+			mc = &mix_client[i];
+			n = MIN(block, take[i] - off);
+			pos = (mc->RingRead + off) % cap;
+			first = MIN(n, cap - pos);
+			mix_add(ext, acc, mc->Ring + pos, first);
+			if (n > first) 
+				mix_add(ext, acc + first / ext->MixSample, mc->Ring, n - first);
+		}
+
+		if (ext->MixSample == 1) {
+			mix_out8((u8_t *) (frag + off), acc, block, ext->MixFlip);
+		} else {
+			mix_out16((u16_t *) (frag + off), acc, block / 2, ext->MixFlip);
+		}
+	}
+
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		if (take[i] == 0) continue;
+		mc = &mix_client[i];
+		mc->RingRead = (mc->RingRead + take[i]) % cap;
+		mc->RingLength -= take[i];
+		mc->LastFrag = ext->FragsMixed + 1;
+	}
+	ext->FragsMixed += 1;
+	commit_fragment(sub_dev_ptr);
+}
+
+
+/* add bytes of samples of one writer to the sums */
+static void mix_add(sub_dev_ext_t *ext, i32_t *acc, char *src, u32_t bytes)
+{
+	if (ext->MixSample == 1) {
+		mix_add8(acc, (u8_t *) src, bytes, ext->MixFlip);
+	} else {
+		mix_add16(acc, (u16_t *) src, bytes / 2, ext->MixFlip);
+	}
+}
+
+
+/* the mixer made room: go on with the writes, drains and selects of the
+ * mix clients of a sub device, and let go of the closed ones that are 
+ * done */
+static void mix_serve(sub_dev_t *sub_dev_ptr)
+{
+	int i;
+	mix_client_t *mc;
+
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		mc = &mix_client[i];
+		if (!mc->InUse || mc->SubDev != sub_dev_ptr->Nr) continue;
+
+		if (mc->ReqPending) {
+			mix_copy_in(mc, &mc->Req);
+			if (mc->Req.Done == mc->Req.Size) {
+				mc->ReqPending = FALSE;
+				TRACE(TRACE_REPLY, sub_dev_ptr->Nr, mc->Req.Size);
+				chardriver_reply_task(mc->Req.SourceProcNr, mc->Req.Id, 
+					mc->Req.Size);
+			}
+		}
+		if (mc->DrainPending && mix_drained(mc)) {
+			mc->DrainPending = FALSE;
+			TRACE(TRACE_REPLY, sub_dev_ptr->Nr, OK);
+			chardriver_reply_task(mc->DrainProcNr, mc->DrainId, OK);
+		}
+		if (!mc->Opened) {
+			if (mc->RingLength < sub_dev_ext[sub_dev_ptr->Nr].MixSample)
+				mix_release(mc);
+			continue;
+		}
+		if ((mc->SelectOps & CDEV_OP_WR) && !mc->ReqPending && 
+				mix_room(mc) > 0) {
+			mc->SelectOps = 0;
+			chardriver_reply_select(mc->SelectProcNr, MIX_MINOR + i, 
+				CDEV_OP_WR);
+		}
+	}
+}
+
+
+/* report how far the hardware is in the stream of a sub device */
+static int get_position(sub_dev_t *sub_dev_ptr, struct dsp_position *pos)
 {
 	int r;
+	u32_t offset, frame_size, queued;
+	u64_t bytes, tsc;
+	sub_dev_ext_t *ext;
 
-	if (!sub_dev_ptr->RevivePending) return; /* nobody is wating for data */
-	if (sub_dev_ptr->BufLength == 0 && sub_dev_ptr->DmaLength == 0) return; 
-		/* no data for user */
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
 
-	if(sub_dev_ptr->BufLength != 0) { /* data in extra buffer available */
+	if (sub_dev_ptr->DmaMode == NO_DMA) return EINVAL;
 
-		r = sys_safecopyto(sub_dev_ptr->SourceProcNr,
-				(vir_bytes)sub_dev_ptr->ReviveGrant,
-				0, (vir_bytes)sub_dev_ptr->ExtraBuf + 
-				sub_dev_ptr->BufReadNext * sub_dev_ptr->FragSize,
-				(phys_bytes)sub_dev_ptr->FragSize);
-		if (r != OK)
-			printf("%s:%d: safecopy failed\n", __FILE__, __LINE__);
+	/* a polled sub device may be fragments ahead of the last poll */
+	if (ext->PollTicks > 0 && sub_dev_ptr->DmaBusy) 
+		poll_sub_dev(sub_dev_ptr->Nr);
 
-		/* adjust the buffer status variables */
-		sub_dev_ptr->BufReadNext = 
-			(sub_dev_ptr->BufReadNext + 1) % sub_dev_ptr->NrOfExtraBuffers;
-		sub_dev_ptr->BufLength -= 1;
+	r = drv_get_position(sub_dev_ptr->Nr, &offset, &frame_size);
+	read_tsc_64(&tsc);
+	if (r != OK) return r;
+	if (frame_size == 0) return EIO;
+
+	/* a stopped device is at a fragment boundary; one paused for lack 
+	   of data has run into a fragment it has no data for */
+	if (!sub_dev_ptr->DmaBusy || 
+			(sub_dev_ptr->DmaMode == WRITE_DMA && sub_dev_ptr->OutOfData) ||
+			offset >= sub_dev_ptr->FragSize) {
+		offset = 0;
+	}
+
+	/* the hardware may have finished a fragment whose interrupt is not
+	   handled yet; its offset then starts over too early */
+	bytes = ext->FragsDone * sub_dev_ptr->FragSize + offset;
+	if (bytes < ext->LastPos) {
+		offset = 0;
+		bytes = ext->LastPos;
+	}
+	ext->LastPos = bytes;
+
+	pos->bytes = bytes;
+	pos->frames = bytes / frame_size;
+	pos->tsc = tsc;
+	pos->usec = tsc_64_to_micros(tsc);
+	pos->frame_size = frame_size;
+
+	queued = sub_dev_ptr->DmaLength * sub_dev_ptr->FragSize;
+	if (sub_dev_ptr->DmaMode == WRITE_DMA) {
+		/* the hardware is at offset in the oldest fragment in the ring */
+		queued += ext->FillOffset;
+		pos->delay = (queued > offset) ? queued - offset : 0;
+	} else {
+		/* and here it fills the fragment after the newest one */
+		pos->delay = queued + sub_dev_ptr->BufLength * sub_dev_ptr->FragSize
+			- ext->ReadOffset + offset;
+	}
+	return OK;
+}
+
+
+/* sample frames that are buffered and not played or read yet */
+static int get_samples_in_buf(sub_dev_t *sub_dev_ptr, u32_t *frames)
+{
+	int r;
+	struct dsp_position pos;
+
+	if ((r = get_position(sub_dev_ptr, &pos)) != OK) return r;
+	*frames = pos.delay / pos.frame_size;
+	return OK;
+}
+
+
+/* report the counters of a sub device, with the average irq gap worked out */
+static int get_stats(sub_dev_t *sub_dev_ptr, struct dsp_stats *stats)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	*stats = ext->Stats;
+	stats->irq_gap_avg = (ext->IrqGaps > 0) ? 
+		(u32_t) (ext->IrqGapSum / ext->IrqGaps) : 0;
+	return OK;
+}
+
+static void data_to_user(sub_dev_t *sub_dev_ptr)
+{
+	audio_req_t *req;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	/* serve the queued reads in order, as long as there is data */
+	while (ext->ReqLength > 0) {
+		req = &ext->ReqQueue[ext->ReqReadNext];
+
+		copy_to_req(sub_dev_ptr, req);
+		if (req->Done < req->Size) break; /* no data for the rest */
+
+		TRACE(TRACE_REPLY, sub_dev_ptr->Nr, req->Size);
+		chardriver_reply_task(req->SourceProcNr, req->Id, req->Size);
+
+		dequeue_request(sub_dev_ptr);
+	}
+}
+
+
+/* copy as much recorded data to a read request as is available */
+static void copy_to_req(sub_dev_t *sub_dev_ptr, audio_req_t *req)
+{
+	int r, nr;
+	size_t chunk, start;
+	char *src;
+	struct vscp_vec vec[NR_COPY_VEC];
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	do {
+		/* collect the pieces of the rings that go to this request */
+		nr = 0;
+		start = req->Done;
+		while (req->Done < req->Size && nr < NR_COPY_VEC) {
+			if(sub_dev_ptr->BufLength != 0) { /* data in extra buf */
+				src = sub_dev_ptr->ExtraBuf + 
+					sub_dev_ptr->BufReadNext * sub_dev_ptr->FragSize;
+			} else if (sub_dev_ptr->DmaLength != 0) { /* data in dma buf */
+				src = sub_dev_ptr->DmaPtr + 
+					sub_dev_ptr->DmaReadNext * sub_dev_ptr->FragSize;
+			} else {
+				break; /* no data for user */
+			}
+			chunk = MIN(sub_dev_ptr->FragSize - ext->ReadOffset, 
+					req->Size - req->Done);
+
+			add_copy_vec(vec, &nr, SELF, req->SourceProcNr, req->Grant,
+				(vir_bytes)req->Done, (vir_bytes)src + ext->ReadOffset, 
+				chunk);
+
+			req->Done += chunk;
+			ext->ReadOffset += chunk;
+			if (ext->ReadOffset < sub_dev_ptr->FragSize) continue;
+
+			/* fragment used up, adjust the buffer status variables */
+			ext->ReadOffset = 0;
+			ext->Stats.frags_to_user += 1;
+			if(sub_dev_ptr->BufLength != 0) {
+				sub_dev_ptr->BufReadNext = (sub_dev_ptr->BufReadNext + 1) %
+					sub_dev_ptr->NrOfExtraBuffers;
+				sub_dev_ptr->BufLength -= 1;
+			} else {
+				sub_dev_ptr->DmaReadNext = (sub_dev_ptr->DmaReadNext + 1) %
+					sub_dev_ptr->NrOfDmaFragments;
+				sub_dev_ptr->DmaLength -= 1;
+			}
+		}
+		if (nr == 0) break;
 
-	} else { /* extra buf empty, but data in dma buf*/ 
-		r = sys_safecopyto(
-				sub_dev_ptr->SourceProcNr, 
-				(vir_bytes)sub_dev_ptr->ReviveGrant, 0, 
-				(vir_bytes)sub_dev_ptr->DmaPtr + 
-				sub_dev_ptr->DmaReadNext * sub_dev_ptr->FragSize,
-				(phys_bytes)sub_dev_ptr->FragSize);
+		/* ...and copy them all with a single kernel call */
+		TRACE(TRACE_COPY_START, sub_dev_ptr->Nr, req->Done - start);
+		r = sys_vsafecopy(vec, nr);
+		TRACE(TRACE_COPY_END, sub_dev_ptr->Nr, r);
 		if (r != OK)
 			printf("%s:%d: safecopy failed\n", __FILE__, __LINE__);
 
-		/* adjust the buffer status variables */
-		sub_dev_ptr->DmaReadNext = 
-			(sub_dev_ptr->DmaReadNext + 1) % sub_dev_ptr->NrOfDmaFragments;
-		sub_dev_ptr->DmaLength -= 1;
+	} while (req->Done < req->Size && nr == NR_COPY_VEC);
+}
+
+
+/* append a read or write request to the queue of a sub device */
+static int queue_request(sub_dev_t *sub_dev_ptr, endpoint_t endpt,
+	cp_grant_id_t grant, size_t size, cdev_id_t id)
+{
+	audio_req_t *req;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	if (ext->ReqLength == NR_PENDING_REQS) return EBUSY;
+
+	req = &ext->ReqQueue[(ext->ReqReadNext + ext->ReqLength) % 
+		NR_PENDING_REQS];
+	req->SourceProcNr = endpt;
+	req->Grant = grant;
+	req->Size = size;
+	req->Done = 0;
+	req->Id = id;
+
+	ext->ReqLength += 1;
+	sub_dev_ptr->RevivePending = TRUE;
+	return OK;
+}
+
+
+/* remove the oldest request from the queue; it must have been replied to */
+static void dequeue_request(sub_dev_t *sub_dev_ptr)
+{
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	ext->ReqReadNext = (ext->ReqReadNext + 1) % NR_PENDING_REQS;
+	ext->ReqLength -= 1;
+	sub_dev_ptr->RevivePending = (ext->ReqLength > 0);
+}
+
+
+/* reply to all queued requests with the given status and empty the queue */
+static void flush_requests(sub_dev_t *sub_dev_ptr, int status)
+{
+	audio_req_t *req;
+	sub_dev_ext_t *ext;
+
+	ext = &sub_dev_ext[sub_dev_ptr->Nr];
+
+	while (ext->ReqLength > 0) {
+		req = &ext->ReqQueue[ext->ReqReadNext];
+		/* report the part that was transferred, if any */
+		TRACE(TRACE_REPLY, sub_dev_ptr->Nr, 
+			req->Done > 0 ? (int) req->Done : status);
+		chardriver_reply_task(req->SourceProcNr, req->Id, 
+			req->Done > 0 ? (int) req->Done : status);
+		dequeue_request(sub_dev_ptr);
+	}
+}
+
+
+static int msg_cancel(devminor_t minor, endpoint_t endpt, cdev_id_t id)
+{
+	int i, j, k, r, chan[2];
+	sub_dev_ext_t *ext;
+	special_file_t* special_file_ptr;
+	mix_client_t *mc;
+
+	if (IS_MIX_MINOR(minor)) {
+		if ((mc = get_mix_client(minor)) == NULL) return EDONTREPLY;
+		return mix_cancel(mc, endpt, id);
+	}
+
+	special_file_ptr = get_special_file(minor);
+	if(special_file_ptr == NULL) {
+		return EDONTREPLY;
+	}
+
+	chan[0] = special_file_ptr->write_chan;
+	chan[1] = special_file_ptr->read_chan;
+
+	if (special_file_ptr->io_ctl != NO_CHANNEL) {
+		ext = &sub_dev_ext[special_file_ptr->io_ctl];
+		if (ext->DrainPending && ext->DrainProcNr == endpt && 
+				ext->DrainId == id) {
+			ext->DrainPending = FALSE;
+			return EINTR;
+		}
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (chan[i] == NO_CHANNEL) continue;
+		ext = &sub_dev_ext[chan[i]];
+
+		for (j = 0; j < ext->ReqLength; j++) {
+			k = (ext->ReqReadNext + j) % NR_PENDING_REQS;
+			if (ext->ReqQueue[k].SourceProcNr != endpt ||
+					ext->ReqQueue[k].Id != id) continue;
+
+			/* an interrupted transfer returns what it got so far */
+			r = (ext->ReqQueue[k].Done > 0) ? 
+				(int) ext->ReqQueue[k].Done : EINTR;
+
+			/* close the gap by moving the younger requests forward */
+			for (; j < ext->ReqLength - 1; j++) {
+				ext->ReqQueue[k] = 
+					ext->ReqQueue[(k + 1) % NR_PENDING_REQS];
+				k = (k + 1) % NR_PENDING_REQS;
+			}
+			ext->ReqLength -= 1;
+			sub_dev[chan[i]].RevivePending = (ext->ReqLength > 0);
+			return r;
+		}
+	}
+	/* not found; the request was already replied to */
+	return EDONTREPLY;
+}
+
+/* the minors of the driver must be below the ones mix clients are
+ * cloned to, and there must be a mix client for every writer a card
+ * allows */
+static int check_minors(void)
+{
+	int i, c, n, mixers[DRV_MAX_CARDS];
+	special_file_t *sf;
+
+	memset(mixers, 0, sizeof(mixers));
+	for (i = 0; i < drv.NrOfSpecialFiles; i++) {
+		sf = &special_file[i];
+		if (sf->minor_dev_nr < 0 || sf->minor_dev_nr >= MIX_MINOR) {
+			printf("%s: minor device %d is out of range\n", 
+				drv.DriverName, sf->minor_dev_nr);
+			return EINVAL;
+		}
+		n = drv_get_mix_clients(sf->minor_dev_nr);
+		if (n <= 1 || sf->write_chan == NO_CHANNEL) continue;
+		c = drv_get_card(sf->write_chan);
+		if (c < 0 || c >= DRV_MAX_CARDS || 
+				(mixers[c] += n) > DRV_MAX_MIX_CLIENTS) {
+			printf("%s: too many mixed writers on card %d\n", 
+				drv.DriverName, c);
+			return EINVAL;
+		}
+	}
+	return OK;
+}
+
+
+/* carve the extra buffers of all sub devices, and the rings of the mix
+ * clients, out of one allocation */
+static int init_extra_pool(void)
+{
+	int i, rings;
+	size_t size, ring_size;
+
+	mix_rings(&rings, &ring_size);
+	size = rings * ring_size;
+	for (i = 0; i < drv.NrOfSubDevices; i++) {
+		size += extra_buf_size(&sub_dev[i]);
+	}
+	if (extra_pool == NULL && size > 0 && 
+			(extra_pool = malloc(size)) == NULL) {
+		return ENOMEM;
+	}
+
+	size = 0;
+	for (i = 0; i < NR_MIX_CLIENTS; i++) {
+		mix_client[i].Ring = NULL;
+		if (i >= rings) continue;
+		mix_client[i].Ring = extra_pool + size;
+		size += ring_size;
+	}
+	for (i = 0; i < drv.NrOfSubDevices; i++) {
+		sub_dev[i].ExtraBuf = sub_dev_ext[i].PoolBuf = extra_pool + size;
+		size += extra_buf_size(&sub_dev[i]);
+	}
+	return OK;
+}
+
+
+/* the mix clients there can be at once, one for every writer the 
+ * special files allow, and the largest ring one of them needs */
+static void mix_rings(int *rings, size_t *ring_size)
+{
+	int i, n, chan;
+
+	*rings = 0;
+	*ring_size = 0;
+	for (i = 0; i < drv.NrOfSpecialFiles; i++) {
+		n = drv_get_mix_clients(special_file[i].minor_dev_nr);
+		chan = special_file[i].write_chan;
+		if (n <= 1 || chan == NO_CHANNEL) continue;
+		*rings += n;
+		*ring_size = MAX(*ring_size, (size_t) sub_dev_ext[chan].DmaCapacity);
 	}
+	/* check_minors() made sure they fit */
+	*rings = MIN(*rings, NR_MIX_CLIENTS);
+}
 
-	chardriver_reply_task(sub_dev_ptr->SourceProcNr, sub_dev_ptr->ReviveId,
-		sub_dev_ptr->FragSize);
 
-	/* reset variables */
-	sub_dev_ptr->RevivePending = 0;
+/* size of the extra buffer space of a sub device, 0 if it does no dma. 
+ * Playback writes straight into the dma ring and needs none. */
+static size_t extra_buf_size(sub_dev_t *sub_dev_ptr)
+{
+	if (!sub_dev_ptr->readable || sub_dev_ptr->DmaSize <= 0 || 
+			sub_dev_ptr->NrOfDmaFragments <= 0) {
+		return 0;
+	}
+	return sub_dev_ptr->NrOfExtraBuffers * 
+		(sub_dev_ptr->DmaSize / sub_dev_ptr->NrOfDmaFragments);
 }
 
+
 static int init_buffers(sub_dev_t *sub_dev_ptr)
 {
 #if defined(__i386__)
+	/* the dma buffer is allocated on the first open and then kept;
+	   contiguous memory below 16M is slow to get and scarce */
+	if (sub_dev_ptr->DmaBuf == NULL && alloc_dma_buf(sub_dev_ptr) != OK) {
+		return EIO;
+	}
+	/* write the physical dma address and size to the device */
+	drv_set_dma(sub_dev_ptr->DmaPhys, 
+			sub_dev_ptr->DmaSize, sub_dev_ptr->Nr);
+	return OK;
+
+#else /* !defined(__i386__) */
+	printf("%s: init_buffers() failed, CHIP != INTEL", drv.DriverName);
+	return EIO;
+#endif /* defined(__i386__) */
+}
+
+
+#if defined(__i386__)
+static int alloc_dma_buf(sub_dev_t *sub_dev_ptr)
+{
 	char *base;
 	size_t size;
 	unsigned left;
@@ -762,50 +3548,52 @@ static int init_buffers(sub_dev_t *sub_dev_ptr)
 	phys_bytes ph;
 
 	/* allocate dma buffer space */
-	size= sub_dev_ptr->DmaSize + 64 * 1024;
+	size= sub_dev_ext[sub_dev_ptr->Nr].DmaCapacity + 64 * 1024;
 	base= alloc_contig(size, AC_ALIGN64K|AC_LOWER16M, &ph);
 	if (!base) {
 		printf("%s: failed to allocate dma buffer for a channel\n", 
 				drv.DriverName);
 		return EIO;
 	}
-	sub_dev_ptr->DmaBuf= base;
 
 	tell_dev((vir_bytes)base, size, 0, 0, 0);
 
-	/* allocate extra buffer space */
-	if (!(sub_dev_ptr->ExtraBuf = malloc(sub_dev_ptr->NrOfExtraBuffers * 
-					sub_dev_ptr->DmaSize / 
-					sub_dev_ptr->NrOfDmaFragments))) {
-		printf("%s failed to allocate extra buffer for a channel\n", 
-				drv.DriverName);
-		return EIO;
-	}
-
-	sub_dev_ptr->DmaPtr = sub_dev_ptr->DmaBuf;
 	i = sys_umap(SELF, VM_D, (vir_bytes) base, (phys_bytes) size,
 			&(sub_dev_ptr->DmaPhys));
 
 	if (i != OK) {
+		free_contig(base, size);
 		return EIO;
 	}
+	sub_dev_ptr->DmaBuf= base;
+	sub_dev_ptr->DmaPtr = sub_dev_ptr->DmaBuf;
 
 	if ((left = dma_bytes_left(sub_dev_ptr->DmaPhys)) < 
-			(unsigned int)sub_dev_ptr->DmaSize) {
+			(unsigned int)sub_dev_ext[sub_dev_ptr->Nr].DmaCapacity) {
 		/* First half of buffer crosses a 64K boundary,
 		 * can't DMA into that */
 		sub_dev_ptr->DmaPtr += left;
 		sub_dev_ptr->DmaPhys += left;
 	}
-	/* write the physical dma address and size to the device */
-	drv_set_dma(sub_dev_ptr->DmaPhys, 
-			sub_dev_ptr->DmaSize, sub_dev_ptr->Nr);
 	return OK;
+}
+#endif
 
-#else /* !defined(__i386__) */
-	printf("%s: init_buffers() failed, CHIP != INTEL", drv.DriverName);
-	return EIO;
-#endif /* defined(__i386__) */
+
+/* give back the buffers of all sub devices when the driver goes down */
+static void free_buffers(void)
+{
+	int i;
+
+	for (i = 0; i < drv.NrOfSubDevices; i++) {
+		free_spill(&sub_dev[i]);
+		if (sub_dev[i].DmaBuf == NULL) continue;
+		free_contig(sub_dev[i].DmaBuf, sub_dev_ext[i].DmaCapacity + 64 * 1024);
+		sub_dev[i].DmaBuf = NULL;
+	}
+	free(extra_pool);
+	extra_pool = NULL;
+	for (i = 0; i < NR_MIX_CLIENTS; i++) mix_client[i].Ring = NULL;
 }
 
 
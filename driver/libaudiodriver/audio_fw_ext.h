@@ -0,0 +1,78 @@
+/*	audio_fw_ext.h - driver interface of the audio framework
+ *
+ * Functions that the device specific part of an audio driver must
+ * provide on top of the ones declared in <minix/audio_fw.h>.
+ */
+
+#ifndef AUDIO_FW_EXT_H
+#define AUDIO_FW_EXT_H
+
+#include <minix/audio_fw.h>
+#include "ioc_audio.h"
+
+/* Largest nr. of fragments the dma ring of a sub device may be split
+ * into; the device must interrupt at the end of every fragment. */
+int drv_get_max_fragments(int sub_dev);
+
+/* Check all parameters of a stream and take them over, see DSPIOPARAMS.
+ * Returns EINVAL without changing anything if one of them can't be 
+ * done; otherwise params is updated with what the device will use. */
+int drv_set_params(struct dsp_params *params, int sub_dev);
+
+/* Where the dma engine of a running sub device is: the bytes it has
+ * done of the fragment it is working on, as read from the hardware, and
+ * the size of a sample frame in the current format. */
+int drv_get_position(int sub_dev, u32_t *frag_offset, u32_t *frame_size);
+
+/* Where the dma engine of a running sub device is in the whole ring, in
+ * bytes from the start of it. Used instead of interrupts, see DSPIOPOLL. */
+int drv_get_dma_offset(int sub_dev, u32_t *offset);
+
+/* Stop a sub device from interrupting, and clear an interrupt it has 
+ * pending; it keeps running. drv_reenable_int() undoes it. */
+int drv_disable_int(int sub_dev);
+
+/* Start a playback and a capture sub device at the same moment, each as
+ * drv_start() would, see DSPIOLINK. ENOSYS if the hardware can't; they 
+ * are then started one after the other. */
+int drv_start_linked(int write_sub_dev, int read_sub_dev);
+
+/* Nr. of writers that may share the playback channel of a special file;
+ * the framework mixes them, see audio_mix.h. 0 or 1 if it is opened by 
+ * one at a time. */
+int drv_get_mix_clients(int minor_dev_nr);
+
+/* The format a sub device is set to, as drv_set_params() would report
+ * it. */
+int drv_get_params(struct dsp_params *params, int sub_dev);
+
+/* One driver may serve several cards of the same kind. The sub devices
+ * and special files of a card follow those of the card before it in
+ * sub_dev[] and special_file[], and each card has minor devices of its
+ * own, below the ones mixed writers are cloned to. drv_get_mix_clients()
+ * of all special files of a card may add up to DRV_MAX_MIX_CLIENTS.
+ * Every card gets an irq hook; drv_get_irq() and drv_int_sum() are
+ * about the first one. For a driver of one card drv_get_nr_cards() is
+ * 1 and every sub device is on card 0. */
+#define DRV_MAX_CARDS		8
+#define DRV_MAX_MIX_CLIENTS	8	/* per card */
+
+/* Nr. of cards drv_init() found, 1 up to DRV_MAX_CARDS. */
+int drv_get_nr_cards(void);
+
+/* The card a sub device is on. */
+int drv_get_card(int sub_dev);
+
+/* The irq of a card. */
+int drv_get_card_irq(int card, char *irq);
+
+/* Status of the interrupt summary bit of a card. */
+int drv_card_int_sum(int card);
+
+/* Not a driver hook: provided by the framework for liveupdate.c. TRUE
+ * if a read (READ_DMA) or a write (WRITE_DMA) caller waits for a reply
+ * that sub_dev[].RevivePending doesn't show, such as a DSPIODRAIN or
+ * one of a mixed writer. */
+int fw_reply_pending(int dma_mode);
+
+#endif /* AUDIO_FW_EXT_H */
@@ -0,0 +1,223 @@
+/* This file contains the software gain of the audio framework, see
+ * audio_gain.h. A sample is multiplied by the gain in Q12, the top bits
+ * of the one kept in Q24, and rounded back to 16 bits with saturation.
+ * The gain of a frame in a ramp is the one at its start plus a step per
+ * frame before it, so a kernel may work it out for a whole vector at
+ * once; for the kernels see conv_simd in audio_conv.h.
+ */
+
+#include <sys/param.h>
+#include "audio_gain.h"
+#include "audio_conv.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define MUL_SHIFT		12					/* the multiply is in Q12 */
+#define MUL_ROUND		(1 << (MUL_SHIFT - 1))
+
+static const i32_t flat[2] = { 0, 0 };
+
+
+/* ======= C ======= */
+
+static void scale_c(i16_t *buf, size_t frames, u32_t channels, i32_t *gain,
+	const i32_t *step)
+{
+	size_t i;
+	u32_t c;
+	i32_t v;
+
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c < channels; c++) {
+			v = *buf * (gain[c] >> (GAIN_SHIFT - MUL_SHIFT));
+			v = (v + MUL_ROUND) >> MUL_SHIFT;
+			if (v > 32767) v = 32767;
+			if (v < -32768) v = -32768;
+			*buf++ = (i16_t) v;
+			gain[c] += step[c];
+		}
+	}
+}
+
+
+/* ======= SSE2 ======= */
+#if defined(__SSE2__)
+
+/* a vector of gains in Q12 times one of samples, as 32 bit products */
+static __m128i mul_lo(__m128i s, __m128i g)
+{
+	return _mm_unpacklo_epi16(_mm_mullo_epi16(s, g), _mm_mulhi_epi16(s, g));
+}
+
+
+static __m128i mul_hi(__m128i s, __m128i g)
+{
+	return _mm_unpackhi_epi16(_mm_mullo_epi16(s, g), _mm_mulhi_epi16(s, g));
+}
+
+
+static __m128i round_q12(__m128i v)
+{
+	return _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(MUL_ROUND)),
+		MUL_SHIFT);
+}
+
+
+/* 8 samples at a time: 8 frames of one channel or 4 of two */
+static void scale_sse2(i16_t *buf, size_t frames, u32_t channels,
+	i32_t *gain, const i32_t *step)
+{
+	i32_t g[8], inc[8];
+	__m128i g0, g1, inc0, inc1, s, g16;
+	size_t i, n;
+	u32_t c;
+
+	for (i = 0; i < 8; i++) {
+		c = i % channels;
+		g[i] = gain[c] + (i32_t) (i / channels) * step[c];
+		inc[i] = (i32_t) (8 / channels) * step[c];
+	}
+	g0 = _mm_loadu_si128((const __m128i *) g);
+	g1 = _mm_loadu_si128((const __m128i *) (g + 4));
+	inc0 = _mm_loadu_si128((const __m128i *) inc);
+	inc1 = _mm_loadu_si128((const __m128i *) (inc + 4));
+
+	n = frames * channels;
+	for (i = 0; i + 8 <= n; i += 8) {
+		g16 = _mm_packs_epi32(_mm_srai_epi32(g0, GAIN_SHIFT - MUL_SHIFT),
+			_mm_srai_epi32(g1, GAIN_SHIFT - MUL_SHIFT));
+		s = _mm_loadu_si128((const __m128i *) (buf + i));
+		_mm_storeu_si128((__m128i *) (buf + i), _mm_packs_epi32(
+			round_q12(mul_lo(s, g16)), round_q12(mul_hi(s, g16))));
+		g0 = _mm_add_epi32(g0, inc0);
+		g1 = _mm_add_epi32(g1, inc1);
+	}
+
+	for (c = 0; c < channels; c++)
+		gain[c] += (i32_t) (i / channels) * step[c];
+	scale_c(buf + i, frames - i / channels, channels, gain, step);
+}
+#endif /* __SSE2__ */
+
+
+/* ======= AVX2 ======= */
+#if defined(__AVX2__)
+
+/* 16 samples at a time. Packing works within each half of a vector, so
+ * the gains of samples 0-3 and 8-11 are in one vector, those of 4-7 and
+ * 12-15 in the other. */
+static void scale_avx2(i16_t *buf, size_t frames, u32_t channels,
+	i32_t *gain, const i32_t *step)
+{
+	static const u32_t lane[8] = { 0, 1, 2, 3, 8, 9, 10, 11 };
+	i32_t g[16], inc[16];
+	__m256i g0, g1, inc0, inc1, s, g16, lo, hi, round;
+	size_t i, n, k;
+	u32_t c;
+
+	for (i = 0; i < 16; i++) {
+		k = lane[i % 8] + (i / 8) * 4;
+		c = k % channels;
+		g[i] = gain[c] + (i32_t) (k / channels) * step[c];
+		inc[i] = (i32_t) (16 / channels) * step[c];
+	}
+	g0 = _mm256_loadu_si256((const __m256i *) g);
+	g1 = _mm256_loadu_si256((const __m256i *) (g + 8));
+	inc0 = _mm256_loadu_si256((const __m256i *) inc);
+	inc1 = _mm256_loadu_si256((const __m256i *) (inc + 8));
+	round = _mm256_set1_epi32(MUL_ROUND);
+
+	n = frames * channels;
+	for (i = 0; i + 16 <= n; i += 16) {
+		g16 = _mm256_packs_epi32(
+			_mm256_srai_epi32(g0, GAIN_SHIFT - MUL_SHIFT),
+			_mm256_srai_epi32(g1, GAIN_SHIFT - MUL_SHIFT));
+		s = _mm256_loadu_si256((const __m256i *) (buf + i));
+		lo = _mm256_mullo_epi16(s, g16);
+		hi = _mm256_mulhi_epi16(s, g16);
+		_mm256_storeu_si256((__m256i *) (buf + i), _mm256_packs_epi32(
+			_mm256_srai_epi32(_mm256_add_epi32(
+				_mm256_unpacklo_epi16(lo, hi), round), MUL_SHIFT),
+			_mm256_srai_epi32(_mm256_add_epi32(
+				_mm256_unpackhi_epi16(lo, hi), round), MUL_SHIFT)));
+		g0 = _mm256_add_epi32(g0, inc0);
+		g1 = _mm256_add_epi32(g1, inc1);
+	}
+
+	for (c = 0; c < channels; c++)
+		gain[c] += (i32_t) (i / channels) * step[c];
+	scale_c(buf + i, frames - i / channels, channels, gain, step);
+}
+#endif /* __AVX2__ */
+
+
+void gain_init(audio_gain_t *g)
+{
+	g->gain[0] = g->gain[1] = GAIN_UNITY;
+	g->target[0] = g->target[1] = GAIN_UNITY;
+	g->step[0] = g->step[1] = 0;
+	g->ramp = 0;
+
+	g->scale = scale_c;
+#if defined(__SSE2__)
+	if (conv_simd >= CONV_SSE2) g->scale = scale_sse2;
+#endif
+#if defined(__AVX2__)
+	if (conv_simd >= CONV_AVX2) g->scale = scale_avx2;
+#endif
+}
+
+
+/* The steps are rounded towards 0; what they leave is made up for at
+ * the end of the ramp. */
+void gain_set(audio_gain_t *g, i32_t left, i32_t right, u32_t frames)
+{
+	g->target[0] = left;
+	g->target[1] = right;
+	g->ramp = frames;
+	if (frames == 0) {
+		g->gain[0] = left;
+		g->gain[1] = right;
+		return;
+	}
+	g->step[0] = (left - g->gain[0]) / (i32_t) frames;
+	g->step[1] = (right - g->gain[1]) / (i32_t) frames;
+}
+
+
+int gain_unity(const audio_gain_t *g, u32_t channels)
+{
+	return g->ramp == 0 && g->gain[0] == GAIN_UNITY &&
+		(channels == 1 || g->gain[1] == GAIN_UNITY);
+}
+
+
+void gain_apply(audio_gain_t *g, i16_t *buf, size_t frames,
+	u32_t channels)
+{
+	size_t n;
+
+	while (g->ramp > 0 && frames > 0) {
+		n = MIN(frames, g->ramp);
+		g->scale(buf, n, channels, g->gain, g->step);
+		buf += n * channels;
+		frames -= n;
+		g->ramp -= n;
+		if (g->ramp == 0) {
+			g->gain[0] = g->target[0];
+			g->gain[1] = g->target[1];
+		}
+	}
+	if (frames == 0 || gain_unity(g, channels)) return;
+
+	/* silence needs no multiply */
+	if (g->gain[0] == 0 && (channels == 1 || g->gain[1] == 0)) {
+		memset(buf, 0, frames * channels * sizeof(i16_t));
+		return;
+	}
+	g->scale(buf, frames, channels, g->gain, flat);
+}
@@ -0,0 +1,41 @@
+/*	audio_gain.h - software gain of the audio framework
+ *
+ * Scales signed 16 bit samples per channel on their way into the dma
+ * ring. A new gain is reached in a linear ramp, a step every frame, so
+ * that a change doesn't click. Gains and steps are fixed point and the
+ * samples are multiplied by the top bits of the gain, in integers.
+ */
+
+#ifndef AUDIO_GAIN_H
+#define AUDIO_GAIN_H
+
+#include <minix/drivers.h>
+
+#define GAIN_SHIFT			24
+#define GAIN_UNITY			(1 << GAIN_SHIFT)	/* 1.0 */
+#define GAIN_MAX			(4 * GAIN_UNITY)	/* the multiply's 16 bits
+												   take up to 8.0 */
+
+typedef struct {
+	i32_t gain[2];					/* per channel, now */
+	i32_t target[2];				/* at the end of the ramp */
+	i32_t step[2];					/* added every frame of the ramp */
+	u32_t ramp;						/* frames of it to go, 0 if none */
+	void (*scale)(i16_t *buf, size_t frames, u32_t channels, i32_t *gain,
+		const i32_t *step);
+} audio_gain_t;
+
+/* at 1.0, and the kernels as conv_simd allows */
+void gain_init(audio_gain_t *g);
+
+/* Ramp from the gain now to left and right, 0 up to GAIN_MAX, in frames;
+ * 0 frames sets them at once. One channel has the left one. */
+void gain_set(audio_gain_t *g, i32_t left, i32_t right, u32_t frames);
+
+/* at 1.0 and no ramp: gain_apply() changes nothing */
+int gain_unity(const audio_gain_t *g, u32_t channels);
+
+void gain_apply(audio_gain_t *g, i16_t *buf, size_t frames,
+	u32_t channels);
+
+#endif /* AUDIO_GAIN_H */
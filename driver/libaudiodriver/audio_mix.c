@@ -0,0 +1,62 @@
+/* This file contains the sample kernels of the mixer in audio_fw.c, see
+ * audio_mix.h. Each is a plain loop over independent samples without 
+ * branches, which the compiler turns into SIMD code where the target has
+ * it (e.g. SSE2 on i386 with -msse2, or -O3); the clipping becomes a 
+ * min and a max.
+ */
+
+#include "audio_mix.h"
+
+
+/* add 8 bit samples to the accumulators */
+void mix_add8(i32_t *restrict acc, const u8_t *restrict src, size_t n,
+	u8_t flip)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		acc[i] += (i32_t) (u8_t) (src[i] ^ flip) - 0x80;
+}
+
+
+/* add 16 bit samples to the accumulators */
+void mix_add16(i32_t *restrict acc, const u16_t *restrict src, size_t n,
+	u16_t flip)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		acc[i] += (i32_t) (u16_t) (src[i] ^ flip) - 0x8000;
+}
+
+
+/* clip the accumulators to 8 bit samples */
+void mix_out8(u8_t *restrict dst, const i32_t *restrict acc, size_t n,
+	u8_t flip)
+{
+	size_t i;
+	i32_t v;
+
+	for (i = 0; i < n; i++) {
+		v = acc[i];
+		v = (v < -0x80) ? -0x80 : v;
+		v = (v > 0x7f) ? 0x7f : v;
+		dst[i] = (u8_t) (v + 0x80) ^ flip;
+	}
+}
+
+
+/* clip the accumulators to 16 bit samples */
+void mix_out16(u16_t *restrict dst, const i32_t *restrict acc, size_t n,
+	u16_t flip)
+{
+	size_t i;
+	i32_t v;
+
+	for (i = 0; i < n; i++) {
+		v = acc[i];
+		v = (v < -0x8000) ? -0x8000 : v;
+		v = (v > 0x7fff) ? 0x7fff : v;
+		dst[i] = (u16_t) (v + 0x8000) ^ flip;
+	}
+}
@@ -0,0 +1,30 @@
+/*	audio_mix.h - sample kernels of the audio framework's mixer
+ *
+ * The mixer sums the writers of a playback sub device a block of
+ * MIX_BLOCK samples at a time. Samples are added to 32 bit accumulators
+ * as signed values and clipped to the sample range once, on the way out,
+ * so the result does not depend on the order of the writers. Signed and
+ * unsigned samples differ only in their top bit, which flip toggles.
+ */
+
+#ifndef AUDIO_MIX_H
+#define AUDIO_MIX_H
+
+#include <minix/drivers.h>
+
+#define MIX_BLOCK		256		/* samples mixed at a time */
+
+/* flip for 8 and 16 bit samples that are signed */
+#define MIX_FLIP8		0x80
+#define MIX_FLIP16		0x8000
+
+void mix_add8(i32_t *restrict acc, const u8_t *restrict src, size_t n,
+	u8_t flip);
+void mix_add16(i32_t *restrict acc, const u16_t *restrict src, size_t n,
+	u16_t flip);
+void mix_out8(u8_t *restrict dst, const i32_t *restrict acc, size_t n,
+	u8_t flip);
+void mix_out16(u16_t *restrict dst, const i32_t *restrict acc, size_t n,
+	u16_t flip);
+
+#endif /* AUDIO_MIX_H */
@@ -0,0 +1,319 @@
+/* This file contains the sample rate conversion of the audio framework,
+ * see audio_rate.h. The input is kept per channel, and an output frame
+ * is the dot product of the frames around it with one phase of the
+ * filter. The position in the input is kept exactly, as a frame and a
+ * fraction of it in 1/den; the phase is that fraction, rounded down to
+ * one of RATE_MAX_PHASES if there are more.
+ *
+ * The table is worked out in double when the conversion is set up,
+ * without libm, which the drivers don't link. For the kernels of the
+ * dot product see conv_simd in audio_conv.h.
+ */
+
+#include <stdlib.h>
+#include <sys/param.h>
+#include "audio_rate.h"
+#include "audio_conv.h"
+#include "ioc_audio.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define PI		3.14159265358979323846
+
+/* filter of each DSP_QUALITY_*: taps at the rate of the slower stream,
+ * and the passband as a part of its Nyquist rate */
+static const struct {
+	u32_t taps;
+	double cutoff;
+} quality[] = {
+	{ 8, 0.80 },
+	{ 16, 0.90 },
+	{ 32, 0.95 }
+};
+
+static u32_t gcd(u32_t a, u32_t b);
+static double sine(double x);
+static double cosine(double x);
+static void make_phase(i16_t *coef, u32_t taps, double t, double fc);
+
+
+/* ======= C ======= */
+
+/* The sum fits: the coefficients of a phase add up to 1.0 in Q15 and
+ * their magnitudes to well below 2.0. */
+static i32_t dot_c(const i16_t *a, const i16_t *b, size_t n)
+{
+	i32_t sum;
+	size_t i;
+
+	sum = 0;
+	for (i = 0; i < n; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+
+/* ======= SSE2 ======= */
+#if defined(__SSE2__)
+
+/* pmaddwd's pairs can't overflow, no coefficient is -32768 */
+static i32_t dot_sse2(const i16_t *a, const i16_t *b, size_t n)
+{
+	__m128i sum;
+	size_t i;
+
+	sum = _mm_setzero_si128();
+	for (i = 0; i < n; i += 8) {
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(
+			_mm_loadu_si128((const __m128i *) (a + i)),
+			_mm_loadu_si128((const __m128i *) (b + i))));
+	}
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+	return _mm_cvtsi128_si32(sum);
+}
+#endif /* __SSE2__ */
+
+
+/* ======= AVX2 ======= */
+#if defined(__AVX2__)
+
+static i32_t dot_avx2(const i16_t *a, const i16_t *b, size_t n)
+{
+	__m256i sum8;
+	__m128i sum;
+	size_t i;
+
+	sum8 = _mm256_setzero_si256();
+	for (i = 0; i + 16 <= n; i += 16) {
+		sum8 = _mm256_add_epi32(sum8, _mm256_madd_epi16(
+			_mm256_loadu_si256((const __m256i *) (a + i)),
+			_mm256_loadu_si256((const __m256i *) (b + i))));
+	}
+	sum = _mm_add_epi32(_mm256_castsi256_si128(sum8),
+		_mm256_extracti128_si256(sum8, 1));
+	if (i < n) {
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(
+			_mm_loadu_si128((const __m128i *) (a + i)),
+			_mm_loadu_si128((const __m128i *) (b + i))));
+	}
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+	return _mm_cvtsi128_si32(sum);
+}
+#endif /* __AVX2__ */
+
+
+int rate_init(audio_rate_t *rs, u32_t in_rate, u32_t out_rate,
+	u32_t channels, u32_t q)
+{
+	u32_t g, p;
+	double fc;
+
+	if (in_rate < RATE_MIN || in_rate > RATE_MAX || out_rate < RATE_MIN ||
+			out_rate > RATE_MAX || channels < 1 || channels > 2 ||
+			q > DSP_QUALITY_BEST) {
+		return EINVAL;
+	}
+
+	rs->in_rate = in_rate;
+	rs->out_rate = out_rate;
+	rs->channels = channels;
+	rs->quality = q;
+	g = gcd(in_rate, out_rate);
+	rs->num = in_rate / g;
+	rs->den = out_rate / g;
+	rs->taps = quality[q].taps;
+	if (in_rate > out_rate) {
+		/* the same span of the output, as the cutoff is lower */
+		rs->taps = (rs->taps * in_rate / out_rate + 7) & ~7;
+		rs->taps = MIN(rs->taps, RATE_MAX_TAPS);
+	}
+	rs->phases = MIN(rs->den, RATE_MAX_PHASES);
+
+	rs->coef = malloc(rs->phases * rs->taps * sizeof(i16_t));
+	rs->hist = malloc(channels * RATE_HIST * sizeof(i16_t));
+	if (rs->coef == NULL || rs->hist == NULL) {
+		free(rs->coef);
+		free(rs->hist);
+		return ENOMEM;
+	}
+
+	/* below the Nyquist rate of the output too, when it is the lower */
+	fc = quality[q].cutoff;
+	if (out_rate < in_rate) fc = fc * out_rate / in_rate;
+	for (p = 0; p < rs->phases; p++) {
+		make_phase(rs->coef + p * rs->taps, rs->taps,
+			(double) p / rs->phases, fc);
+	}
+
+	rs->dot = dot_c;
+#if defined(__SSE2__)
+	if (conv_simd >= CONV_SSE2) rs->dot = dot_sse2;
+#endif
+#if defined(__AVX2__)
+	if (conv_simd >= CONV_AVX2) rs->dot = dot_avx2;
+#endif
+
+	rate_reset(rs);
+	return OK;
+}
+
+
+void rate_free(audio_rate_t *rs)
+{
+	free(rs->coef);
+	free(rs->hist);
+	rs->coef = NULL;
+	rs->hist = NULL;
+}
+
+
+/* The input starts with silence up to the middle of the filter, so that
+ * the first output frame falls on the first input frame. */
+void rate_reset(audio_rate_t *rs)
+{
+	memset(rs->hist, 0, rs->channels * RATE_HIST * sizeof(i16_t));
+	rs->hist_len = rs->taps / 2 - 1;
+	rs->pos = 0;
+	rs->frac = 0;
+}
+
+
+size_t rate_room(const audio_rate_t *rs)
+{
+	return RATE_HIST - (rs->hist_len - rs->pos);
+}
+
+
+size_t rate_push(audio_rate_t *rs, const i16_t *src, size_t frames)
+{
+	u32_t c, keep;
+	i16_t *h;
+	size_t i;
+
+	/* move what is still needed to the start */
+	if (rs->pos > 0) {
+		keep = rs->hist_len - rs->pos;
+		for (c = 0; c < rs->channels; c++) {
+			h = rs->hist + c * RATE_HIST;
+			memmove(h, h + rs->pos, keep * sizeof(i16_t));
+		}
+		rs->hist_len = keep;
+		rs->pos = 0;
+	}
+
+	frames = MIN(frames, RATE_HIST - rs->hist_len);
+	for (c = 0; c < rs->channels; c++) {
+		h = rs->hist + c * RATE_HIST + rs->hist_len;
+		for (i = 0; i < frames; i++)
+			h[i] = src[i * rs->channels + c];
+	}
+	rs->hist_len += frames;
+	return frames;
+}
+
+
+size_t rate_pull(audio_rate_t *rs, i16_t *dst, size_t frames)
+{
+	const i16_t *coef;
+	u32_t c;
+	i32_t v;
+	size_t n;
+
+	for (n = 0; n < frames && rs->pos + rs->taps <= rs->hist_len; n++) {
+		coef = rs->coef + (u64_t) rs->frac * rs->phases / rs->den * rs->taps;
+		for (c = 0; c < rs->channels; c++) {
+			v = rs->dot(rs->hist + c * RATE_HIST + rs->pos, coef, rs->taps);
+			v = (v + (1 << 14)) >> 15;
+			if (v > 32767) v = 32767;
+			if (v < -32768) v = -32768;
+			*dst++ = (i16_t) v;
+		}
+
+		rs->frac += rs->num;
+		rs->pos += rs->frac / rs->den;
+		rs->frac %= rs->den;
+	}
+	return n;
+}
+
+
+static u32_t gcd(u32_t a, u32_t b)
+{
+	u32_t t;
+
+	while (b != 0) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+
+/* sin(x), as a series on [-pi/2, pi/2]; good to far more bits than a
+ * coefficient has */
+static double sine(double x)
+{
+	double x2, term, sum;
+	int i;
+
+	x -= 2 * PI * (double) (long) (x / (2 * PI));
+	if (x > PI) x -= 2 * PI;
+	if (x < -PI) x += 2 * PI;
+	if (x > PI / 2) x = PI - x;
+	if (x < -PI / 2) x = -PI - x;
+
+	x2 = x * x;
+	term = sum = x;
+	for (i = 1; i < 12; i++) {
+		term = -term * x2 / ((2 * i) * (2 * i + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+
+static double cosine(double x)
+{
+	return sine(x + PI / 2);
+}
+
+
+/* One phase of the filter: the output t input frames after the middle
+ * tap, taps / 2 - 1. A Blackman window over the taps, scaled so that the
+ * coefficients add up to 1.0 in Q15 exactly. */
+static void make_phase(i16_t *coef, u32_t taps, double t, double fc)
+{
+	double h[RATE_MAX_TAPS], d, sum;
+	i32_t c, total;
+	u32_t i, big;
+
+	sum = 0;
+	for (i = 0; i < taps; i++) {
+		d = (double) i - (taps / 2 - 1) - t;
+		h[i] = fc;
+		if (d != 0) h[i] = sine(PI * fc * d) / (PI * d);
+		h[i] *= 0.42 + 0.5 * cosine(PI * d / (taps / 2)) +
+			0.08 * cosine(2 * PI * d / (taps / 2));
+		sum += h[i];
+	}
+
+	total = 0;
+	big = 0;
+	for (i = 0; i < taps; i++) {
+		d = h[i] / sum * 32768;
+		c = (i32_t) (d < 0 ? d - 0.5 : d + 0.5);
+		if (c > 32767) c = 32767;
+		coef[i] = (i16_t) c;
+		total += c;
+		if (coef[i] > coef[big]) big = i;
+	}
+	/* what the rounding lost goes to the largest one */
+	coef[big] += 32768 - total;
+}
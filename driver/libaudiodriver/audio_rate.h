@@ -0,0 +1,58 @@
+/*	audio_rate.h - sample rate conversion of the audio framework
+ *
+ * Plays a stream at a rate the device can't do at the one it can: every
+ * output frame is a windowed sinc filter over the input around it, with
+ * the filter taken from a table of phases. Samples and coefficients are
+ * signed 16 bit and the sums 32 bit, so no kernel rounds. The cost per
+ * input frame is fixed by the quality, see DSP_QUALITY_* in ioc_audio.h:
+ * it sets the taps per channel, which grow with the ratio when the
+ * stream is made slower, up to RATE_MAX_TAPS.
+ */
+
+#ifndef AUDIO_RATE_H
+#define AUDIO_RATE_H
+
+#include <minix/drivers.h>
+
+#define RATE_MIN			1000		/* rates a stream may have */
+#define RATE_MAX			192000
+#define RATE_MAX_PHASES		1024		/* more are rounded down to these */
+#define RATE_MAX_TAPS		64
+#define RATE_HIST			2048		/* input frames it can hold */
+
+typedef struct {
+	u32_t in_rate;					/* as given to rate_init() */
+	u32_t out_rate;
+	u32_t channels;
+	u32_t quality;					/* DSP_QUALITY_* */
+	u32_t num;						/* in_rate / out_rate, reduced */
+	u32_t den;
+	u32_t taps;						/* per phase, a multiple of 8 */
+	u32_t phases;
+	i16_t *coef;					/* phases x taps */
+	i16_t *hist;					/* RATE_HIST frames per channel */
+	u32_t hist_len;					/* frames in hist */
+	u32_t pos;						/* first frame of the next output */
+	u32_t frac;						/* and how far after it, in 1/den */
+	i32_t (*dot)(const i16_t *a, const i16_t *b, size_t n);
+} audio_rate_t;
+
+/* Set up the conversion of channels of signed 16 bit samples from one
+ * rate to the other. EINVAL for a rate out of range, ENOMEM if there is
+ * no memory for the tables. */
+int rate_init(audio_rate_t *rs, u32_t in_rate, u32_t out_rate,
+	u32_t channels, u32_t quality);
+void rate_free(audio_rate_t *rs);
+
+/* forget the input, as for a new stream */
+void rate_reset(audio_rate_t *rs);
+
+/* input frames rate_push() takes now */
+size_t rate_room(const audio_rate_t *rs);
+
+/* Hand over input frames, returns how many it took. Output can be pulled
+ * as soon as the frames after it are in. */
+size_t rate_push(audio_rate_t *rs, const i16_t *src, size_t frames);
+size_t rate_pull(audio_rate_t *rs, i16_t *dst, size_t frames);
+
+#endif /* AUDIO_RATE_H */
@@ -0,0 +1,59 @@
+/* This file contains the event trace of the audio framework. 
+ *
+ * The trace is a fixed ring of binary records that is only ever written 
+ * by the driver's own (single) thread, so recording an event takes no 
+ * locks: a cycle counter read and four stores. Old events are overwritten.
+ * Nothing is formatted here; the audiotrace command decodes the records.
+ */
+
+#include <minix/drivers.h>
+#include "audio_trace.h"
+
+#ifdef AUDIO_TRACE
+
+static struct audio_trace_rec trace_ring[AUDIO_TRACE_SIZE];
+static u32_t trace_seq;		/* sequence nr. of the next event */
+
+
+/* record an event */
+void audio_trace(int event, int sub_dev, u32_t arg)
+{
+	struct audio_trace_rec *rec;
+
+	rec = &trace_ring[trace_seq & (AUDIO_TRACE_SIZE - 1)];
+	read_tsc_64(&rec->tsc);
+	rec->event = event;
+	rec->sub_dev = sub_dev;
+	rec->arg = arg;
+	trace_seq++;
+}
+
+
+/* copy out the events from dump->next on, as many as fit */
+int audio_trace_dump(struct dsp_trace *dump)
+{
+	u32_t seq, oldest;
+
+	oldest = (trace_seq > AUDIO_TRACE_SIZE) ? 
+		trace_seq - AUDIO_TRACE_SIZE : 0;
+
+	seq = dump->next;
+	dump->lost = 0;
+	if (seq < oldest) {
+		dump->lost = oldest - seq;
+		seq = oldest;
+	}
+	if (seq > trace_seq) seq = trace_seq;
+
+	dump->count = 0;
+	while (seq != trace_seq && dump->count < AUDIO_TRACE_CHUNK) {
+		dump->rec[dump->count++] = 
+			trace_ring[seq & (AUDIO_TRACE_SIZE - 1)];
+		seq++;
+	}
+	dump->next = seq;
+	dump->usec_per_gtsc = tsc_64_to_micros((u64_t) 1000000000);
+	return OK;
+}
+
+#endif /* AUDIO_TRACE */
@@ -0,0 +1,25 @@
+/*	audio_trace.h - event trace of the audio framework
+ *
+ * Audio drivers built with -DAUDIO_TRACE record the events defined in
+ * ioc_audio.h in a ring in memory, which can be copied out with the
+ * DSPIOTRACE ioctl and decoded by audiotrace(1). Without AUDIO_TRACE
+ * the trace points compile away.
+ */
+
+#ifndef AUDIO_TRACE_H
+#define AUDIO_TRACE_H
+
+#include "ioc_audio.h"
+
+#ifdef AUDIO_TRACE
+#define TRACE(event, sub_dev, arg)	audio_trace((event), (sub_dev), (arg))
+
+void audio_trace(int event, int sub_dev, u32_t arg);
+int audio_trace_dump(struct dsp_trace *dump);
+#else
+/* arg is still mentioned, so variables kept only for tracing do not 
+   trigger warnings; it must not have side effects */
+#define TRACE(event, sub_dev, arg)	((void) (arg))
+#endif
+
+#endif /* AUDIO_TRACE_H */
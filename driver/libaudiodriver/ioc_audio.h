@@ -0,0 +1,273 @@
+/*	ioc_audio.h - ioctl command codes handled by the audio framework
+ *
+ * These complement the DSPIO* codes in <sys/ioc_sound.h>. They are not
+ * passed to the device specific part of a driver, but are served by
+ * libaudiodriver itself for every audio driver that is built on it.
+ */
+
+#ifndef _IOC_AUDIO_H
+#define _IOC_AUDIO_H
+
+#include <sys/ioccom.h>
+#include <minix/types.h>
+
+/* Memory mapped access to the dma ring, modelled on OSS/ALSA mmap mode.
+ * After DSPIOMMAP the client reads or writes the ring directly and
+ * tells the driver with DSPIOMMAPSYNC how many fragments it filled
+ * (playback) or consumed (capture). read() and write() fail with EBUSY
+ * as long as the ring is mapped. */
+struct dsp_mmap_info {
+	void *addr;				/* start of the ring in the client */
+	u32_t size;				/* size of the ring in bytes */
+	u32_t frag_size;		/* size of one fragment in bytes */
+	u32_t nr_frags;			/* nr. of fragments in the ring */
+};
+
+struct dsp_mmap_sync {
+	u32_t commit;			/* in: fragments filled or consumed */
+	u32_t app_frag;			/* out: next fragment for the client */
+	u32_t hw_frag;			/* out: fragment the hardware is at */
+	u32_t avail;			/* out: fragments free (playback) or
+							   recorded (capture) */
+	u32_t lost;				/* out: fragments overwritten before
+							   they were consumed (capture) */
+};
+
+#define DSPIOMMAP		_IOR ('s', 40, struct dsp_mmap_info)
+#define DSPIOMUNMAP		_IO  ('s', 41)
+#define DSPIOMMAPSYNC	_IOWR('s', 42, struct dsp_mmap_sync)
+
+/* Layout of the dma ring: count fragments ("periods") of size bytes each.
+ * Many small fragments give a low latency, a few large ones a low
+ * interrupt rate. The layout can only be changed before the first
+ * transfer and holds until the device is closed. DSPIOPERIODS with a
+ * count of 0 reports the current layout. */
+struct dsp_periods {
+	u32_t count;			/* nr. of fragments in the ring */
+	u32_t size;				/* size of one fragment in bytes */
+};
+
+/* Presets for DSPIOPROFILE */
+#define DSP_PROFILE_LOW_LATENCY	1	/* smallest fragments the device 
+									   allows */
+#define DSP_PROFILE_THROUGHPUT	2	/* two fragments, as large as 
+									   possible */
+#define DSP_LOW_LATENCY_FRAGS	8	/* nr. of fragments for low latency */
+
+#define DSPIOPERIODS	_IOWR('s', 43, struct dsp_periods)
+#define DSPIOPROFILE	_IOW ('s', 44, u32_t)
+
+/* Counters of the ioctl sub device, reset when it is opened. The times
+ * between interrupts only cover the periods the device was running. */
+struct dsp_stats {
+	u32_t interrupts;		/* interrupts handled */
+	u32_t frags_from_user;	/* fragments filled by write() */
+	u32_t frags_to_user;	/* fragments consumed by read() */
+	u32_t underruns;		/* playback paused for lack of data */
+	u32_t overruns;			/* capture data lost, buffers full */
+	u32_t pauses;			/* times the device was paused */
+	u32_t resumes;			/* times the device was resumed */
+	u32_t irq_gap_max;		/* longest time between interrupts, usec */
+	u32_t irq_gap_avg;		/* average time between interrupts, usec */
+	u32_t frags_buffered;	/* fragments recorded while no read was 
+							   waiting, moved to the extra buffers */
+	u32_t polls;			/* dma position polls, see DSPIOPOLL */
+};
+
+#define DSPIOSTATS		_IOR ('s', 45, struct dsp_stats)
+
+/* Event trace of the framework's hot path, only present in drivers built
+ * with AUDIO_TRACE. The ring keeps the last AUDIO_TRACE_SIZE events;
+ * DSPIOTRACE copies out up to AUDIO_TRACE_CHUNK of them at a time,
+ * starting at sequence nr. next or at the oldest event still there. */
+#define TRACE_IRQ			1	/* interrupt message received, arg: 
+								   mask of the cards in it */
+#define TRACE_INT_WRITE		2	/* playback fragment done, arg: fragments 
+								   left in the dma ring */
+#define TRACE_INT_READ		3	/* capture fragment done, arg: fragments 
+								   in the dma ring */
+#define TRACE_COPY_START	4	/* vectored safecopy, arg: bytes */
+#define TRACE_COPY_END		5	/* safecopy done, arg: result */
+#define TRACE_REPLY			6	/* request replied to, arg: status */
+#define TRACE_INT_SUM		7	/* driver's irq status, arg: status reg */
+#define TRACE_OPEN			8	/* arg: minor device */
+#define TRACE_CLOSE			9	/* arg: minor device */
+#define TRACE_POLL			10	/* timer poll, arg: fragments done */
+
+#define TRACE_NO_SUB_DEV	0xffff	/* event is not about one sub device */
+
+#define AUDIO_TRACE_SIZE	1024	/* events in the ring, a power of 2 */
+#define AUDIO_TRACE_CHUNK	256		/* events per DSPIOTRACE */
+
+struct audio_trace_rec {
+	u64_t tsc;				/* cpu cycle counter at the event */
+	u16_t event;			/* TRACE_* */
+	u16_t sub_dev;			/* sub device, or TRACE_NO_SUB_DEV */
+	u32_t arg;				/* depends on the event */
+};
+
+struct dsp_trace {
+	u32_t next;				/* in: first sequence nr. wanted;
+							   out: sequence nr. to ask for next */
+	u32_t count;			/* out: nr. of events in rec */
+	u32_t lost;				/* out: events overwritten before they
+							   could be copied out */
+	u32_t usec_per_gtsc;	/* out: microseconds per 10^9 tsc ticks */
+	struct audio_trace_rec rec[AUDIO_TRACE_CHUNK];
+};
+
+#define DSPIOTRACE		_IOWR('s', 46, struct dsp_trace)
+
+/* What capture does when the client falls behind and the dma ring and
+ * the extra buffers are full. With STOP the device stops until the next
+ * read; the others keep recording and drop data, which DSPIOLOST counts.
+ * Every open starts with DSP_OVERRUN_STOP. */
+#define DSP_OVERRUN_STOP		0	/* stop recording */
+#define DSP_OVERRUN_OVERWRITE	1	/* drop the oldest fragment */
+#define DSP_OVERRUN_SPILL		2	/* grow the extra buffers, up to 
+									   DSP_SPILL_MAX fragments; drop the 
+									   oldest fragment beyond that */
+#define DSP_SPILL_MAX			64
+
+/* Recorded data dropped since the device was opened, in mmap mode too.
+ * Divide bytes by the frame size of the stream for lost frames. */
+struct dsp_lost {
+	u32_t frags;			/* fragments dropped */
+	u32_t bytes;			/* bytes dropped */
+};
+
+#define DSPIOOVERRUN	_IOW ('s', 47, u32_t)
+#define DSPIOLOST		_IOR ('s', 48, struct dsp_lost)
+
+/* All parameters of a stream in one call, instead of DSPIOSIZE, 
+ * DSPIOSTEREO, DSPIORATE, DSPIOBITS and DSPIOSIGN one by one. The driver
+ * checks the whole set before it changes anything and fails with EINVAL
+ * if it can't do the format at all. The rate and the sign are set as 
+ * close as the device can get; on return all fields hold what was set.
+ * Only allowed before the first transfer. */
+struct dsp_params {
+	u32_t rate;				/* samples per second */
+	u32_t stereo;			/* 0 mono, 1 stereo */
+	u32_t bits;				/* bits per sample */
+	u32_t sign;				/* 0 unsigned, 1 signed samples */
+	u32_t frag_size;		/* bytes per fragment, 0 for the largest
+							   one the ring layout allows */
+};
+
+#define DSPIOPARAMS		_IOWR('s', 49, struct dsp_params)
+
+/* Where a stream is, for A/V sync: the data the hardware played or 
+ * recorded since the stream started, read from the dma engine itself, 
+ * and the time it was read. The count never goes back; it starts at 0
+ * when the device starts, and again after capture stopped on an 
+ * overrun. DSPIOSAMPLESINBUF reports delay in sample frames. */
+struct dsp_position {
+	u64_t bytes;			/* bytes played or recorded */
+	u64_t frames;			/* the same in sample frames */
+	u64_t tsc;				/* cpu cycle counter when the dma 
+							   position was read */
+	u64_t usec;				/* the same in usecs since boot */
+	u32_t delay;			/* playback: bytes written but not played
+							   yet; capture: bytes recorded but not 
+							   read yet */
+	u32_t frame_size;		/* bytes per sample frame */
+};
+
+#define DSPIOPOSITION	_IOR ('s', 50, struct dsp_position)
+
+/* Poll the dma position every so many milliseconds instead of taking an
+ * interrupt for every fragment; 0 goes back to interrupts. One poll 
+ * handles all fragments done since the previous one, so small fragments
+ * cost no more interrupts, and a polled sub device may have more 
+ * fragments than the hardware can interrupt on. The interval is rounded
+ * up to clock ticks and must stay well below the time the whole ring 
+ * takes, or the poll misses a lap. A polled playback that runs dry is 
+ * stopped, not paused, and restarts at the head of the ring. Only while
+ * the sub device is idle; every open starts with interrupts. */
+#define DSPIOPOLL		_IOW ('s', 51, u32_t)
+
+/* End of a playback stream. DSPIODRAIN returns once all that was written
+ * has been played, the last incomplete fragment padded with silence; 
+ * with O_NONBLOCK it returns EAGAIN until then. DSPIODROP throws away 
+ * what is buffered, in either direction, and stops the device at once; 
+ * a drain or write that waits returns early. The next read or write 
+ * starts the device again. */
+#define DSPIODRAIN		_IO  ('s', 52)
+#define DSPIODROP		_IO  ('s', 53)
+
+/* Link the playback and the capture channel of a special file that has 
+ * both, for full duplex at a fixed offset: a read then waits for the 
+ * first fragment written, which starts both dma engines together, with
+ * one register write where the hardware allows it. 0 unlinks them. Only
+ * while both are idle; every open starts unlinked. A channel restarted
+ * later, e.g. after an overrun, starts on its own and the offset is 
+ * lost; DSPIOPOSITION of both tells the new one. */
+#define DSPIOLINK		_IOW ('s', 54, u32_t)
+
+/* The format of the samples a client writes, when it is not the one the
+ * device plays: the framework converts them on the way into the dma 
+ * ring, see audio_conv.h. The device format is still set with 
+ * DSPIOPARAMS or the single ioctls, and may be set after this. Only 
+ * before the first write; every open starts with DSP_FMT_NATIVE. Each 
+ * writer of a mixed minor has a format of its own, a mapped ring has 
+ * none. The byte counts of DSPIOPOSITION and DSPIOSAMPLESINBUF are the 
+ * device's. */
+#define DSP_FMT_NATIVE	0		/* as the device plays it */
+#define DSP_FMT_U8		1
+#define DSP_FMT_S8		2
+#define DSP_FMT_S16_LE	3
+#define DSP_FMT_S16_BE	4
+#define DSP_FMT_U16_LE	5
+#define DSP_FMT_U16_BE	6
+#define DSP_FMT_S24_LE	7		/* packed in 3 bytes */
+#define DSP_FMT_S32_LE	8
+#define DSP_FMT_FLOAT	9		/* 32 bit IEEE, -1.0 up to 1.0 */
+
+struct dsp_format {
+	u32_t format;			/* DSP_FMT_* */
+	u32_t channels;			/* 1 or 2 */
+};
+
+#define DSPIOFORMAT		_IOW ('s', 55, struct dsp_format)
+
+/* A rate the device can't do is not refused: DSPIOPARAMS reports the rate
+ * asked for, and the framework resamples what is written to the rate the 
+ * device was set to, see audio_rate.h. This picks the filter, from a few
+ * taps to more taps and a flatter passband; the CPU time it takes grows 
+ * with its taps, which grow with the ratio when the rate goes down. It 
+ * is used from the next stream on; every open starts with 
+ * DSP_QUALITY_GOOD. DSPIOPOSITION counts the frames the device plays, 
+ * and a stream ends, at a drain or close, without the last few frames 
+ * the filter looks ahead for. Capture and the writers of a mixed minor 
+ * are not resampled. */
+#define DSP_QUALITY_FAST	0		/* 8 taps */
+#define DSP_QUALITY_GOOD	1		/* 16 taps */
+#define DSP_QUALITY_BEST	2		/* 32 taps */
+
+#define DSPIOQUALITY	_IOW ('s', 56, u32_t)
+
+/* Gain of a playback stream in software: the framework scales the 
+ * samples on their way into the dma ring and never touches the mixer of
+ * the device. Left and right go up to DSP_GAIN_MAX, louder samples are
+ * clipped; a device with one channel takes left. The gain moves to the
+ * new one in a straight line over ramp ms, up to DSP_GAIN_MAX_RAMP, or
+ * DSP_GAIN_RAMP if it is 0, so that a change doesn't click. It starts 
+ * with the next sample written, not with the one the device plays now.
+ * DSPIOMUTE ramps to silence, and back to the gain for 0. Each writer of
+ * a mixed minor has a gain of its own, a mapped ring has none. Every 
+ * open starts at DSP_GAIN_UNITY, not muted. */
+struct dsp_gain {
+	u32_t left;				/* DSP_GAIN_UNITY is as written */
+	u32_t right;
+	u32_t ramp;				/* ms */
+};
+
+#define DSP_GAIN_UNITY		0x10000
+#define DSP_GAIN_MAX		(4 * DSP_GAIN_UNITY)
+#define DSP_GAIN_RAMP		10		/* ms */
+#define DSP_GAIN_MAX_RAMP	10000
+
+#define DSPIOGAIN		_IOW ('s', 57, struct dsp_gain)
+#define DSPIOMUTE		_IOW ('s', 58, u32_t)
+
+#endif /* _IOC_AUDIO_H */
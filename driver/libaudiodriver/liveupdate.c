@@ -1,4 +1,5 @@
 #include <minix/audio_fw.h>
+#include "audio_fw_ext.h"
 
 /*
  * - From audio_fw.h:
@@ -31,6 +32,10 @@ static void load_state_info(void)
 
       found_pending = (is_read_pending && is_write_pending);
   }
+
+  /* Callers the framework holds back without a RevivePending. */
+  if (fw_reply_pending(READ_DMA)) is_read_pending = TRUE;
+  if (fw_reply_pending(WRITE_DMA)) is_write_pending = TRUE;
 }
 
 /* Custom states definition. */
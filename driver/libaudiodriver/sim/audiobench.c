@@ -0,0 +1,245 @@
+/* audiobench - benchmark the audio framework on the simulated sound card
+ *
+ * Usage: audiobench [-c] [-t ms] [-w workload] [-p n:size]...
+ *	-c		print comma separated values instead of a table
+ *	-t ms		virtual length of each run (default 10000)
+ *	-w name		only run this workload
+ *	-p n:size	ring layout to run with, instead of the default set
+ *
+ * Every workload runs once for each ring layout, 44.1 kHz 16 bit stereo:
+ *	steady		a writer that keeps the buffers full, one fragment
+ *			per write
+ *	bursty		a writer that writes the whole ring at once and then
+ *			sleeps for a random time, on average as long as the
+ *			ring plays
+ *	duplex		a steady writer and a steady reader at the same time
+ *	openclose	open, write 4 fragments, close and drain, 100 times
+ *
+ * For each run it prints the fragments the device played or recorded per
+ * second of virtual time, the host time and cycles the framework spent
+ * per fragment, percentiles of the host time from the start of an
+ * interrupt to the replies sent from it, and the underruns and overruns.
+ * The counts are the same on every host, the times are not.
+ */
+
+#include <unistd.h>
+#include "sim.h"
+
+#define BENCH_RATE		44100
+#define BENCH_BYTE_RATE	(BENCH_RATE * 2 * 2)
+#define OPENCLOSE_RUNS	100
+#define MAX_LAYOUTS		16
+
+struct workload {
+	char *name;
+	void (*run)(struct dsp_periods *p, u64_t length, struct sim_client *c,
+		int *nr);
+};
+
+static void steady(struct dsp_periods *p, u64_t length, struct sim_client *c,
+	int *nr);
+static void bursty(struct dsp_periods *p, u64_t length, struct sim_client *c,
+	int *nr);
+static void duplex(struct dsp_periods *p, u64_t length, struct sim_client *c,
+	int *nr);
+static void openclose(struct dsp_periods *p, u64_t length,
+	struct sim_client *c, int *nr);
+static void client(struct sim_client *c, int write, struct dsp_periods *p);
+static void usage(void);
+
+static struct workload workloads[] = {
+	{ "steady",		steady },
+	{ "bursty",		bursty },
+	{ "duplex",		duplex },
+	{ "openclose",	openclose },
+};
+#define NR_WORKLOADS	(sizeof(workloads) / sizeof(workloads[0]))
+
+static struct dsp_periods def_layouts[] = {
+	{ 2, 32768 },
+	{ 4, 16384 },
+	{ 8, 4096 },
+	{ 16, 2048 },
+	{ 32, 1024 },
+};
+
+
+int main(int argc, char **argv)
+{
+	int ch, i, csv, nr, nr_layouts;
+	unsigned w;
+	char *only;
+	u64_t length, start, frags;
+	u32_t underruns, overruns;
+	struct dsp_periods layouts[MAX_LAYOUTS];
+	struct sim_client clients[2];
+
+	csv = FALSE;
+	only = NULL;
+	length = 10000;
+	nr_layouts = 0;
+	while ((ch = getopt(argc, argv, "ct:w:p:")) != -1) {
+		switch (ch) {
+		case 'c': csv = TRUE; break;
+		case 't': length = strtoull(optarg, NULL, 10); break;
+		case 'w': only = optarg; break;
+		case 'p':
+			if (nr_layouts == MAX_LAYOUTS || sscanf(optarg, "%u:%u",
+					&layouts[nr_layouts].count,
+					&layouts[nr_layouts].size) != 2) {
+				usage();
+			}
+			nr_layouts++;
+			break;
+		default: usage();
+		}
+	}
+	if (optind != argc || length == 0) usage();
+	length *= 1000000;
+
+	if (nr_layouts == 0) {
+		nr_layouts = sizeof(def_layouts) / sizeof(def_layouts[0]);
+		memcpy(layouts, def_layouts, sizeof(def_layouts));
+	}
+
+	if (sim_init() != OK) {
+		fprintf(stderr, "audiobench: framework failed to start\n");
+		return 2;
+	}
+
+	if (csv) {
+		printf("workload,frags,frag_size,frags_per_s,ns_per_frag,"
+			"cycles_per_frag,lat_p50_ns,lat_p90_ns,lat_p99_ns,"
+			"lat_max_ns,underruns,overruns\n");
+	} else {
+		printf("%-10s %-8s %8s %8s %9s %7s %7s %7s %7s %5s %5s\n",
+			"workload", "ring", "frag/s", "ns/frag", "cyc/frag",
+			"p50 ns", "p90 ns", "p99 ns", "max ns", "under", "over");
+	}
+
+	for (w = 0; w < NR_WORKLOADS; w++) {
+		if (only != NULL && strcmp(only, workloads[w].name) != 0) continue;
+
+		for (i = 0; i < nr_layouts; i++) {
+			sim_reset_stats();
+			start = sim_now;
+			memset(clients, 0, sizeof(clients));
+			nr = 0;
+			workloads[w].run(&layouts[i], length, clients, &nr);
+
+			underruns = overruns = 0;
+			for (ch = 0; ch < nr; ch++) {
+				underruns += clients[ch].stats.underruns;
+				overruns += clients[ch].stats.overruns;
+				if (clients[ch].errors > 0 ||
+						clients[ch].gaps > clients[ch].stats.overruns) {
+					printf("%s %ux%u: errors in the data\n",
+						workloads[w].name, layouts[i].count,
+						layouts[i].size);
+					return 1;
+				}
+			}
+			if (sim_stats.play_errors > 0) {
+				printf("%s %ux%u: %llu bytes played wrong\n",
+					workloads[w].name, layouts[i].count, layouts[i].size,
+					(unsigned long long) sim_stats.play_errors);
+				return 1;
+			}
+
+			frags = sim_stats.frags > 0 ? sim_stats.frags : 1;
+			printf(csv ? "%s,%u,%u,%.1f,%llu,%llu,%llu,%llu,%llu,%llu,"
+					"%u,%u\n" :
+				"%-10s %3ux%-5u %8.1f %8llu %9llu %7llu %7llu %7llu "
+					"%7llu %5u %5u\n",
+				workloads[w].name, layouts[i].count, layouts[i].size,
+				(double) sim_stats.frags * SIM_NS / (sim_now - start),
+				(unsigned long long) (sim_stats.host_ns / frags),
+				(unsigned long long) (sim_stats.host_cycles / frags),
+				(unsigned long long) sim_latency_pct(50),
+				(unsigned long long) sim_latency_pct(90),
+				(unsigned long long) sim_latency_pct(99),
+				(unsigned long long) sim_latency_pct(100),
+				underruns, overruns);
+		}
+	}
+
+	sim_shutdown();
+	return 0;
+}
+
+
+static void client(struct sim_client *c, int write, struct dsp_periods *p)
+{
+	c->minor = write ? SIM_DAC : SIM_ADC;
+	c->write = write;
+	c->rate = BENCH_RATE;
+	c->stereo = TRUE;
+	c->bits = 16;
+	c->periods = *p;
+	c->chunk = p->size;
+	c->start = sim_now;
+}
+
+
+static void steady(struct dsp_periods *p, u64_t length, struct sim_client *c,
+	int *nr)
+{
+	client(&c[0], TRUE, p);
+	*nr = 1;
+	sim_run(c, *nr, sim_now + length);
+}
+
+
+static void bursty(struct dsp_periods *p, u64_t length, struct sim_client *c,
+	int *nr)
+{
+	client(&c[0], TRUE, p);
+	c[0].chunk = p->count * p->size;
+	c[0].jitter = 2 * (u64_t) c[0].chunk * SIM_NS / BENCH_BYTE_RATE;
+	c[0].seed = 1;
+	*nr = 1;
+	sim_run(c, *nr, sim_now + length);
+}
+
+
+static void duplex(struct dsp_periods *p, u64_t length, struct sim_client *c,
+	int *nr)
+{
+	client(&c[0], TRUE, p);
+	client(&c[1], FALSE, p);
+	*nr = 2;
+	sim_run(c, *nr, sim_now + length);
+}
+
+
+/* the counters of all runs are added up in the first client */
+static void openclose(struct dsp_periods *p, u64_t length,
+	struct sim_client *c, int *nr)
+{
+	int i;
+	struct sim_client run;
+	struct dsp_stats sum;
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < OPENCLOSE_RUNS; i++) {
+		memset(&run, 0, sizeof(run));
+		client(&run, TRUE, p);
+		run.total = 4 * (u64_t) p->size;
+		sim_run(&run, 1, sim_now + length);
+
+		sum.underruns += run.stats.underruns;
+		sum.overruns += run.stats.overruns;
+		c[0].errors += run.errors;
+		c[0].gaps += run.gaps;
+	}
+	c[0].stats = sum;
+	*nr = 1;
+}
+
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: audiobench [-c] [-t ms] [-w workload] "
+		"[-p n:size]...\n");
+	exit(2);
+}
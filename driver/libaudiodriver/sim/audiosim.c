@@ -0,0 +1,293 @@
+/* audiosim - run the audio framework against a simulated sound card
+ *
+ * Usage: audiosim [options]
+ *	-t ms		length of the run (default 5000)
+ *	-r rate		sample rate (default 44100)
+ *	-c chans	1 or 2 channels (default 2)
+ *	-b bits		8 or 16 bits (default 16)
+ *	-d bytes	size of the dma buffer (default 65536)
+ *	-n frags	nr. of dma fragments the driver sets up (default 2)
+ *	-m bytes	smallest fragment size (default 1024)
+ *	-x bufs		nr. of extra buffers for recording (default 4)
+ *	-p n:size	lay out the ring as n fragments of size bytes
+ *	-k bytes	bytes per read or write (default 8192)
+ *	-l bytes	close after this many bytes (default: at the end)
+ *	-E how		how a writer ends its stream after -l bytes: close
+ *			(default), drain or drop
+ *	-T usec		time between a reply and the next request (default 0)
+ *	-s at:len	stall the client once, at ms for len ms
+ *	-R		record instead of play
+ *	-D		play and record at the same time
+ *	-L		as -D, on one open of the duplex minor with DSPIOLINK
+ *	-a ms		with -D or -L, start the writer ms after the reader
+ *	-M n		n writers mixed on one minor; the first one plays the 
+ *			stream the device checks, the others silence
+ *	-F fmt		write in fmt and have the framework convert it, see 
+ *			DSPIOFORMAT: u8, s8, s16le, s16be, u16le, u16be, s24, 
+ *			s32 or float; the 8 bit ones with -b 8 only
+ *	-G ms		writers set a gain of 1.0 after ms, see DSPIOGAIN
+ *	-N		use non-blocking reads and writes
+ *	-S		as -N, but wait in select() when nothing can be done
+ *	-O policy	what capture does when it overruns: stop (default), 
+ *			overwrite or spill
+ *	-P		check the playback position before every write
+ *	-i ms		poll the dma position every ms instead of interrupts
+ *	-u n		fail unless there were exactly n underruns
+ *	-o n		fail unless there were exactly n overruns
+ *	-C n		n cards, each with its own irq and the same clients
+ *			(default 1)
+ *
+ * The run is in virtual time and gives the same counts on every host;
+ * only the time spent in the framework is measured on the host.
+ */
+
+#include <unistd.h>
+#include "sim.h"
+
+static void usage(void);
+static u32_t format_nr(const char *name);
+static void report(struct sim_client *c, u64_t length);
+
+
+int main(int argc, char **argv)
+{
+	int ch, i, c, n, nr, mix, duplex, link, record, fail;
+	long underruns, overruns;
+	u64_t length, after;
+	u64_t frags;
+	struct sim_client clients[(SIM_MIX_CLIENTS + 1) * SIM_MAX_CARDS], proto;
+
+	memset(&proto, 0, sizeof(proto));
+	proto.rate = 44100;
+	proto.stereo = TRUE;
+	proto.bits = 16;
+	proto.chunk = 8192;
+	length = 5000;
+	duplex = link = record = FALSE;
+	mix = 0;
+	after = 0;
+	underruns = overruns = -1;
+
+	while ((ch = getopt(argc, argv, 
+			"t:r:c:b:d:n:m:x:p:k:l:E:T:s:RDLa:M:F:G:NSO:Pi:u:o:C:")) != -1) {
+		switch (ch) {
+		case 't': length = strtoull(optarg, NULL, 10); break;
+		case 'r': proto.rate = atoi(optarg); break;
+		case 'c': proto.stereo = (atoi(optarg) == 2); break;
+		case 'b': proto.bits = atoi(optarg); break;
+		case 'd': sim_dev_conf.dma_size = atoi(optarg); break;
+		case 'n': sim_dev_conf.nr_frags = atoi(optarg); break;
+		case 'm': sim_dev_conf.min_frag = atoi(optarg); break;
+		case 'x': sim_dev_conf.nr_extra = atoi(optarg); break;
+		case 'p':
+			if (sscanf(optarg, "%u:%u", &proto.periods.count,
+					&proto.periods.size) != 2) usage();
+			break;
+		case 'k': proto.chunk = atoi(optarg); break;
+		case 'l': proto.total = strtoull(optarg, NULL, 10); break;
+		case 'E':
+			if (strcmp(optarg, "close") == 0)
+				proto.end = SIM_END_CLOSE;
+			else if (strcmp(optarg, "drain") == 0)
+				proto.end = SIM_END_DRAIN;
+			else if (strcmp(optarg, "drop") == 0)
+				proto.end = SIM_END_DROP;
+			else
+				usage();
+			break;
+		case 'T': proto.think = strtoull(optarg, NULL, 10) * 1000; break;
+		case 's': {
+			unsigned long long at, len;
+
+			if (sscanf(optarg, "%llu:%llu", &at, &len) != 2) usage();
+			proto.stall_at = at * 1000000;
+			proto.stall_len = len * 1000000;
+			break;
+		}
+		case 'R': record = TRUE; break;
+		case 'D': duplex = TRUE; break;
+		case 'L': duplex = link = TRUE; break;
+		case 'a': after = strtoull(optarg, NULL, 10) * 1000000; break;
+		case 'M':
+			mix = atoi(optarg);
+			if (mix < 1 || mix > SIM_MIX_CLIENTS) usage();
+			break;
+		case 'F': proto.format = format_nr(optarg); break;
+		case 'G': proto.gain_at = strtoull(optarg, NULL, 10) * 1000000; break;
+		case 'N': proto.nonblock = TRUE; break;
+		case 'S': proto.nonblock = proto.select = TRUE; break;
+		case 'O':
+			if (strcmp(optarg, "stop") == 0) 
+				proto.overrun = DSP_OVERRUN_STOP;
+			else if (strcmp(optarg, "overwrite") == 0)
+				proto.overrun = DSP_OVERRUN_OVERWRITE;
+			else if (strcmp(optarg, "spill") == 0)
+				proto.overrun = DSP_OVERRUN_SPILL;
+			else
+				usage();
+			break;
+		case 'P': proto.position = TRUE; break;
+		case 'i': proto.poll = atoi(optarg); break;
+		case 'u': underruns = atol(optarg); break;
+		case 'o': overruns = atol(optarg); break;
+		case 'C':
+			sim_dev_conf.nr_cards = atoi(optarg);
+			if (sim_dev_conf.nr_cards < 1 ||
+					sim_dev_conf.nr_cards > SIM_MAX_CARDS) usage();
+			break;
+		default: usage();
+		}
+	}
+	if (optind != argc || proto.chunk == 0) usage();
+
+	if (sim_init() != OK) {
+		fprintf(stderr, "audiosim: framework failed to start\n");
+		return 2;
+	}
+
+	nr = 0;
+	if (mix > 0) {
+		/* the first one sets up the format while it is still alone */
+		for (i = 0; i < mix; i++) {
+			clients[nr] = proto;
+			clients[nr].minor = SIM_MIX;
+			clients[nr].write = TRUE;
+			clients[nr].start = after;
+			if (i > 0) {
+				clients[nr].silent = TRUE;
+				clients[nr].format = DSP_FMT_NATIVE;
+				clients[nr].rate = 0;
+				clients[nr].poll = 0;
+				clients[nr].periods.count = 0;
+				clients[nr].total = 0;
+			}
+			nr++;
+		}
+	} else if (!record || duplex) {
+		clients[nr] = proto;
+		clients[nr].minor = link ? SIM_DUPLEX : SIM_DAC;
+		clients[nr].link = link;
+		clients[nr].write = TRUE;
+		clients[nr].start = after;
+		nr++;
+	}
+	if (record || duplex) {
+		clients[nr] = proto;
+		clients[nr].minor = link ? SIM_DUPLEX : SIM_ADC;
+		clients[nr].link = link;
+		nr++;
+	}
+
+	/* the other cards get the same, on their own minors */
+	n = nr;
+	for (c = 1; c < sim_dev_conf.nr_cards; c++) {
+		for (i = 0; i < n; i++) {
+			clients[nr] = clients[i];
+			clients[nr].card = c;
+			clients[nr].minor = SIM_MINOR(c, clients[i].minor);
+			nr++;
+		}
+	}
+
+	length *= 1000000;
+	sim_run(clients, nr, length);
+
+	fail = (sim_stats.play_errors > 0);
+	if (sim_stats.lu_errors > 0) {
+		printf("live update: %llu steps with the wrong state\n",
+			(unsigned long long) sim_stats.lu_errors);
+		fail = TRUE;
+	}
+	for (i = 0; i < nr; i++) {
+		report(&clients[i], length);
+		if (clients[i].errors > 0) fail = TRUE;
+		/* every overrun may break the recorded stream once */
+		if (clients[i].gaps > clients[i].stats.overruns) fail = TRUE;
+		if (underruns >= 0 && clients[i].write &&
+				clients[i].stats.underruns != underruns) {
+			printf("expected %ld underruns\n", underruns);
+			fail = TRUE;
+		}
+		if (overruns >= 0 && !clients[i].write &&
+				clients[i].stats.overruns != overruns) {
+			printf("expected %ld overruns\n", overruns);
+			fail = TRUE;
+		}
+	}
+
+	if (duplex) {
+		printf("duplex: start skew %llu usec\n", 
+			(unsigned long long) (sim_stats.start_skew / 1000));
+		/* linked, both start in the same drv_start_linked() */
+		if (link && sim_stats.start_skew != 0) fail = TRUE;
+	}
+
+	frags = sim_stats.frags > 0 ? sim_stats.frags : 1;
+	printf("device: %llu fragments, %llu irqs, %llu play errors\n",
+		(unsigned long long) sim_stats.frags,
+		(unsigned long long) sim_stats.irqs,
+		(unsigned long long) sim_stats.play_errors);
+	printf("framework: %llu calls, %llu copies, %llu ns/fragment, "
+		"%llu cycles/fragment\n",
+		(unsigned long long) sim_stats.calls,
+		(unsigned long long) sim_stats.copies,
+		(unsigned long long) (sim_stats.host_ns / frags),
+		(unsigned long long) (sim_stats.host_cycles / frags));
+
+	sim_shutdown();
+	printf("%s\n", fail ? "FAIL" : "ok");
+	return fail ? 1 : 0;
+}
+
+
+static void report(struct sim_client *c, u64_t length)
+{
+	struct dsp_stats *s;
+
+	s = &c->stats;
+	if (sim_dev_conf.nr_cards > 1) printf("card %d ", c->card);
+	printf("%s: %llu bytes in %llu ms, %llu requests, %llu EAGAIN, "
+		"%llu errors, %llu gaps\n",
+		c->write ? "play" : "record",
+		(unsigned long long) c->done,
+		(unsigned long long) (length / 1000000),
+		(unsigned long long) c->requests,
+		(unsigned long long) c->eagain,
+		(unsigned long long) c->errors,
+		(unsigned long long) c->gaps);
+	printf("  interrupts %u, fragments %u, underruns %u, overruns %u, "
+		"pauses %u, resumes %u, irq gap avg %u max %u usec, polls %u\n",
+		s->interrupts, c->write ? s->frags_from_user : s->frags_to_user,
+		s->underruns, s->overruns, s->pauses, s->resumes,
+		s->irq_gap_avg, s->irq_gap_max, s->polls);
+	if (!c->write) {
+		printf("  lost %u fragments, %u bytes, %u fragments buffered\n",
+			c->lost.frags, c->lost.bytes, s->frags_buffered);
+	}
+}
+
+
+static u32_t format_nr(const char *name)
+{
+	static const char *names[] = { "native", "u8", "s8", "s16le", "s16be", 
+		"u16le", "u16be", "s24", "s32", "float" };
+	u32_t i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcmp(name, names[i]) == 0) return i;
+	}
+	usage();
+	return 0;
+}
+
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: audiosim [-RDLNSP] [-t ms] [-r rate] [-c chans] "
+		"[-b bits] [-d bytes]\n"
+		"\t[-n frags] [-m bytes] [-x bufs] [-p n:size] [-k bytes] "
+		"[-l bytes] [-E how]\n"
+		"\t[-a ms] [-M writers] [-F fmt] [-G ms] [-T usec] [-s at:len]\n"
+		"\t[-O policy] [-i ms] [-u underruns] [-o overruns] [-C cards]\n");
+	exit(2);
+}
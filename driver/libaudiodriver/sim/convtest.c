@@ -0,0 +1,185 @@
+/* convtest - check the sample format conversion of the audio framework
+ *
+ * Usage: convtest
+ *
+ * Converts pseudo random samples, and for floats the special values as
+ * well, from every DSP_FMT_* format and channel count to every format a
+ * device plays, once with each set of kernels that is built in. Every
+ * result must be the same, bit for bit, as the one worked out here one
+ * sample at a time. The AVX2 kernels are only built with e.g.
+ * CFLAGS=-mavx2; make check does that too if the host has them.
+ */
+
+#include <math.h>
+#include "sim.h"
+#include "audio_conv.h"
+
+#define MAX_FRAMES		(3 * CONV_BLOCK + 19)	/* several blocks and a
+												   partial vector */
+
+static u32_t seed = 1;
+static u8_t src[MAX_FRAMES * CONV_MAX_FRAME];
+static u8_t dst[MAX_FRAMES * 4 + 1], want[MAX_FRAMES * 4];
+
+static void fill(u32_t format, size_t bytes);
+static int sample(u32_t format, const u8_t *p);
+static void expect(u32_t format, u32_t in_channels, u32_t bits, u32_t sign,
+	u32_t out_channels, size_t frames);
+static int check(u32_t format, u32_t in_channels, u32_t bits, u32_t sign,
+	u32_t out_channels, size_t frames);
+
+
+int main(void)
+{
+	static const size_t lengths[] = { 0, 1, 7, 15, 16, 17, 33,
+		CONV_BLOCK, MAX_FRAMES };
+	u32_t format, in_channels, out_channels, bits, sign;
+	unsigned int l, checks;
+	int fail;
+
+	fail = FALSE;
+	checks = 0;
+	for (format = DSP_FMT_U8; format <= DSP_FMT_FLOAT; format++)
+	for (in_channels = 1; in_channels <= 2; in_channels++)
+	for (out_channels = 1; out_channels <= 2; out_channels++)
+	for (bits = 8; bits <= 16; bits += 8)
+	for (sign = 0; sign <= 1; sign++)
+	for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+		fill(format, lengths[l] * conv_frame_size(format, in_channels));
+		expect(format, in_channels, bits, sign, out_channels, lengths[l]);
+		SIM_EACH_KERNELS {
+			if (check(format, in_channels, bits, sign, out_channels,
+					lengths[l]) != OK) {
+				fail = TRUE;
+			}
+			checks++;
+		}
+	}
+
+	if (conv_frame_size(DSP_FMT_NATIVE, 2) != 0 ||
+			conv_frame_size(DSP_FMT_FLOAT + 1, 2) != 0 ||
+			conv_frame_size(DSP_FMT_S16_LE, 3) != 0) {
+		printf("conv_frame_size() takes a format it can't do\n");
+		fail = TRUE;
+	}
+
+	return sim_test_report(checks, "conversions", fail);
+}
+
+
+static void fill(u32_t format, size_t bytes)
+{
+	static const float special[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f,
+		-0.5f, 2.0f, -2.0f, 1e-10f, -1e-10f,
+		0.5f / 32768, -0.5f / 32768, 1.5f / 32768, -1.5f / 32768,
+		0x1.fffffep-2f / 32768, -0x1.fffffep-2f / 32768,
+		32767.5f / 32768, -32768.5f / 32768,
+		INFINITY, -INFINITY, NAN, -NAN };
+	float *f;
+	size_t i;
+
+	for (i = 0; i < bytes; i++)
+		src[i] = (u8_t) (sim_rand(&seed) >> 8);
+	if (format != DSP_FMT_FLOAT) return;
+
+	/* floats in the range a client uses, and every special one */
+	f = (float *) src;
+	for (i = 0; i < bytes / sizeof(float); i++) {
+		if (i < sizeof(special) / sizeof(special[0]))
+			f[i] = special[i];
+		else if (i % 8 == 0)
+			f[i] = (float) (i32_t) (sim_rand(&seed) >> 8) / (1 << 23);
+		else
+			f[i] = (float) ((i32_t) (sim_rand(&seed) >> 8) - (1 << 23)) /
+				(1 << 23);
+	}
+}
+
+
+/* one sample as signed 16 bit */
+static int sample(u32_t format, const u8_t *p)
+{
+	double v;
+	float f;
+
+	switch(format) {
+		case DSP_FMT_U8:		return (p[0] - 128) * 256;
+		case DSP_FMT_S8:		return (signed char) p[0] * 256;
+		case DSP_FMT_S16_LE:	return (i16_t) (p[0] | p[1] << 8);
+		case DSP_FMT_S16_BE:	return (i16_t) (p[1] | p[0] << 8);
+		case DSP_FMT_U16_LE:	return (p[0] | p[1] << 8) - 32768;
+		case DSP_FMT_U16_BE:	return (p[1] | p[0] << 8) - 32768;
+		case DSP_FMT_S24_LE:	return (i16_t) (p[1] | p[2] << 8);
+		case DSP_FMT_S32_LE:	return (i16_t) (p[2] | p[3] << 8);
+		default:
+			memcpy(&f, p, sizeof(f));
+			if (isnan(f)) return 0;
+			v = (double) f * 32768;
+			if (v < -32768) return -32768;
+			if (v > 32767) return 32767;
+			return (int) (v < 0 ? ceil(v - 0.5) : floor(v + 0.5));
+	}
+}
+
+
+static void expect(u32_t format, u32_t in_channels, u32_t bits, u32_t sign,
+	u32_t out_channels, size_t frames)
+{
+	u32_t size, c;
+	size_t i;
+	int s[2], v;
+	u8_t *p;
+
+	size = conv_frame_size(format, 1);
+	p = want;
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c < in_channels; c++)
+			s[c] = sample(format, src + (i * in_channels + c) * size);
+		if (in_channels == 1)
+			s[1] = s[0];
+		else if (out_channels == 1)
+			s[0] = (int) floor((s[0] + s[1]) / 2.0);
+
+		for (c = 0; c < out_channels; c++) {
+			v = s[c];
+			if (bits == 8) {
+				v = (v >> 8) + (sign ? 0 : 128);
+				*p++ = (u8_t) v;
+			} else {
+				v += sign ? 0 : 32768;
+				*p++ = (u8_t) v;
+				*p++ = (u8_t) (v >> 8);
+			}
+		}
+	}
+}
+
+
+static int check(u32_t format, u32_t in_channels, u32_t bits, u32_t sign,
+	u32_t out_channels, size_t frames)
+{
+	audio_conv_t cv;
+	size_t i;
+
+	if (conv_init(&cv, format, in_channels, bits, sign, out_channels)
+			!= OK) {
+		printf("format %u, %u channels to %u bits %s, %u channels: "
+			"not done\n", format, in_channels, bits,
+			sign ? "signed" : "unsigned", out_channels);
+		return EINVAL;
+	}
+
+	memset(dst, 0xa5, sizeof(dst));
+	conv_frames(&cv, dst, src, frames);
+	for (i = 0; i < frames * cv.out_frame; i++) {
+		if (dst[i] != want[i]) break;
+	}
+	if (i == frames * cv.out_frame && dst[i] == 0xa5) return OK;
+
+	printf("format %u, %u channels to %u bits %s, %u channels, "
+		"%zu frames, kernels %d: byte %zu is %02x, not %02x\n",
+		format, in_channels, bits, sign ? "signed" : "unsigned",
+		out_channels, frames, conv_simd, i, dst[i],
+		i < frames * cv.out_frame ? want[i] : 0xa5);
+	return EINVAL;
+}
@@ -0,0 +1,476 @@
+/* This file contains a simulated sound card behind the drv_* interface of
+ * the audio framework. It behaves like the es1371: every channel runs
+ * over its dma ring at the sample clock and interrupts after every
+ * fragment, for as long as its interrupt is enabled. A paused channel
+ * keeps its place in the ring.
+ *
+ * The playback channel checks what it plays against the stream the
+ * writers in sim.c send. The capture channel records that same stream.
+ * Minor SIM_DUPLEX opens both channels at once. Up to SIM_MIX_CLIENTS
+ * writers can share the playback channel through minor SIM_MIX.
+ *
+ * There may be several such cards, each with an IRQ of its own.
+ */
+
+#include "sim.h"
+
+#define MIN_RATE		4000
+#define MAX_RATE		48000
+
+#define NR_CHANS		(sim_dev_conf.nr_cards * SIM_NR_SUB_DEVS)
+#define KIND(ch)		((ch) % SIM_NR_SUB_DEVS)	/* SIM_DAC or SIM_ADC */
+#define CARD(ch)		((ch) / SIM_NR_SUB_DEVS)
+
+drv_t drv;
+sub_dev_t sub_dev[SIM_MAX_CARDS * SIM_NR_SUB_DEVS];
+special_file_t special_file[SIM_MAX_CARDS * SIM_NR_SPECIAL_FILES];
+
+struct sim_dev_conf sim_dev_conf = {
+	64 * 1024,					/* dma_size */
+	2,							/* nr_frags */
+	1024,						/* min_frag */
+	4,							/* nr_extra */
+	1							/* nr_cards */
+};
+
+/* state of one channel */
+static struct {
+	u32_t rate;
+	u32_t stereo;
+	u32_t bits;
+	u32_t frag_size;			/* interrupt after this many bytes */
+	char *ring;					/* dma ring as set by drv_set_dma */
+	u32_t ring_len;
+	int running;
+	int paused;
+	int int_enabled;
+	int pending;				/* interrupt status bit */
+	u32_t pos;					/* offset of the current fragment */
+	u64_t next_irq;				/* end of the current fragment */
+	u64_t left;					/* time left of it when paused */
+	u64_t stream;				/* bytes played or recorded */
+	u64_t expect;				/* bytes of the stream to check */
+	u64_t started;				/* time of the last start */
+} chan[SIM_MAX_CARDS * SIM_NR_SUB_DEVS];
+
+static void set_special_file(int minor, int write_chan, int read_chan,
+	int io_ctl);
+
+
+/* the byte at a given offset of the stream the clients play and record */
+u8_t sim_pattern(u64_t offset)
+{
+	return (u8_t) (offset % 251);
+}
+
+
+/* a writer opened the channel, its stream starts at byte 0 */
+void sim_dev_new_stream(int ch)
+{
+	chan[ch].stream = 0;
+}
+
+
+/* how much of the playback stream the device should check */
+void sim_dev_expect(int ch, u64_t bytes)
+{
+	chan[ch].expect = bytes;
+}
+
+
+/* time one fragment takes at the channel's sample clock */
+static u64_t frag_time(int ch)
+{
+	u64_t byte_rate;
+
+	byte_rate = (u64_t) chan[ch].rate * (chan[ch].stereo ? 2 : 1) *
+		(chan[ch].bits / 8);
+	return chan[ch].frag_size * SIM_NS / byte_rate;
+}
+
+
+/* the time of the next fragment end of any channel */
+u64_t sim_dev_next_event(void)
+{
+	int ch;
+	u64_t t;
+
+	t = SIM_NEVER;
+	for (ch = 0; ch < NR_CHANS; ch++) {
+		if (chan[ch].running && !chan[ch].paused && chan[ch].next_irq < t)
+			t = chan[ch].next_irq;
+	}
+	return t;
+}
+
+
+/* finish the fragments that end now */
+void sim_dev_tick(void)
+{
+	int ch;
+	u32_t i;
+	u8_t *frag;
+
+	for (ch = 0; ch < NR_CHANS; ch++) {
+		if (!chan[ch].running || chan[ch].paused ||
+				chan[ch].next_irq > sim_now) {
+			continue;
+		}
+		frag = (u8_t *) chan[ch].ring + chan[ch].pos;
+		for (i = 0; i < chan[ch].frag_size; i++) {
+			if (KIND(ch) == SIM_ADC) {
+				frag[i] = sim_pattern(chan[ch].stream + i);
+			} else if (chan[ch].stream + i < chan[ch].expect &&
+					frag[i] != sim_pattern(chan[ch].stream + i)) {
+				sim_stats.play_errors++;
+			}
+		}
+		chan[ch].stream += chan[ch].frag_size;
+		chan[ch].pos = (chan[ch].pos + chan[ch].frag_size) % 
+			chan[ch].ring_len;
+		chan[ch].next_irq += frag_time(ch);
+		if (chan[ch].int_enabled) chan[ch].pending = TRUE;
+		sim_stats.frags++;
+	}
+}
+
+
+/* is any channel of a card waiting for its interrupt to be handled? */
+int sim_dev_irq_pending(int card)
+{
+	return drv_card_int_sum(card);
+}
+
+
+int drv_init(void)
+{
+	int c, i, dac, adc;
+
+	if (sim_dev_conf.nr_cards < 1 || sim_dev_conf.nr_cards > SIM_MAX_CARDS)
+		return EINVAL;
+
+	drv.DriverName = "audiosim";
+	drv.NrOfSubDevices = sim_dev_conf.nr_cards * SIM_NR_SUB_DEVS;
+	drv.NrOfSpecialFiles = sim_dev_conf.nr_cards * SIM_NR_SPECIAL_FILES;
+
+	for (i = 0; i < NR_CHANS; i++) {
+		sub_dev[i].readable = (KIND(i) == SIM_ADC);
+		sub_dev[i].writable = (KIND(i) == SIM_DAC);
+		sub_dev[i].DmaSize = sim_dev_conf.dma_size;
+		sub_dev[i].NrOfDmaFragments = sim_dev_conf.nr_frags;
+		sub_dev[i].MinFragmentSize = sim_dev_conf.min_frag;
+		sub_dev[i].NrOfExtraBuffers = sim_dev_conf.nr_extra;
+	}
+	for (c = 0; c < sim_dev_conf.nr_cards; c++) {
+		dac = SIM_SUB_DEV(c, SIM_DAC);
+		adc = SIM_SUB_DEV(c, SIM_ADC);
+		set_special_file(SIM_MINOR(c, SIM_DAC), dac, NO_CHANNEL, dac);
+		set_special_file(SIM_MINOR(c, SIM_ADC), NO_CHANNEL, adc, adc);
+		set_special_file(SIM_MINOR(c, SIM_DUPLEX), dac, adc, dac);
+		set_special_file(SIM_MINOR(c, SIM_MIX), dac, NO_CHANNEL, dac);
+	}
+	return OK;
+}
+
+
+/* the minors of all cards are in a row, so a minor is its index */
+static void set_special_file(int minor, int write_chan, int read_chan,
+	int io_ctl)
+{
+	special_file[minor].minor_dev_nr = minor;
+	special_file[minor].write_chan = write_chan;
+	special_file[minor].read_chan = read_chan;
+	special_file[minor].io_ctl = io_ctl;
+}
+
+
+int drv_init_hw(void)
+{
+	int i;
+
+	for (i = 0; i < NR_CHANS; i++) {
+		memset(&chan[i], 0, sizeof(chan[i]));
+		chan[i].rate = 44100;
+		chan[i].stereo = TRUE;
+		chan[i].bits = 16;
+		chan[i].frag_size = sub_dev[i].DmaSize / 
+			sub_dev[i].NrOfDmaFragments;
+	}
+	return OK;
+}
+
+
+int drv_reset(void)
+{
+	return OK;
+}
+
+
+int drv_start(int sub_dev_nr, int UNUSED(DmaMode))
+{
+	int other;
+
+	chan[sub_dev_nr].running = TRUE;
+	chan[sub_dev_nr].paused = FALSE;
+	chan[sub_dev_nr].int_enabled = TRUE;
+	chan[sub_dev_nr].pending = FALSE;
+	chan[sub_dev_nr].pos = 0;
+	/* capture starts a new stream; playback goes on with what the 
+	   writer sends next, also after a stop, see sim_dev_new_stream() */
+	if (KIND(sub_dev_nr) == SIM_ADC) chan[sub_dev_nr].stream = 0;
+	chan[sub_dev_nr].next_irq = sim_now + frag_time(sub_dev_nr);
+	chan[sub_dev_nr].started = sim_now;
+
+	other = SIM_SUB_DEV(CARD(sub_dev_nr), 
+		(KIND(sub_dev_nr) == SIM_DAC) ? SIM_ADC : SIM_DAC);
+	if (chan[other].running)
+		sim_stats.start_skew = sim_now - chan[other].started;
+	return OK;
+}
+
+
+/* like the es1371, both start by the same register write */
+int drv_start_linked(int write_sub_dev, int read_sub_dev)
+{
+	drv_start(write_sub_dev, WRITE_DMA);
+	drv_start(read_sub_dev, READ_DMA);
+	return OK;
+}
+
+
+int drv_stop(int sub_dev_nr)
+{
+	chan[sub_dev_nr].running = FALSE;
+	chan[sub_dev_nr].int_enabled = FALSE;
+	chan[sub_dev_nr].pending = FALSE;
+	return OK;
+}
+
+
+/* the ring is found through the sub device; on the host a physical
+   address does not fit in 32 bits */
+int drv_set_dma(u32_t UNUSED(dma), u32_t length, int ch)
+{
+	chan[ch].ring = sub_dev[ch].DmaPtr;
+	chan[ch].ring_len = length;
+	return OK;
+}
+
+
+int drv_reenable_int(int ch)
+{
+	chan[ch].pending = FALSE;
+	chan[ch].int_enabled = TRUE;
+	return OK;
+}
+
+
+int drv_disable_int(int ch)
+{
+	chan[ch].pending = FALSE;
+	chan[ch].int_enabled = FALSE;
+	return OK;
+}
+
+
+int drv_int_sum(void)
+{
+	return drv_card_int_sum(0);
+}
+
+
+int drv_card_int_sum(int card)
+{
+	int i;
+
+	for (i = 0; i < SIM_NR_SUB_DEVS; i++) {
+		if (chan[SIM_SUB_DEV(card, i)].pending) return TRUE;
+	}
+	return FALSE;
+}
+
+
+int drv_int(int sub_dev_nr)
+{
+	return chan[sub_dev_nr].pending;
+}
+
+
+int drv_pause(int ch)
+{
+	if (!chan[ch].running || chan[ch].paused) return OK;
+	chan[ch].int_enabled = FALSE;
+	chan[ch].pending = FALSE;
+	chan[ch].paused = TRUE;
+	chan[ch].left = chan[ch].next_irq - sim_now;
+	return OK;
+}
+
+
+int drv_resume(int ch)
+{
+	drv_reenable_int(ch);
+	if (!chan[ch].paused) return OK;
+	chan[ch].paused = FALSE;
+	chan[ch].next_irq = sim_now + chan[ch].left;
+	return OK;
+}
+
+
+static int set_frag_size(u32_t fragment_size, int ch)
+{
+	if (fragment_size > (u32_t) (sub_dev[ch].DmaSize /
+				sub_dev[ch].NrOfDmaFragments) ||
+			fragment_size < (u32_t) sub_dev[ch].MinFragmentSize) {
+		return EINVAL;
+	}
+	chan[ch].frag_size = fragment_size;
+	return OK;
+}
+
+
+int drv_io_ctl(unsigned long request, void *val, int *len, int ch)
+{
+	u32_t v;
+
+	v = *((u32_t *) val);
+	switch(request) {
+		case DSPIORATE:
+			if (v < MIN_RATE || v > MAX_RATE) return EINVAL;
+			chan[ch].rate = v;
+			return OK;
+		case DSPIOSTEREO:
+			chan[ch].stereo = (v != 0);
+			return OK;
+		case DSPIOBITS:
+			if (v != 8 && v != 16) return EINVAL;
+			chan[ch].bits = v;
+			return OK;
+		case DSPIOSIGN:
+			return OK;
+		case DSPIOSIZE:
+			return set_frag_size(v, ch);
+		case DSPIOMAX:
+			*len = sizeof(u32_t);
+			*((u32_t *) val) = sub_dev[ch].DmaSize /
+				sub_dev[ch].NrOfDmaFragments;
+			return OK;
+		case DSPIORESET:
+			return OK;
+		case DSPIOPAUSE:
+			return drv_pause(ch);
+		case DSPIORESUME:
+			return drv_resume(ch);
+		default:
+			return EINVAL;
+	}
+}
+
+
+int drv_set_params(struct dsp_params *params, int ch)
+{
+	if ((params->bits != 8 && params->bits != 16) ||
+			params->frag_size > (u32_t) (sub_dev[ch].DmaSize /
+				sub_dev[ch].NrOfDmaFragments) ||
+			params->frag_size < (u32_t) sub_dev[ch].MinFragmentSize) {
+		return EINVAL;
+	}
+	if (params->rate < MIN_RATE) params->rate = MIN_RATE;
+	if (params->rate > MAX_RATE) params->rate = MAX_RATE;
+	params->stereo = (params->stereo != 0);
+	params->sign = (params->bits == 16);
+
+	chan[ch].rate = params->rate;
+	chan[ch].stereo = params->stereo;
+	chan[ch].bits = params->bits;
+	chan[ch].frag_size = params->frag_size;
+	return OK;
+}
+
+
+int drv_get_params(struct dsp_params *params, int ch)
+{
+	params->rate = chan[ch].rate;
+	params->stereo = chan[ch].stereo;
+	params->bits = chan[ch].bits;
+	params->sign = (chan[ch].bits == 16);
+	params->frag_size = chan[ch].frag_size;
+	return OK;
+}
+
+
+int drv_get_mix_clients(int minor_dev_nr)
+{
+	return (minor_dev_nr % SIM_NR_SPECIAL_FILES == SIM_MIX) ? 
+		SIM_MIX_CLIENTS : 0;
+}
+
+
+/* how far the channel is in its current fragment, by the sample clock */
+int drv_get_position(int ch, u32_t *frag_offset, u32_t *frame_size)
+{
+	u64_t t, left;
+
+	*frame_size = (chan[ch].stereo ? 2 : 1) * (chan[ch].bits / 8);
+	*frag_offset = 0;
+	if (!chan[ch].running) return OK;
+
+	t = frag_time(ch);
+	if (chan[ch].paused)
+		left = chan[ch].left;
+	else
+		left = (chan[ch].next_irq > sim_now) ? chan[ch].next_irq - sim_now : 0;
+	if (left > t) left = t;
+	*frag_offset = (u32_t) ((t - left) * chan[ch].frag_size / t);
+	*frag_offset -= *frag_offset % *frame_size;
+	return OK;
+}
+
+
+/* the fragment the channel is in plus how far it is in it */
+int drv_get_dma_offset(int ch, u32_t *offset)
+{
+	u32_t frag_offset, frame_size;
+
+	drv_get_position(ch, &frag_offset, &frame_size);
+	*offset = (chan[ch].pos + frag_offset) % chan[ch].ring_len;
+	return OK;
+}
+
+
+int drv_get_irq(char *irq)
+{
+	return drv_get_card_irq(0, irq);
+}
+
+
+int drv_get_card_irq(int card, char *irq)
+{
+	*irq = SIM_IRQ + card;
+	return OK;
+}
+
+
+int drv_get_nr_cards(void)
+{
+	return sim_dev_conf.nr_cards;
+}
+
+
+int drv_get_card(int ch)
+{
+	return CARD(ch);
+}
+
+
+int drv_get_frag_size(u32_t *frag_size, int ch)
+{
+	*frag_size = chan[ch].frag_size;
+	return OK;
+}
+
+
+int drv_get_max_fragments(int UNUSED(ch))
+{
+	return INT_MAX;
+}
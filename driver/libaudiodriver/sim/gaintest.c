@@ -0,0 +1,131 @@
+/* gaintest - check the software gain of the audio framework
+ *
+ * Usage: gaintest
+ *
+ * Scales pseudo random samples, with one and two channels, from one gain
+ * to another, with ramps that end inside a block and ones that don't.
+ * Every set of kernels that is built in, handed the samples in blocks of
+ * several sizes, must give the same result, bit for bit, as the one
+ * worked out here one sample at a time, and end at the new gain.
+ */
+
+#include <sys/param.h>
+#include "sim.h"
+#include "audio_gain.h"
+#include "audio_conv.h"
+
+#define FRAMES			4099
+
+static const i32_t gains[] = { 0, GAIN_UNITY / 3, GAIN_UNITY,
+	GAIN_UNITY + 12345, GAIN_MAX };
+static const u32_t ramps[] = { 0, 1, 17, 1000, FRAMES, 2 * FRAMES };
+static const size_t blocks[] = { 1, 7, 16, 333, FRAMES };
+
+static u32_t seed = 1;
+static i16_t src[FRAMES * 2], dst[FRAMES * 2], want[FRAMES * 2];
+
+static void expect(u32_t channels, i32_t from, i32_t left, i32_t right,
+	u32_t ramp);
+static int check(u32_t channels, i32_t from, i32_t left, i32_t right,
+	u32_t ramp, size_t block);
+
+
+int main(void)
+{
+	u32_t channels, r;
+	unsigned int f, t, b, checks;
+	int fail;
+	size_t i;
+
+	for (i = 0; i < FRAMES * 2; i++) {
+		src[i] = (i16_t) (sim_rand(&seed) >> 12);
+	}
+	/* the extremes too */
+	src[0] = 32767; src[1] = -32768; src[2] = -1; src[3] = 1;
+
+	fail = FALSE;
+	checks = 0;
+	for (channels = 1; channels <= 2; channels++)
+	for (f = 0; f < sizeof(gains) / sizeof(gains[0]); f++)
+	for (t = 0; t < sizeof(gains) / sizeof(gains[0]); t++)
+	for (r = 0; r < sizeof(ramps) / sizeof(ramps[0]); r++) {
+		/* the right channel goes the other way */
+		expect(channels, gains[f], gains[t], gains[f], ramps[r]);
+		for (b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++)
+		SIM_EACH_KERNELS {
+			if (check(channels, gains[f], gains[t], gains[f], ramps[r],
+					blocks[b]) != OK) {
+				fail = TRUE;
+			}
+			checks++;
+		}
+	}
+
+	return sim_test_report(checks, "gains", fail);
+}
+
+
+/* both channels start at from */
+static void expect(u32_t channels, i32_t from, i32_t left, i32_t right,
+	u32_t ramp)
+{
+	i32_t target[2], g;
+	long v;
+	size_t i;
+	u32_t c;
+
+	target[0] = left;
+	target[1] = right;
+	for (i = 0; i < FRAMES; i++) {
+		for (c = 0; c < channels; c++) {
+			g = target[c];
+			if (i < ramp)
+				g = from + (i32_t) i * ((target[c] - from) / (i32_t) ramp);
+			v = (long) src[i * channels + c] * (g >> 12);
+			v = (v + 2048) >> 12;
+			if (v > 32767) v = 32767;
+			if (v < -32768) v = -32768;
+			want[i * channels + c] = (i16_t) v;
+		}
+	}
+}
+
+
+static int check(u32_t channels, i32_t from, i32_t left, i32_t right,
+	u32_t ramp, size_t block)
+{
+	audio_gain_t g;
+	size_t i, n;
+
+	gain_init(&g);
+	gain_set(&g, from, from, 0);
+	gain_set(&g, left, right, ramp);
+
+	memcpy(dst, src, sizeof(dst));
+	for (i = 0; i < FRAMES; i += n) {
+		n = MIN(block, FRAMES - i);
+		gain_apply(&g, dst + i * channels, n, channels);
+	}
+
+	for (i = 0; i < FRAMES * channels; i++) {
+		if (dst[i] != want[i]) {
+			printf("%u channels, %d to %d/%d in %u frames, blocks of %zu, "
+				"kernels %d: sample %zu is %d, not %d\n", channels, from,
+				left, right, ramp, block, conv_simd, i, dst[i], want[i]);
+			return EINVAL;
+		}
+	}
+	if (ramp <= FRAMES && (g.ramp != 0 || g.gain[0] != left ||
+			g.gain[1] != right)) {
+		printf("%u channels, %d to %d/%d in %u frames: ends at %d/%d\n",
+			channels, from, left, right, ramp, g.gain[0], g.gain[1]);
+		return EINVAL;
+	}
+	if (gain_unity(&g, channels) != (ramp <= FRAMES &&
+			left == GAIN_UNITY && (channels == 1 || right == GAIN_UNITY))) {
+		printf("%u channels, %d to %d/%d in %u frames: unity is wrong\n",
+			channels, from, left, right, ramp);
+		return EINVAL;
+	}
+	return OK;
+}
@@ -0,0 +1,35 @@
+/* Host stand-in for the MINIX <errno.h>. MINIX system code uses negative
+ * error numbers, so a driver's read and write callbacks can return either
+ * a byte count or an error. The host's positive numbers would be taken
+ * for byte counts, so this replaces <errno.h> for the harness.
+ */
+
+#ifndef _SIM_ERRNO_H
+#define _SIM_ERRNO_H
+
+#define _SIGN		-
+
+#define EPERM		(_SIGN  1)
+#define ENOENT		(_SIGN  2)
+#define ESRCH		(_SIGN  3)
+#define EINTR		(_SIGN  4)
+#define EIO			(_SIGN  5)
+#define ENXIO		(_SIGN  6)
+#define E2BIG		(_SIGN  7)
+#define EBADF		(_SIGN  9)
+#define EAGAIN		(_SIGN 11)
+#define ENOMEM		(_SIGN 12)
+#define EFAULT		(_SIGN 14)
+#define EBUSY		(_SIGN 16)
+#define ENODEV		(_SIGN 19)
+#define EINVAL		(_SIGN 22)
+#define ENOTTY		(_SIGN 25)
+#define ENOSPC		(_SIGN 28)
+#define EPIPE		(_SIGN 32)
+#define ERANGE		(_SIGN 34)
+#define ENOSYS		(_SIGN 78)
+
+#define EDONTREPLY	(_SIGN 201)	/* driver replies later */
+#define ENOTREADY	(_SIGN 203)	/* not ready for live update */
+
+#endif /* _SIM_ERRNO_H */
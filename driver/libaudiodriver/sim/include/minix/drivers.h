@@ -0,0 +1,57 @@
+/* Host stand-in for <minix/drivers.h>, for the libaudiodriver simulation
+ * harness. It declares just what the audio framework uses; kernel.c
+ * implements it on top of plain libc.
+ */
+
+#ifndef _SIM_MINIX_DRIVERS_H
+#define _SIM_MINIX_DRIVERS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef uint64_t u64_t;
+typedef int16_t i16_t;
+typedef int32_t i32_t;
+
+typedef int endpoint_t;
+typedef int32_t cp_grant_id_t;
+typedef unsigned long vir_bytes;
+typedef unsigned long phys_bytes;
+typedef int devminor_t;
+typedef int cdev_id_t;
+
+#define OK			0
+#define SELF		0x8ace
+#define VM_D		1
+
+#define EXTERN		extern
+#define UNUSED(v)	v __attribute__((unused))
+#ifndef __unused
+#define __unused	__attribute__((unused))
+#endif
+
+typedef struct {
+	int m_type;
+	long m2_l1, m2_l2;
+	int m2_i1, m2_i2, m2_i3;
+} message;
+
+#define IOMMU_MAP	1
+
+#include <minix/syslib.h>
+#include <minix/sysutil.h>
+#include <minix/sef.h>
+#include <minix/chardriver.h>
+
+#endif /* _SIM_MINIX_DRIVERS_H */
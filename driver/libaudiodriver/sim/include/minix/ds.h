@@ -0,0 +1 @@
+/* Host stand-in for <minix/ds.h>; see <minix/syslib.h> */
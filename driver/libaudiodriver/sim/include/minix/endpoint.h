@@ -0,0 +1 @@
+/* Host stand-in for <minix/endpoint.h>; see <minix/drivers.h> */
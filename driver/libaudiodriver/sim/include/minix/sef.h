@@ -0,0 +1,26 @@
+/* Host stand-in for <minix/sef.h>, see kernel.c */
+
+#ifndef _SIM_MINIX_SEF_H
+#define _SIM_MINIX_SEF_H
+
+typedef struct { int dummy; } sef_init_info_t;
+
+#define SEF_INIT_FRESH		0
+#define SEF_INIT_RESTART	2
+
+#define SEF_LU_STATE_WORK_FREE		1
+#define SEF_LU_STATE_REQUEST_FREE	2
+#define SEF_LU_STATE_PROTOCOL_FREE	3
+#define SEF_LU_STATE_CUSTOM_BASE	10
+#define SEF_LU_STATE_IS_STANDARD(s)	((s) >= 1 && (s) <= 3)
+
+void sef_setcb_init_fresh(int (*cb)(int, sef_init_info_t *));
+void sef_setcb_init_restart(int (*cb)(int, sef_init_info_t *));
+void sef_setcb_lu_prepare(int (*cb)(int));
+void sef_setcb_lu_state_isvalid(int (*cb)(int, int));
+void sef_setcb_lu_state_dump(void (*cb)(int));
+void sef_setcb_signal_handler(void (*cb)(int));
+void sef_startup(void);
+void sef_lu_dprint(const char *fmt, ...);
+
+#endif /* _SIM_MINIX_SEF_H */
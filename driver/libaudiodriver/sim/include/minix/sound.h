@@ -0,0 +1,17 @@
+/* Host stand-in for <minix/sound.h> */
+
+#ifndef _SIM_MINIX_SOUND_H
+#define _SIM_MINIX_SOUND_H
+
+/* Volume levels range from 0 to 31, bass & treble range from 0 to 15 */
+enum Device {
+	Master, Dac, Fm, Cd, Line, Mic, Speaker, Treble, Bass
+};
+
+struct volume_level {
+	enum Device device;
+	int left;
+	int right;
+};
+
+#endif /* _SIM_MINIX_SOUND_H */
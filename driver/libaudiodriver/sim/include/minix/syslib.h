@@ -0,0 +1,44 @@
+/* Host stand-in for <minix/syslib.h>, see kernel.c */
+
+#ifndef _SIM_MINIX_SYSLIB_H
+#define _SIM_MINIX_SYSLIB_H
+
+#include <sys/mman.h>
+
+struct vscp_vec {
+	endpoint_t v_from;
+	endpoint_t v_to;
+	cp_grant_id_t v_gid;
+	vir_bytes v_offset;
+	vir_bytes v_addr;
+	size_t v_bytes;
+};
+
+int sys_safecopyfrom(endpoint_t src, cp_grant_id_t grant, vir_bytes offset,
+	vir_bytes address, size_t bytes);
+int sys_safecopyto(endpoint_t dst, cp_grant_id_t grant, vir_bytes offset,
+	vir_bytes address, size_t bytes);
+int sys_vsafecopy(struct vscp_vec *vec, int count);
+
+int sys_irqsetpolicy(int irq, int policy, int *irq_hook_id);
+int sys_irqrmpolicy(int *irq_hook_id);
+int sys_irqenable(int *irq_hook_id);
+int sys_irqdisable(int *irq_hook_id);
+
+int sys_umap(endpoint_t proc_ep, int seg, vir_bytes vir_addr,
+	vir_bytes bytes, phys_bytes *phys_addr);
+int sys_setalarm(clock_t exp_time, int abs_time);
+
+#define AC_ALIGN4K		0x01
+#define AC_LOWER16M		0x02
+#define AC_ALIGN64K		0x04
+void *alloc_contig(size_t len, int flags, phys_bytes *phys);
+int free_contig(void *addr, size_t len);
+
+void *vm_remap(endpoint_t d, endpoint_t s, void *da, void *sa, size_t size);
+int vm_unmap(endpoint_t endpt, void *addr);
+
+int ds_retrieve_label_endpt(const char *ds_name, endpoint_t *endpoint);
+int ipc_sendrec(endpoint_t src_dest, message *m_ptr);
+
+#endif /* _SIM_MINIX_SYSLIB_H */
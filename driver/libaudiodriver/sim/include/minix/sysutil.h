@@ -0,0 +1,11 @@
+/* Host stand-in for <minix/sysutil.h>, see kernel.c */
+
+#ifndef _SIM_MINIX_SYSUTIL_H
+#define _SIM_MINIX_SYSUTIL_H
+
+void read_tsc_64(u64_t *t);
+u32_t tsc_64_to_micros(u64_t tsc);
+clock_t getticks(void);
+u32_t sys_hz(void);
+
+#endif /* _SIM_MINIX_SYSUTIL_H */
@@ -0,0 +1,8 @@
+/* Host stand-in for <minix/types.h> */
+
+#ifndef _SIM_MINIX_TYPES_H
+#define _SIM_MINIX_TYPES_H
+
+#include <minix/drivers.h>
+
+#endif /* _SIM_MINIX_TYPES_H */
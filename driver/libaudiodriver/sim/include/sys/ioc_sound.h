@@ -0,0 +1,26 @@
+/* Host stand-in for <sys/ioc_sound.h> */
+
+#ifndef _SIM_SYS_IOC_SOUND_H
+#define _SIM_SYS_IOC_SOUND_H
+
+#include <sys/ioccom.h>
+#include <minix/sound.h>
+
+/* Soundcard DSP ioctls. */
+#define	DSPIORATE	_IOW('s', 1, u32_t)
+#define DSPIOSTEREO	_IOW('s', 2, u32_t)
+#define DSPIOSIZE	_IOW('s', 3, u32_t)
+#define DSPIOBITS	_IOW('s', 4, u32_t)
+#define DSPIOSIGN	_IOW('s', 5, u32_t)
+#define DSPIOMAX	_IOR('s', 6, u32_t)
+#define DSPIORESET	_IO ('s', 7)
+#define DSPIOFREEBUF	_IOR('s', 30, u32_t)
+#define DSPIOSAMPLESINBUF	_IOR('s', 31, u32_t)
+#define DSPIOPAUSE	_IO ('s', 32)
+#define DSPIORESUME	_IO ('s', 33)
+
+/* Soundcard mixer ioctls. */
+#define MIXIOGETVOLUME		_IOWR('s', 10, struct volume_level)
+#define MIXIOSETVOLUME		_IOWR('s', 20, struct volume_level)
+
+#endif /* _SIM_SYS_IOC_SOUND_H */
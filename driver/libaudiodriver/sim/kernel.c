@@ -0,0 +1,366 @@
+/* This file stands in for the parts of MINIX that libaudiodriver talks
+ * to: safecopies on grants, IRQ control, contiguous memory, SEF and
+ * libchardriver. Grants are plain host buffers in a table. An IRQ is
+ * delivered by calling the driver's cdr_intr with the bit of its hook,
+ * and only after the driver has reenabled that hook with sys_irqenable,
+ * as with a MINIX IRQ policy without IRQ_REENABLE. An alarm set with
+ * sys_setalarm calls cdr_alarm.
+ */
+
+#include <stdarg.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "sim.h"
+
+#define SIM_NR_GRANTS	64
+
+static struct {
+	char *addr;
+	size_t size;
+} grant_tab[SIM_NR_GRANTS];
+
+u64_t sim_now;						/* virtual time in ns */
+struct chardriver *sim_tab;			/* the framework's callbacks */
+struct sim_stats sim_stats;
+struct sim_latency sim_latency;
+struct sim_irq_hook sim_irq_hook[SIM_MAX_CARDS];
+int sim_nr_irq_hooks;
+u64_t sim_alarm = SIM_NEVER;		/* when the alarm goes off */
+void (*sim_reply_hook)(endpoint_t endpt, cdev_id_t id, int status);
+void (*sim_select_hook)(endpoint_t endpt, devminor_t minor, int ops);
+int (*sim_lu_prepare)(int state);	/* the framework's live update check */
+
+static int (*init_cb)(int, sef_init_info_t *);
+static void (*signal_cb)(int);
+
+
+cp_grant_id_t sim_grant(void *addr, size_t size)
+{
+	cp_grant_id_t g;
+
+	for (g = 1; g < SIM_NR_GRANTS; g++) {
+		if (grant_tab[g].addr != NULL) continue;
+		grant_tab[g].addr = addr;
+		grant_tab[g].size = size;
+		return g;
+	}
+	fprintf(stderr, "sim: out of grants\n");
+	exit(2);
+}
+
+
+void sim_ungrant(cp_grant_id_t grant)
+{
+	grant_tab[grant].addr = NULL;
+}
+
+
+/* check a copy against its grant, return the granted memory */
+static char *granted(cp_grant_id_t grant, vir_bytes offset, size_t bytes)
+{
+	if (grant == SIM_BAD_GRANT) return NULL;
+	if (grant <= 0 || grant >= SIM_NR_GRANTS ||
+			grant_tab[grant].addr == NULL ||
+			offset + bytes > grant_tab[grant].size) {
+		fprintf(stderr, "sim: bad copy: grant %d offset %lu bytes %zu\n",
+			grant, offset, bytes);
+		return NULL;
+	}
+	return grant_tab[grant].addr + offset;
+}
+
+
+int sys_safecopyfrom(endpoint_t UNUSED(src), cp_grant_id_t grant,
+	vir_bytes offset, vir_bytes address, size_t bytes)
+{
+	char *p;
+
+	if ((p = granted(grant, offset, bytes)) == NULL) return EPERM;
+	memcpy((void *) address, p, bytes);
+	sim_stats.copies++;
+	sim_stats.copy_bytes += bytes;
+	return OK;
+}
+
+
+int sys_safecopyto(endpoint_t UNUSED(dst), cp_grant_id_t grant,
+	vir_bytes offset, vir_bytes address, size_t bytes)
+{
+	char *p;
+
+	if ((p = granted(grant, offset, bytes)) == NULL) return EPERM;
+	memcpy(p, (void *) address, bytes);
+	sim_stats.copies++;
+	sim_stats.copy_bytes += bytes;
+	return OK;
+}
+
+
+int sys_vsafecopy(struct vscp_vec *vec, int count)
+{
+	int i;
+	char *p;
+
+	for (i = 0; i < count; i++) {
+		p = granted(vec[i].v_gid, vec[i].v_offset, vec[i].v_bytes);
+		if (p == NULL) return EPERM;
+		if (vec[i].v_from == SELF)
+			memcpy(p, (void *) vec[i].v_addr, vec[i].v_bytes);
+		else
+			memcpy((void *) vec[i].v_addr, p, vec[i].v_bytes);
+		sim_stats.copy_bytes += vec[i].v_bytes;
+	}
+	sim_stats.copies++;
+	return OK;
+}
+
+
+/* the id the driver passes in is the bit of the hook in the notify, the
+   one it gets back is the index of the hook */
+int sys_irqsetpolicy(int irq, int UNUSED(policy), int *irq_hook_id)
+{
+	struct sim_irq_hook *h;
+
+	if (sim_nr_irq_hooks == SIM_MAX_CARDS) return ENOSPC;
+	h = &sim_irq_hook[sim_nr_irq_hooks];
+	h->irq = irq;
+	h->bit = *irq_hook_id;
+	h->enabled = FALSE;
+	*irq_hook_id = sim_nr_irq_hooks++;
+	return OK;
+}
+
+
+static struct sim_irq_hook *irq_hook(const int *irq_hook_id)
+{
+	if (*irq_hook_id < 0 || *irq_hook_id >= sim_nr_irq_hooks) {
+		fprintf(stderr, "sim: bad irq hook %d\n", *irq_hook_id);
+		exit(2);
+	}
+	return &sim_irq_hook[*irq_hook_id];
+}
+
+
+int sys_irqrmpolicy(int *irq_hook_id)
+{
+	irq_hook(irq_hook_id)->enabled = FALSE;
+	return OK;
+}
+
+
+int sys_irqenable(int *irq_hook_id)
+{
+	irq_hook(irq_hook_id)->enabled = TRUE;
+	return OK;
+}
+
+
+int sys_irqdisable(int *irq_hook_id)
+{
+	irq_hook(irq_hook_id)->enabled = FALSE;
+	return OK;
+}
+
+
+/* physical addresses are host addresses */
+int sys_umap(endpoint_t UNUSED(proc_ep), int UNUSED(seg), vir_bytes vir_addr,
+	vir_bytes UNUSED(bytes), phys_bytes *phys_addr)
+{
+	*phys_addr = vir_addr;
+	return OK;
+}
+
+
+int sys_setalarm(clock_t exp_time, int abs_time)
+{
+	u64_t tick;
+
+	tick = SIM_NS / sys_hz();
+	if (exp_time == 0)
+		sim_alarm = SIM_NEVER;
+	else if (abs_time)
+		sim_alarm = (u64_t) exp_time * tick;
+	else
+		sim_alarm = (getticks() + (u64_t) exp_time) * tick;
+	return OK;
+}
+
+
+void *alloc_contig(size_t len, int flags, phys_bytes *phys)
+{
+	size_t align;
+	void *p;
+
+	align = (flags & AC_ALIGN64K) ? 64 * 1024 : 4096;
+	len = (len + align - 1) & ~(align - 1);
+	if ((p = aligned_alloc(align, len)) == NULL) return NULL;
+	if (phys != NULL) *phys = (phys_bytes) p;
+	return p;
+}
+
+
+int free_contig(void *addr, size_t UNUSED(len))
+{
+	free(addr);
+	return OK;
+}
+
+
+/* driver and client share the address space */
+void *vm_remap(endpoint_t UNUSED(d), endpoint_t UNUSED(s), void *UNUSED(da),
+	void *sa, size_t UNUSED(size))
+{
+	return sa;
+}
+
+
+int vm_unmap(endpoint_t UNUSED(endpt), void *UNUSED(addr))
+{
+	return OK;
+}
+
+
+int ds_retrieve_label_endpt(const char *UNUSED(ds_name),
+	endpoint_t *UNUSED(endpoint))
+{
+	return ESRCH;	/* no amddev */
+}
+
+
+int ipc_sendrec(endpoint_t UNUSED(src_dest), message *UNUSED(m_ptr))
+{
+	return EIO;
+}
+
+
+/* the driver's cycle counter runs at 1 GHz of virtual time */
+void read_tsc_64(u64_t *t)
+{
+	*t = sim_now;
+}
+
+
+u32_t tsc_64_to_micros(u64_t tsc)
+{
+	return (u32_t) (tsc / 1000);
+}
+
+
+clock_t getticks(void)
+{
+	return (clock_t) (sim_now / (SIM_NS / sys_hz()));
+}
+
+
+u32_t sys_hz(void)
+{
+	return 100;
+}
+
+
+void sef_setcb_init_fresh(int (*cb)(int, sef_init_info_t *))
+{
+	init_cb = cb;
+}
+
+
+void sef_setcb_init_restart(int (*cb)(int, sef_init_info_t *))
+{
+	(void) cb;
+}
+
+
+void sef_setcb_lu_prepare(int (*cb)(int))
+{
+	sim_lu_prepare = cb;
+}
+
+
+void sef_setcb_lu_state_isvalid(int (*cb)(int, int))
+{
+	(void) cb;
+}
+
+
+void sef_setcb_lu_state_dump(void (*cb)(int))
+{
+	(void) cb;
+}
+
+
+void sef_setcb_signal_handler(void (*cb)(int))
+{
+	signal_cb = cb;
+}
+
+
+void sef_startup(void)
+{
+	sef_init_info_t info;
+
+	if (init_cb != NULL && init_cb(SEF_INIT_FRESH, &info) != OK) {
+		fprintf(stderr, "sim: driver initialization failed\n");
+		exit(2);
+	}
+}
+
+
+void sef_lu_dprint(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+
+/* the harness drives the callbacks itself, there is no message loop */
+void chardriver_task(struct chardriver *cdp)
+{
+	sim_tab = cdp;
+}
+
+
+void chardriver_announce(void)
+{
+}
+
+
+void chardriver_reply_task(endpoint_t endpt, cdev_id_t id, int r)
+{
+	if (sim_reply_hook != NULL) sim_reply_hook(endpt, id, r);
+}
+
+
+void chardriver_reply_select(endpoint_t endpt, devminor_t minor, int ops)
+{
+	if (sim_select_hook != NULL) sim_select_hook(endpt, minor, ops);
+}
+
+
+/* send the driver SIGTERM, as the RS does when it is stopped */
+void sim_shutdown(void)
+{
+	if (signal_cb != NULL) signal_cb(SIGTERM);
+}
+
+
+u64_t sim_host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64_t) ts.tv_sec * SIM_NS + ts.tv_nsec;
+}
+
+
+u64_t sim_host_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return sim_host_ns();
+#endif
+}
@@ -0,0 +1,209 @@
+/* ratetest - check the sample rate conversion of the audio framework
+ *
+ * Usage: ratetest [-v]
+ *
+ * Resamples between the rates clients and devices use, at every quality
+ * and with one and two channels:
+ *	- every set of kernels that is built in gives the same output, bit
+ *	  for bit, however the input is handed over;
+ *	- n input frames make n * out / in output frames, give or take the
+ *	  ones the filter still waits for;
+ *	- a constant comes out unchanged;
+ *	- a sine well inside the passband comes out at its own phase, with
+ *	  an error below the bound of the quality.
+ * With -v the error of every sine is printed.
+ */
+
+#include <math.h>
+#include <sys/param.h>
+#include "sim.h"
+#include "audio_rate.h"
+#include "audio_conv.h"
+
+#define IN_FRAMES		20000
+#define MAX_OUT			(IN_FRAMES * 25)		/* 8000 to 192000 */
+
+static const u32_t rates[][2] = {
+	{ 8000, 48000 }, { 8000, 44100 }, { 11025, 48000 }, { 22050, 44100 },
+	{ 44100, 48000 }, { 48000, 44100 }, { 96000, 48000 }, { 192000, 44100 },
+	{ 32000, 48000 }, { 44100, 8000 }, { 2000, 4000 }, { 48000, 48000 }
+};
+
+/* largest error of a sine of amplitude 16384, per quality */
+static const double max_error[] = { 600, 100, 40 };
+
+static i16_t in[IN_FRAMES * 2];
+static i16_t out[2][MAX_OUT * 2];
+static int verbose;
+
+static size_t run(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality, size_t chunk, i16_t *dst);
+static int check_kernels(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality);
+static int check_dc(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality);
+static int check_sine(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality);
+
+
+int main(int argc, char **argv)
+{
+	unsigned int r, checks;
+	u32_t channels, quality;
+	int fail;
+
+	if (argc == 2 && strcmp(argv[1], "-v") == 0) {
+		verbose = TRUE;
+	} else if (argc != 1) {
+		fprintf(stderr, "Usage: ratetest [-v]\n");
+		return 2;
+	}
+
+	fail = FALSE;
+	checks = 0;
+	for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+	for (channels = 1; channels <= 2; channels++)
+	for (quality = DSP_QUALITY_FAST; quality <= DSP_QUALITY_BEST; quality++) {
+		if (check_kernels(rates[r][0], rates[r][1], channels, quality) != OK)
+			fail = TRUE;
+		if (check_dc(rates[r][0], rates[r][1], channels, quality) != OK)
+			fail = TRUE;
+		if (check_sine(rates[r][0], rates[r][1], channels, quality) != OK)
+			fail = TRUE;
+		checks += 3;
+	}
+
+	return sim_test_report(checks, "resampler checks", fail);
+}
+
+
+/* resample all of in, chunk frames at a time; returns the frames made */
+static size_t run(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality, size_t chunk, i16_t *dst)
+{
+	audio_rate_t rs;
+	size_t done, made, n;
+
+	if (rate_init(&rs, in_rate, out_rate, channels, quality) != OK) {
+		printf("%u to %u: rate_init failed\n", in_rate, out_rate);
+		exit(1);
+	}
+	done = made = 0;
+	while (done < IN_FRAMES) {
+		n = MIN(chunk, IN_FRAMES - done);
+		n = rate_push(&rs, in + done * channels, n);
+		done += n;
+		made += rate_pull(&rs, dst + made * channels, MAX_OUT - made);
+	}
+	rate_free(&rs);
+	return made;
+}
+
+
+static int check_kernels(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality)
+{
+	static const size_t chunks[] = { 1, 7, 1000, IN_FRAMES };
+	u32_t seed;
+	size_t i, n, made, ideal;
+	unsigned int c;
+
+	seed = in_rate ^ out_rate ^ channels;
+	for (i = 0; i < IN_FRAMES * channels; i++) {
+		in[i] = (i16_t) (sim_rand(&seed) >> 16);
+	}
+
+	conv_simd = CONV_SCALAR;
+	made = run(in_rate, out_rate, channels, quality, IN_FRAMES, out[0]);
+
+	/* all but what waits for the second half of the filter */
+	ideal = (size_t) ((u64_t) IN_FRAMES * out_rate / in_rate);
+	if (made > ideal + 1 ||
+			made + (u64_t) RATE_MAX_TAPS * out_rate / in_rate + 1 < ideal) {
+		printf("%u to %u: %zu frames out of %u, not about %zu\n",
+			in_rate, out_rate, made, IN_FRAMES, ideal);
+		return EINVAL;
+	}
+
+	SIM_EACH_KERNELS {
+		for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+			n = run(in_rate, out_rate, channels, quality, chunks[c], out[1]);
+			if (n != made || memcmp(out[0], out[1],
+					made * channels * sizeof(i16_t)) != 0) {
+				printf("%u to %u, %u channels, quality %u: kernels %d in "
+					"chunks of %zu differ\n", in_rate, out_rate, channels,
+					quality, conv_simd, chunks[c]);
+				conv_simd = CONV_AVX2;
+				return EINVAL;
+			}
+		}
+	}
+	conv_simd = CONV_AVX2;
+	return OK;
+}
+
+
+static int check_dc(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality)
+{
+	size_t i, made, skip;
+
+	for (i = 0; i < IN_FRAMES * channels; i++)
+		in[i] = (i % channels) ? -12345 : 20000;
+
+	made = run(in_rate, out_rate, channels, quality, IN_FRAMES, out[0]);
+
+	/* once the filter is past the silence before the start */
+	skip = (size_t) ((u64_t) RATE_MAX_TAPS * out_rate / in_rate + 1) * channels;
+	for (i = skip; i < made * channels; i++) {
+		if (out[0][i] != in[i % channels]) {
+			printf("%u to %u, %u channels, quality %u: %d in, %d out\n",
+				in_rate, out_rate, channels, quality, in[i % channels],
+				out[0][i]);
+			return EINVAL;
+		}
+	}
+	return OK;
+}
+
+
+static int check_sine(u32_t in_rate, u32_t out_rate, u32_t channels,
+	u32_t quality)
+{
+	size_t i, made, skip;
+	double f, t, want, err, max;
+	unsigned int c;
+
+	/* a fifth of the lower Nyquist rate */
+	f = MIN(in_rate, out_rate) / 10.0;
+	for (i = 0; i < IN_FRAMES; i++) {
+		for (c = 0; c < channels; c++) {
+			in[i * channels + c] = (i16_t) lrint(16384 *
+				sin(2 * M_PI * f * i / in_rate + c));
+		}
+	}
+
+	made = run(in_rate, out_rate, channels, quality, IN_FRAMES, out[0]);
+
+	max = 0;
+	skip = (size_t) ((u64_t) RATE_MAX_TAPS * out_rate / in_rate + 1);
+	for (i = skip; i < made; i++) {
+		t = (double) i / out_rate;
+		for (c = 0; c < channels; c++) {
+			want = 16384 * sin(2 * M_PI * f * t + c);
+			err = fabs(out[0][i * channels + c] - want);
+			if (err > max) max = err;
+		}
+	}
+	if (verbose) {
+		printf("%u to %u, %u channels, quality %u: error %.1f\n",
+			in_rate, out_rate, channels, quality, max);
+	}
+	if (max > max_error[quality]) {
+		printf("%u to %u, %u channels, quality %u: error %.1f, more than "
+			"%.0f\n", in_rate, out_rate, channels, quality, max,
+			max_error[quality]);
+		return EINVAL;
+	}
+	return OK;
+}
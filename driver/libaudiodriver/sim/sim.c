@@ -0,0 +1,725 @@
+/* This file contains the event loop of the simulation harness. It moves
+ * virtual time from one event to the next: the end of a fragment in the
+ * simulated device, or a client that wants to do its next read or write.
+ * Interrupts are delivered as soon as a card raises one and the
+ * framework has the IRQ hook of that card enabled.
+ */
+
+#include "sim.h"
+#include "audio_conv.h"
+#include "audio_rate.h"
+
+#define SIM_CLIENT_ENDPT	100		/* endpoint of the first client */
+#define SIM_IOCTL_ENDPT		99		/* endpoint sim_ioctl() calls from */
+
+int audio_fw_main(void);			/* main() of audio_fw.c */
+
+static struct sim_client *sim_clients;
+static int sim_nr_clients;
+static cdev_id_t next_id = 1;
+static u64_t irq_start;				/* host time the interrupt began, 0 
+									   outside of one */
+
+static void deliver_irq(void);
+static void check_lu(void);
+static void client_open(struct sim_client *c);
+static void client_setup(struct sim_client *c);
+static void client_close(struct sim_client *c);
+static int shared_open(struct sim_client *c);
+static void client_request(struct sim_client *c);
+static void client_gain(struct sim_client *c);
+static void check_bad_copy(struct sim_client *c, unsigned long request);
+static void client_done(struct sim_client *c, ssize_t r);
+static void check_read(struct sim_client *c, size_t size);
+static void check_position(struct sim_client *c);
+static u64_t played(struct sim_client *c, u64_t bytes);
+static u8_t format_byte(struct sim_client *c, u64_t offset);
+static void client_end(struct sim_client *c);
+static void client_ended(struct sim_client *c, int r);
+static void reply(endpoint_t endpt, cdev_id_t id, int status);
+static void select_reply(endpoint_t endpt, devminor_t minor, int ops);
+static void record_latency(u64_t ns);
+static int cmp_u64(const void *a, const void *b);
+
+
+/* bring up the framework on the simulated device */
+int sim_init(void)
+{
+	sim_reply_hook = reply;
+	sim_select_hook = select_reply;
+	audio_fw_main();
+	return (sim_tab != NULL) ? OK : EIO;
+}
+
+
+void sim_reset_stats(void)
+{
+	memset(&sim_stats, 0, sizeof(sim_stats));
+	sim_latency.nr = 0;
+}
+
+
+/* a percentile of the interrupt to reply latencies so far, in ns */
+u64_t sim_latency_pct(int percent)
+{
+	size_t i;
+
+	if (sim_latency.nr == 0) return 0;
+	qsort(sim_latency.ns, sim_latency.nr, sizeof(u64_t), cmp_u64);
+	i = (sim_latency.nr * percent + 99) / 100;
+	return sim_latency.ns[i > 0 ? i - 1 : 0];
+}
+
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64_t x = *(const u64_t *) a, y = *(const u64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+
+static void record_latency(u64_t ns)
+{
+	if (sim_latency.nr == sim_latency.max) {
+		sim_latency.max = sim_latency.max ? 2 * sim_latency.max : 1024;
+		sim_latency.ns = realloc(sim_latency.ns, 
+			sim_latency.max * sizeof(u64_t));
+		if (sim_latency.ns == NULL) {
+			printf("sim: out of memory\n");
+			exit(2);
+		}
+	}
+	sim_latency.ns[sim_latency.nr++] = ns;
+}
+
+
+/* do an ioctl on an opened minor device, arg is copied in and out */
+int sim_ioctl(int minor, unsigned long request, void *arg)
+{
+	int r;
+	cp_grant_id_t grant;
+
+	grant = sim_grant(arg, IOCPARM_LEN(request));
+	SIM_CALL(r = sim_tab->cdr_ioctl(minor, request, SIM_IOCTL_ENDPT, grant,
+			0, SIM_IOCTL_ENDPT, next_id++));
+	sim_ungrant(grant);
+	deliver_irq();
+	return r;
+}
+
+
+/* call the framework's interrupt handler for every hook that has an
+ * interrupt coming */
+static void deliver_irq(void)
+{
+	struct sim_irq_hook *h;
+	int i, again;
+
+	do {
+		again = FALSE;
+		for (i = 0; i < sim_nr_irq_hooks; i++) {
+			h = &sim_irq_hook[i];
+			if (!h->enabled || !sim_dev_irq_pending(h->irq - SIM_IRQ))
+				continue;
+			h->enabled = FALSE;	/* until the handler reenables it */
+			sim_stats.irqs++;
+			irq_start = sim_host_ns();
+			SIM_CALL(sim_tab->cdr_intr(1 << h->bit));
+			irq_start = 0;
+			again = TRUE;
+		}
+	} while (again);
+}
+
+
+/* run the clients until the end time, or until they and the device are
+ * all done */
+void sim_run(struct sim_client *clients, int nr, u64_t end)
+{
+	int i, busy;
+
+	sim_clients = clients;
+	sim_nr_clients = nr;
+	for (i = 0; i < nr; i++) {
+		clients[i].endpt = SIM_CLIENT_ENDPT + i;
+		clients[i].wake = clients[i].start;
+		clients[i].last = -1;
+	}
+
+	while (sim_now < end) {
+		busy = (sim_dev_next_event() != SIM_NEVER);
+		for (i = 0; i < nr; i++) {
+			if (!clients[i].finished) busy = TRUE;
+		}
+		if (!busy) break;
+		sim_step(end);
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (clients[i].opened) client_close(&clients[i]);
+	}
+
+	/* let the device play what the writers left behind */
+	end = sim_now + SIM_DRAIN;
+	while (sim_dev_next_event() != SIM_NEVER && sim_now < end) sim_step(end);
+
+	sim_clients = NULL;
+	sim_nr_clients = 0;
+}
+
+
+/* move on to the next event, but not beyond limit */
+void sim_step(u64_t limit)
+{
+	int i;
+	u64_t t, t_dev;
+	struct sim_client *c;
+
+	t = t_dev = sim_dev_next_event();
+	if (sim_alarm < t) t = sim_alarm;
+	for (i = 0; i < sim_nr_clients; i++) {
+		c = &sim_clients[i];
+		if (!c->finished && c->id == 0 && !c->selecting && c->wake < t)
+			t = c->wake;
+	}
+	if (t > limit) {
+		sim_now = limit;
+		return;
+	}
+	if (t > sim_now) sim_now = t;
+
+	if (t_dev <= sim_now) {
+		sim_dev_tick();
+		deliver_irq();
+	}
+	if (sim_alarm <= sim_now) {
+		sim_alarm = SIM_NEVER;
+		SIM_CALL(sim_tab->cdr_alarm(getticks()));
+		deliver_irq();
+	}
+
+	for (i = 0; i < sim_nr_clients; i++) {
+		c = &sim_clients[i];
+		if (c->finished || c->id != 0 || c->selecting || c->wake > sim_now)
+			continue;
+
+		if (!c->opened) {
+			client_open(c);
+		} else if (c->total > 0 && c->done >= c->total) {
+			if (c->write && c->end != SIM_END_CLOSE && !c->ended)
+				client_end(c);
+			else
+				client_close(c);
+			continue;
+		} else if (c->stall_len > 0 && !c->stalled &&
+				sim_now >= c->stall_at) {
+			c->stalled = TRUE;
+			c->wake = sim_now + c->stall_len;
+			continue;
+		}
+		if (c->write && c->gain_at > 0 && !c->gained && 
+				sim_now >= c->gain_at) {
+			client_gain(c);
+		}
+		if (!c->finished) client_request(c);
+		deliver_irq();
+	}
+	check_lu();
+}
+
+
+/* a live update may only go ahead when no client waits for a reply */
+static void check_lu(void)
+{
+	int i, waiting, ready;
+
+	if (sim_lu_prepare == NULL) return;
+	waiting = FALSE;
+	for (i = 0; i < sim_nr_clients; i++) {
+		if (sim_clients[i].id != 0) waiting = TRUE;
+	}
+	ready = (sim_lu_prepare(SEF_LU_STATE_REQUEST_FREE) == OK);
+	if (ready == waiting) sim_stats.lu_errors++;
+}
+
+
+static void client_open(struct sim_client *c)
+{
+	int r;
+
+	if (shared_open(c)) {
+		/* the minor is open already: share that open, as after a 
+		   fork(), and the set up done with it */
+		c->opened = TRUE;
+	} else {
+		SIM_CALL(r = sim_tab->cdr_open(c->minor, 0, c->endpt));
+		if (r < 0) {
+			printf("sim: open of minor %d failed: %d\n", c->minor, r);
+			c->errors++;
+			c->finished = TRUE;
+			return;
+		}
+		/* a mixed writer goes on on a minor of its own */
+		if (r & CDEV_CLONED) c->minor = r & ~CDEV_CLONED;
+		c->opened = TRUE;
+		client_setup(c);
+	}
+
+	/* a resampled stream isn't the one the device checks */
+	if (c->write && !c->silent) {
+		sim_dev_new_stream(SIM_SUB_DEV(c->card, SIM_DAC));
+		if (c->dev_rate > 0)
+			sim_dev_expect(SIM_SUB_DEV(c->card, SIM_DAC), 0);
+		else
+			sim_dev_expect(SIM_SUB_DEV(c->card, SIM_DAC), 
+				c->total ? played(c, c->total) : SIM_NEVER);
+	}
+
+	if ((c->buf = malloc(c->chunk)) == NULL) {
+		printf("sim: out of memory\n");
+		exit(2);
+	}
+	c->grant = sim_grant(c->buf, c->chunk);
+}
+
+
+/* the ioctls a client does right after it opened the minor */
+static void client_setup(struct sim_client *c)
+{
+	int r;
+	struct dsp_params params;
+	struct dsp_format format;
+
+	if (c->link && (r = sim_ioctl(c->minor, DSPIOLINK, &c->link)) != OK) {
+		printf("sim: DSPIOLINK failed: %d\n", r);
+		c->errors++;
+	}
+
+	/* set up the sample format like playwave(1) does */
+	if (c->rate > 0) {
+		params.rate = c->rate;
+		params.stereo = c->stereo;
+		params.bits = c->bits;
+		params.sign = (c->bits == 16);
+		params.frag_size = 0;
+		check_bad_copy(c, DSPIOPARAMS);
+		if ((r = sim_ioctl(c->minor, DSPIOPARAMS, &params)) != OK) {
+			printf("sim: DSPIOPARAMS failed: %d\n", r);
+			c->errors++;
+		} else if (params.rate != c->rate) {
+			printf("sim: rate %u set as %u\n", c->rate, params.rate);
+		}
+		/* the writer gets its rate even if the device can't do it */
+		if (r == OK && c->write && drv_get_params(&params, 
+				SIM_SUB_DEV(c->card, SIM_DAC)) == OK &&
+				params.rate != c->rate) {
+			c->dev_rate = params.rate;
+		}
+	}
+	if (c->format != DSP_FMT_NATIVE) {
+		format.format = c->format;
+		format.channels = c->stereo ? 2 : 1;
+		check_bad_copy(c, DSPIOFORMAT);
+		if ((r = sim_ioctl(c->minor, DSPIOFORMAT, &format)) != OK) {
+			printf("sim: DSPIOFORMAT %u failed: %d\n", c->format, r);
+			c->errors++;
+		}
+	}
+	if (c->poll > 0 && (r = sim_ioctl(c->minor, DSPIOPOLL, &c->poll)) != OK) {
+		printf("sim: DSPIOPOLL %u failed: %d\n", c->poll, r);
+		c->errors++;
+	}
+	if (c->periods.count > 0) check_bad_copy(c, DSPIOPERIODS);
+	if (c->periods.count > 0 &&
+			(r = sim_ioctl(c->minor, DSPIOPERIODS, &c->periods)) != OK) {
+		printf("sim: DSPIOPERIODS %u x %u failed: %d\n",
+			c->periods.count, c->periods.size, r);
+		c->errors++;
+	}
+
+	if (!c->write && c->overrun != DSP_OVERRUN_STOP &&
+			sim_ioctl(c->minor, DSPIOOVERRUN, &c->overrun) != OK) {
+		c->errors++;
+	}
+}
+
+
+/* an ioctl whose argument can't be copied in must fail with the error 
+ * of the copy, not act on what some earlier ioctl left behind */
+static void check_bad_copy(struct sim_client *c, unsigned long request)
+{
+	int r;
+
+	SIM_CALL(r = sim_tab->cdr_ioctl(c->minor, request, SIM_IOCTL_ENDPT,
+			SIM_BAD_GRANT, 0, SIM_IOCTL_ENDPT, next_id++));
+	if (r != EPERM) {
+		printf("sim: ioctl %lx with a bad grant gave %d\n", request, r);
+		c->errors++;
+	}
+}
+
+
+static void client_close(struct sim_client *c)
+{
+	int r;
+
+	c->selecting = FALSE;
+
+	/* VFS cancels a request that is still waiting before the close */
+	if (c->id != 0) {
+		SIM_CALL(r = sim_tab->cdr_cancel(c->minor, c->endpt, c->id));
+		c->id = 0;
+		if (c->draining)
+			c->draining = FALSE;
+		else if (r != EDONTREPLY)
+			client_done(c, r == EINTR ? 0 : r);
+	}
+
+	/* the ioctls of the duplex minor are about the playback */
+	if ((c->write || c->minor != SIM_MINOR(c->card, SIM_DUPLEX)) &&
+			sim_ioctl(c->minor, DSPIOSTATS, &c->stats) != OK) {
+		c->errors++;
+	}
+	if (!c->write && c->minor != SIM_MINOR(c->card, SIM_DUPLEX) &&
+			sim_ioctl(c->minor, DSPIOLOST, &c->lost) != OK) {
+		c->errors++;
+	}
+
+	/* whatever the writer got out is what the device has to play */
+	if (c->write && !c->silent && c->dev_rate == 0) 
+		sim_dev_expect(SIM_SUB_DEV(c->card, SIM_DAC), played(c, c->done));
+
+	/* the last one to close a shared open closes the minor */
+	c->opened = FALSE;
+	if (!shared_open(c)) {
+		SIM_CALL(r = sim_tab->cdr_close(c->minor));
+		if (r != OK) c->errors++;
+		deliver_irq();
+	}
+
+	sim_ungrant(c->grant);
+	free(c->buf);
+	c->buf = NULL;
+	c->finished = TRUE;
+}
+
+
+/* is the minor of a client opened by another client? */
+static int shared_open(struct sim_client *c)
+{
+	int i;
+
+	for (i = 0; i < sim_nr_clients; i++) {
+		if (&sim_clients[i] != c && sim_clients[i].opened &&
+				sim_clients[i].minor == c->minor) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+
+/* issue the next read or write of a client */
+static void client_request(struct sim_client *c)
+{
+	size_t size, i;
+	ssize_t r;
+	int flags, ops;
+	cdev_id_t id;
+
+	size = c->chunk;
+	if (c->total > 0 && c->total - c->done < size)
+		size = c->total - c->done;
+	flags = c->nonblock ? CDEV_NONBLOCK : 0;
+
+	if (c->position && c->write) check_position(c);
+
+	/* the reply may come before the call returns */
+	id = c->id = next_id++;
+	c->requests++;
+	if (c->write) {
+		if (c->format == DSP_FMT_NATIVE) {
+			for (i = 0; i < size; i++) c->buf[i] = sim_pattern(c->done + i);
+		} else {
+			for (i = 0; i < size; i++) 
+				c->buf[i] = format_byte(c, c->done + i);
+		}
+		/* silence, in the format the device plays */
+		if (c->silent) memset(c->buf, c->bits == 8 ? 0x80 : 0, size);
+		SIM_CALL(r = sim_tab->cdr_write(c->minor, 0, c->endpt, c->grant,
+				size, flags, id));
+	} else {
+		SIM_CALL(r = sim_tab->cdr_read(c->minor, 0, c->endpt, c->grant,
+				size, flags, id));
+	}
+	if (r == EDONTREPLY) return;
+
+	/* answered right away */
+	c->id = 0;
+	if (r == EAGAIN) {
+		c->eagain++;
+		if (c->select) {
+			c->wake = sim_now;
+			ops = c->write ? CDEV_OP_WR : CDEV_OP_RD;
+			SIM_CALL(r = sim_tab->cdr_select(c->minor, ops | CDEV_NOTIFY,
+					c->endpt));
+			if (r < 0) {
+				c->errors++;
+			} else if (!(r & ops)) {
+				c->selecting = TRUE;
+			}
+			return;
+		}
+		/* as if it slept until the next interrupt */
+		c->wake = sim_dev_next_event();
+		if (c->wake == SIM_NEVER) c->wake = sim_now + c->think + 1;
+		return;
+	}
+	client_done(c, r);
+}
+
+
+/* from now on the stream goes through the gain, which at 1.0 must leave
+ * it as it is */
+static void client_gain(struct sim_client *c)
+{
+	int r;
+	struct dsp_gain gain;
+
+	c->gained = TRUE;
+	gain.left = gain.right = DSP_GAIN_UNITY;
+	gain.ramp = 0;
+	check_bad_copy(c, DSPIOGAIN);
+	check_bad_copy(c, DSPIOMUTE);
+	if ((r = sim_ioctl(c->minor, DSPIOGAIN, &gain)) != OK) {
+		printf("sim: DSPIOGAIN failed: %d\n", r);
+		c->errors++;
+	}
+	/* a frame written in part isn't played any more */
+	if (!c->silent && c->dev_rate == 0 && c->total > 0)
+		sim_dev_expect(SIM_SUB_DEV(c->card, SIM_DAC), played(c, c->total));
+}
+
+
+/* a read or write of a client has finished with result r */
+static void client_done(struct sim_client *c, ssize_t r)
+{
+	c->replies++;
+	if (r < 0) {
+		printf("sim: %s on minor %d failed: %zd\n",
+			c->write ? "write" : "read", c->minor, r);
+		c->errors++;
+	} else {
+		if (!c->write) check_read(c, r);
+		c->done += r;
+	}
+	/* replies come from inside the framework; the next request, or the
+	   close, has to wait until it is done */
+	c->wake = sim_now + c->think;
+	if (c->jitter > 0) {
+		c->seed = c->seed * 1103515245 + 12345;
+		c->wake += (c->seed >> 8) % c->jitter;
+	}
+}
+
+
+/* recorded data must continue the stream, except after an overrun */
+static void check_read(struct sim_client *c, size_t size)
+{
+	size_t i;
+	u8_t b;
+
+	for (i = 0; i < size; i++) {
+		b = (u8_t) c->buf[i];
+		if (c->last >= 0 && b != (u8_t) ((c->last + 1) % 251)) c->gaps++;
+		c->last = b;
+	}
+}
+
+
+/* between two writes, what was played and what still waits must add up
+ * to what was written, or what that was resampled to at least; the 
+ * position never goes back */
+static void check_position(struct sim_client *c)
+{
+	struct dsp_position pos;
+	u32_t frame_size;
+
+	if (sim_ioctl(c->minor, DSPIOPOSITION, &pos) != OK) {
+		c->errors++;
+		return;
+	}
+	frame_size = (c->stereo ? 2 : 1) * (c->bits / 8);
+	if (pos.bytes < c->pos.bytes || pos.usec < c->pos.usec ||
+			pos.bytes + pos.delay < played(c, c->done) ||
+			(c->dev_rate == 0 && 
+			 pos.bytes + pos.delay != played(c, c->done)) ||
+			pos.frame_size != frame_size || 
+			pos.frames != pos.bytes / frame_size) {
+		printf("sim: position %llu + %u bytes after %llu written\n",
+			(unsigned long long) pos.bytes, pos.delay, 
+			(unsigned long long) c->done);
+		c->errors++;
+	}
+	c->pos = pos;
+}
+
+
+/* the bytes of the device's stream a writer's bytes make, once they are 
+ * converted; a sample written in part is not played yet. Resampled, it 
+ * is the least they make: the input the filter still waits on, up to 
+ * its taps, isn't played either. */
+static u64_t played(struct sim_client *c, u64_t bytes)
+{
+	u32_t in_frame, out_frame;
+	u64_t frames;
+
+	if (c->dev_rate > 0) {
+		out_frame = (c->stereo ? 2 : 1) * (c->bits / 8);
+		in_frame = out_frame;
+		if (c->format != DSP_FMT_NATIVE) 
+			in_frame = conv_frame_size(c->format, c->stereo ? 2 : 1);
+		frames = bytes / in_frame;
+		frames = frames > RATE_MAX_TAPS ? frames - RATE_MAX_TAPS : 0;
+		return frames * c->dev_rate / c->rate * out_frame;
+	}
+	if (c->format == DSP_FMT_NATIVE) {
+		/* through the gain it is converted from the device's format */
+		if (!c->gained) return bytes;
+		out_frame = (c->stereo ? 2 : 1) * (c->bits / 8);
+		return bytes - bytes % out_frame;
+	}
+	return bytes / conv_frame_size(c->format, 1) * (c->bits / 8);
+}
+
+
+/* the byte at an offset of the stream in the format a writer set: the
+ * samples of the device's stream, converted back. Only formats that 
+ * keep all bits of the device's samples give the stream it checks. */
+static u8_t format_byte(struct sim_client *c, u64_t offset)
+{
+	u8_t b[4];
+	u64_t n;
+	i16_t s;
+	float f;
+
+	/* the sample as signed 16 bit; 8 bit samples are unsigned, see 
+	   client_setup() */
+	n = offset / conv_frame_size(c->format, 1);
+	if (c->bits == 8) {
+		s = (i16_t) (u16_t) ((sim_pattern(n) ^ 0x80) << 8);
+	} else {
+		s = (i16_t) (u16_t) (sim_pattern(2 * n) | 
+			sim_pattern(2 * n + 1) << 8);
+	}
+
+	switch(c->format) {
+		case DSP_FMT_U8:		b[0] = (u8_t) ((s >> 8) ^ 0x80); break;
+		case DSP_FMT_S8:		b[0] = (u8_t) (s >> 8); break;
+		case DSP_FMT_S16_LE:	b[0] = (u8_t) s; b[1] = (u8_t) (s >> 8); break;
+		case DSP_FMT_S16_BE:	b[0] = (u8_t) (s >> 8); b[1] = (u8_t) s; break;
+		case DSP_FMT_U16_LE:
+			b[0] = (u8_t) s; b[1] = (u8_t) ((s >> 8) ^ 0x80); 
+			break;
+		case DSP_FMT_U16_BE:
+			b[0] = (u8_t) ((s >> 8) ^ 0x80); b[1] = (u8_t) s; 
+			break;
+		case DSP_FMT_S24_LE:
+			b[0] = 0; b[1] = (u8_t) s; b[2] = (u8_t) (s >> 8);
+			break;
+		case DSP_FMT_S32_LE:
+			b[0] = b[1] = 0; b[2] = (u8_t) s; b[3] = (u8_t) (s >> 8);
+			break;
+		default:
+			f = s / 32768.0f;
+			memcpy(b, &f, sizeof(f));
+			break;
+	}
+	return b[offset % conv_frame_size(c->format, 1)];
+}
+
+
+/* end the stream of a writer that has written all it had */
+static void client_end(struct sim_client *c)
+{
+	int r;
+
+	c->ended = TRUE;
+	if (c->end == SIM_END_DROP) {
+		client_ended(c, sim_ioctl(c->minor, DSPIODROP, NULL));
+		return;
+	}
+
+	/* the drain is answered once the device has played it all */
+	c->id = next_id++;
+	c->draining = TRUE;
+	SIM_CALL(r = sim_tab->cdr_ioctl(c->minor, DSPIODRAIN, c->endpt, 0, 0,
+			c->endpt, c->id));
+	if (r != EDONTREPLY) client_ended(c, r);
+}
+
+
+/* after a drain all was played, after a drop nothing is left */
+static void client_ended(struct sim_client *c, int r)
+{
+	struct dsp_position pos;
+
+	c->id = 0;
+	c->draining = FALSE;
+	c->wake = sim_now;
+	if (r != OK || sim_ioctl(c->minor, DSPIOPOSITION, &pos) != OK) {
+		printf("sim: %s failed: %d\n", 
+			c->end == SIM_END_DRAIN ? "DSPIODRAIN" : "DSPIODROP", r);
+		c->errors++;
+		return;
+	}
+	if (pos.delay != 0 || 
+			(c->end == SIM_END_DRAIN && pos.bytes < played(c, c->done))) {
+		printf("sim: %llu + %u bytes played after %llu written and %s\n",
+			(unsigned long long) pos.bytes, pos.delay,
+			(unsigned long long) c->done,
+			c->end == SIM_END_DRAIN ? "drained" : "dropped");
+		c->errors++;
+	}
+}
+
+
+static void select_reply(endpoint_t endpt, devminor_t minor, int ops)
+{
+	int i;
+	struct sim_client *c;
+
+	for (i = 0; i < sim_nr_clients; i++) {
+		c = &sim_clients[i];
+		if (c->endpt != endpt || c->minor != minor || !c->selecting)
+			continue;
+		if (!(ops & (c->write ? CDEV_OP_WR : CDEV_OP_RD))) c->errors++;
+		c->selecting = FALSE;
+		c->wake = sim_now;
+		return;
+	}
+	printf("sim: select reply %d on %d to %d, nobody waits\n", ops, minor,
+		endpt);
+}
+
+
+static void reply(endpoint_t endpt, cdev_id_t id, int status)
+{
+	int i;
+	struct sim_client *c;
+
+	for (i = 0; i < sim_nr_clients; i++) {
+		c = &sim_clients[i];
+		if (c->endpt != endpt || c->id != id) continue;
+		if (c->draining) {
+			client_ended(c, status);
+			return;
+		}
+		if (irq_start != 0) record_latency(sim_host_ns() - irq_start);
+		c->id = 0;
+		client_done(c, status);
+		return;
+	}
+	printf("sim: reply %d to unknown request %d of %d\n", status, id, endpt);
+}
@@ -0,0 +1,207 @@
+/* sim.h - simulation harness for libaudiodriver
+ *
+ * The harness builds audio_fw.c unchanged for a plain host. kernel.c
+ * stands in for the MINIX system calls, SEF and libchardriver. device.c
+ * is a simulated sound card behind the drv_* interface. It plays and
+ * records its dma ring at a fixed sample clock and raises an interrupt
+ * after every fragment. sim.c runs client processes against the
+ * framework's chardriver callbacks.
+ *
+ * All time is virtual, in nanoseconds, and only advances to the next
+ * device or client event. A run is therefore fully deterministic,
+ * however slow the host is. The host time spent inside the framework is
+ * measured separately.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <minix/audio_fw.h>
+#include "audio_fw_ext.h"
+#include "ioc_audio.h"
+
+#define SIM_NEVER		UINT64_MAX
+#define SIM_BAD_GRANT	1000	/* passed on purpose, copies with it fail
+								   without a message */
+#define SIM_NS			1000000000ULL	/* ns per second */
+#define SIM_DRAIN		(10 * SIM_NS)	/* longest drain after a run */
+
+#define SIM_DAC			0		/* sub device for playback, minor 0 */
+#define SIM_ADC			1		/* sub device for capture, minor 1 */
+#define SIM_NR_SUB_DEVS	2
+#define SIM_DUPLEX		2		/* minor with both, ioctls go to the dac */
+#define SIM_MIX			3		/* minor the dac's writers share */
+#define SIM_NR_SPECIAL_FILES	4
+#define SIM_MIX_CLIENTS	4		/* writers mixed on SIM_MIX */
+
+/* The device may be several cards, each with the sub devices and minors
+ * above, numbered after those of the card before it. */
+#define SIM_MAX_CARDS	3
+#define SIM_SUB_DEV(card, n)	((card) * SIM_NR_SUB_DEVS + (n))
+#define SIM_MINOR(card, n)		((card) * SIM_NR_SPECIAL_FILES + (n))
+#define SIM_IRQ			5		/* of card 0, the next ones have the next */
+
+/* configuration of the simulated device, set before sim_init() */
+struct sim_dev_conf {
+	int dma_size;				/* DmaSize of each sub device */
+	int nr_frags;				/* NrOfDmaFragments */
+	int min_frag;				/* MinFragmentSize */
+	int nr_extra;				/* NrOfExtraBuffers */
+	int nr_cards;				/* 1 up to SIM_MAX_CARDS */
+};
+
+/* a client process doing reads or writes on a minor device */
+struct sim_client {
+	/* set by the caller */
+	int card;					/* card the minor is on */
+	int minor;					/* device to use */
+	int write;					/* writes (playback) or reads */
+	size_t chunk;				/* bytes per request */
+	u64_t think;				/* ns between a reply and the next
+								   request */
+	u64_t jitter;				/* up to this much is added to think */
+	u32_t seed;					/* of the jitter, per client */
+	u64_t total;				/* bytes to transfer, 0 for no limit */
+	int nonblock;				/* use CDEV_NONBLOCK */
+	int select;					/* wait in select() after EAGAIN */
+	u64_t start;				/* time of the first request */
+	u64_t stall_at;				/* stall once at this time... */
+	u64_t stall_len;			/* ...for this long (0: never) */
+	u32_t rate;					/* sample format, 0: default */
+	u32_t stereo;
+	u32_t bits;
+	struct dsp_periods periods;	/* ring layout, count 0: default */
+	u32_t overrun;				/* DSP_OVERRUN_* for readers */
+	u32_t poll;					/* DSPIOPOLL interval in ms, 0: use
+								   interrupts */
+	int position;				/* check DSPIOPOSITION before every 
+								   write */
+	int end;					/* SIM_END_*: how a writer ends once
+								   total is reached */
+	int link;					/* DSPIOLINK on SIM_DUPLEX */
+	int silent;					/* write silence, not the stream the
+								   device checks; for mixed writers */
+	u32_t format;				/* DSP_FMT_* the stream is written in,
+								   see DSPIOFORMAT */
+	u64_t gain_at;				/* a writer sets a DSPIOGAIN of 1.0 at
+								   this time (0: never) */
+
+	/* kept by the harness */
+	endpoint_t endpt;
+	int opened;
+	u32_t dev_rate;				/* rate the device plays at, if it 
+								   resamples the writes; else 0 */
+	int finished;				/* total reached, device closed */
+	int stalled;
+	int gained;					/* did the DSPIOGAIN */
+	int selecting;				/* waiting for a select notification */
+	int ended;					/* SIM_END_DRAIN or _DROP done */
+	int draining;				/* id is a DSPIODRAIN */
+	cdev_id_t id;				/* outstanding request, 0 if none */
+	u64_t wake;					/* time of the next request */
+	u64_t done;					/* bytes transferred */
+	u64_t requests;				/* requests issued */
+	u64_t replies;				/* replies received */
+	u64_t eagain;				/* EAGAIN returns */
+	u64_t errors;				/* failed requests */
+	u64_t gaps;					/* breaks in the recorded stream */
+	struct dsp_stats stats;		/* DSPIOSTATS as of the close */
+	struct dsp_lost lost;		/* DSPIOLOST of readers, as of the close */
+	struct dsp_position pos;	/* last DSPIOPOSITION */
+	char *buf;
+	cp_grant_id_t grant;
+	int last;					/* last byte read, -1 for none */
+};
+
+#define SIM_END_CLOSE	0		/* just close, the driver plays on */
+#define SIM_END_DRAIN	1		/* DSPIODRAIN before the close */
+#define SIM_END_DROP	2		/* DSPIODROP before the close */
+
+/* counters of the harness itself */
+struct sim_stats {
+	u64_t irqs;					/* interrupt messages delivered */
+	u64_t frags;				/* fragments played or recorded */
+	u64_t copies;				/* safecopy kernel calls */
+	u64_t copy_bytes;			/* bytes copied by them */
+	u64_t calls;				/* calls into the framework */
+	u64_t host_ns;				/* host time spent in the framework */
+	u64_t host_cycles;			/* host cycles spent in the framework */
+	u64_t play_errors;			/* played bytes that were wrong */
+	u64_t lu_errors;			/* steps after which live update was
+								   ready although a client waited for 
+								   a reply, or the other way round */
+	u64_t start_skew;			/* ns between the starts of the dac and
+								   the adc, as of the last time both 
+								   started */
+};
+
+/* an irq hook the driver set with sys_irqsetpolicy */
+struct sim_irq_hook {
+	int irq;
+	int bit;					/* the id it was set with, its bit in the
+								   mask the driver's cdr_intr gets */
+	int enabled;				/* IRQ line unmasked */
+};
+
+/* host time from the start of an interrupt to each reply sent in it */
+struct sim_latency {
+	u64_t *ns;
+	size_t nr;
+	size_t max;
+};
+
+/* kernel.c */
+extern u64_t sim_now;
+extern struct chardriver *sim_tab;
+extern struct sim_stats sim_stats;
+extern struct sim_latency sim_latency;
+extern struct sim_irq_hook sim_irq_hook[SIM_MAX_CARDS];
+extern int sim_nr_irq_hooks;
+extern u64_t sim_alarm;
+extern void (*sim_reply_hook)(endpoint_t endpt, cdev_id_t id, int status);
+extern void (*sim_select_hook)(endpoint_t endpt, devminor_t minor, int ops);
+extern int (*sim_lu_prepare)(int state);
+cp_grant_id_t sim_grant(void *addr, size_t size);
+void sim_ungrant(cp_grant_id_t grant);
+void sim_shutdown(void);
+u64_t sim_host_ns(void);
+u64_t sim_host_cycles(void);
+
+/* device.c */
+extern struct sim_dev_conf sim_dev_conf;
+u64_t sim_dev_next_event(void);
+void sim_dev_tick(void);
+int sim_dev_irq_pending(int card);
+void sim_dev_new_stream(int chan);
+void sim_dev_expect(int chan, u64_t bytes);
+u8_t sim_pattern(u64_t offset);
+
+/* sim.c */
+int sim_init(void);
+void sim_step(u64_t limit);
+void sim_run(struct sim_client *clients, int nr, u64_t end);
+int sim_ioctl(int minor, unsigned long request, void *arg);
+void sim_reset_stats(void);
+u64_t sim_latency_pct(int percent);
+
+/* simtest.c, for the tests of the kernels */
+u32_t sim_rand(u32_t *seed);
+int sim_test_report(unsigned int checks, const char *what, int fail);
+
+/* Runs the statement after it once with each level of kernels that is
+ * built in, as set in conv_simd, see audio_conv.h. */
+#define SIM_EACH_KERNELS						\
+	for (conv_simd = CONV_SCALAR; conv_simd <= conv_built; conv_simd++)
+
+/* Calls into the framework are timed with these, e.g.
+ * SIM_CALL(r = sim_tab->cdr_write(...)); */
+#define SIM_CALL(call) do {						\
+		u64_t sim_ns0 = sim_host_ns();				\
+		u64_t sim_cy0 = sim_host_cycles();			\
+		call;									\
+		sim_stats.host_cycles += sim_host_cycles() - sim_cy0;	\
+		sim_stats.host_ns += sim_host_ns() - sim_ns0;	\
+		sim_stats.calls++;						\
+	} while (0)
+
+#endif /* SIM_H */
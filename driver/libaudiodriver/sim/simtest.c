@@ -0,0 +1,30 @@
+/* This file contains what the tests of the framework's kernels share:
+ * convtest, ratetest and gaintest. Each of them works its results out
+ * one sample at a time and compares them with what every set of
+ * kernels that is built in gives, see SIM_EACH_KERNELS in sim.h.
+ */
+
+#include "sim.h"
+#include "audio_conv.h"
+
+static const char *kernel_names[] = { "scalar", "sse2", "avx2" };
+
+
+/* a linear congruential generator, the same on every host; returns the
+ * new state, of which the top bits are the most random */
+u32_t sim_rand(u32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed;
+}
+
+
+/* the last line of a test: what was checked and with which kernels,
+ * and ok or FAIL; returns the exit status */
+int sim_test_report(unsigned int checks, const char *what, int fail)
+{
+	printf("%u %s, kernels up to %s\n", checks, what,
+		kernel_names[conv_built]);
+	printf("%s\n", fail ? "FAIL" : "ok");
+	return fail ? 1 : 0;
+}
@@ -16,6 +16,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <minix/sound.h>
+#include <ioc_audio.h>
 
 int main(int argc, char **argv);
 void usage(void);
@@ -71,6 +72,7 @@ int open_audio(unsigned int *fragment_size, unsigned int channels,
 {
   unsigned int sign;
   int audio;
+  struct dsp_params params;
 FUNC_LOG();
   /* Open DSP */
   if ((audio = open("/dev/audio", O_RDWR)) < 0)
@@ -79,6 +81,22 @@ FUNC_LOG();
     exit(-1);
   }
 
+  /* Set all DSP parameters at once, with the max. fragment size */
+  params.rate = samples_per_sec;
+  params.stereo = channels;
+  params.bits = bits;
+  params.sign = (bits == 16 ? 1 : 0);
+  params.frag_size = 0;
+  if (ioctl(audio, DSPIOPARAMS, &params) == 0)
+  {
+    if (params.rate != samples_per_sec)
+      fprintf(stderr, "playwave: playing at %u Hz instead of %u Hz\n",
+	params.rate, samples_per_sec);
+    *fragment_size = params.frag_size;
+    return audio;
+  }
+
+  /* The driver can't do it in one go, set them one by one */
   ioctl(audio, DSPIOMAX, fragment_size); /* Get maximum fragment size. */
 
   /* Set DSP parameters (should check return values..) */
@@ -183,26 +201,16 @@ FUNC_LOG();
   /* Play data */
   while(data_len > 0)
   {
-    if (data_len > fragment_size) 
-    {
-      /* Read next fragment */
-      read(file, buffer, fragment_size); 
-      data_len-= fragment_size;
-    }
-    else 
-    { 
-      /* Read until end of file and fill rest of buffer with silence,
-       * in PCM this means: fill buffer with last played value
-       */
-      read(file, buffer, data_len); 
-      for (i = data_len; i< fragment_size; i++) 
-        buffer[i] = buffer[(int)data_len-1];
-      data_len = 0;
-    }
+    /* Read next fragment, or what is left of the file. The driver pads
+     * an incomplete last fragment with silence itself.
+     */
+    i = (data_len > fragment_size ? fragment_size : data_len);
+    read(file, buffer, i); 
+    data_len-= i;
 
     /* Copy data to DSP */
-    r= write(audio, buffer,  fragment_size);
-    if (r != fragment_size)
+    r= write(audio, buffer, i);
+    if (r != i)
     {
 	if (r < 0)
 	{
@@ -226,8 +234,14 @@ FUNC_LOG();
 	else
 	{
 		fprintf(stderr, "playwave: partial write %d instead of %d\n",
-			r, fragment_size);
+			r, i);
 	}
     }
   }
+
+  /* Return once it has all been played. Older drivers don't know 
+   * DSPIODRAIN and play on after we exit.
+   */
+  ioctl(audio, DSPIODRAIN);
+  return 0;
 }